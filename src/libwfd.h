@@ -30,6 +30,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -717,6 +718,109 @@ static inline char *wfd_rtsp_next_token(char *tokens)
 	return tokens + strlen(tokens) + 1;
 }
 
+/**
+ * wfd_rtsp_tokenize_buf - Tokenize an RTSP line into a caller-provided buffer
+ * @line: input line
+ * @len: length of the line or -1 if zero-terminated
+ * @buf: output buffer
+ * @size: size of @buf in bytes
+ *
+ * This is the same as wfd_rtsp_tokenize() but writes the tokens into @buf
+ * instead of allocating a new buffer. Twice the line length plus 2 bytes is
+ * always enough to hold the tokenized line.
+ *
+ * This function returns the number of tokens parsed. If @buf is too small,
+ * -ENOBUFS is returned and the content of @buf is undefined.
+ */
+ssize_t wfd_rtsp_tokenize_buf(const char *line,
+			      ssize_t len,
+			      char *buf,
+			      size_t size);
+
+/**
+ * wfd_rtsp_token_flags - Token flags
+ * @WFD_RTSP_TOKEN_SPECIAL: token is a single RTSP special-char like ':'
+ * @WFD_RTSP_TOKEN_QUOTED: token is a quoted-string, the span excludes the
+ *                         surrounding quotes
+ * @WFD_RTSP_TOKEN_ESCAPED: the span contains escape-sequences or binary-0s
+ *                          and differs from the token value; use
+ *                          wfd_rtsp_token_copy() to get the value
+ */
+enum wfd_rtsp_token_flags {
+	WFD_RTSP_TOKEN_SPECIAL			= (1U << 0),
+	WFD_RTSP_TOKEN_QUOTED			= (1U << 1),
+	WFD_RTSP_TOKEN_ESCAPED			= (1U << 2),
+};
+
+/**
+ * wfd_rtsp_token - Token span
+ * @offset: offset of the token in the line
+ * @length: length of the token in the line
+ * @flags: token flags (see wfd_rtsp_token_flags)
+ *
+ * A token as returned by wfd_rtsp_token_iter_next(). It describes a span of
+ * the original line, nothing is copied.
+ */
+struct wfd_rtsp_token {
+	size_t offset;
+	size_t length;
+	unsigned int flags;
+};
+
+/**
+ * wfd_rtsp_token_iter - Token iterator
+ * @line: input line
+ * @len: length of @line
+ * @pos: current position in @line
+ *
+ * Iterator over the tokens of an RTSP line. Initialize it via
+ * wfd_rtsp_token_iter_init(), all members are private.
+ */
+struct wfd_rtsp_token_iter {
+	const char *line;
+	size_t len;
+	size_t pos;
+};
+
+/**
+ * wfd_rtsp_token_iter_init - Initialize token iterator
+ * @iter: iterator to initialize
+ * @line: input line
+ * @len: length of the line or -1 if zero-terminated
+ *
+ * This initializes @iter to iterate over the tokens of @line. The line is not
+ * copied and must stay valid while the iterator is used.
+ */
+void wfd_rtsp_token_iter_init(struct wfd_rtsp_token_iter *iter,
+			      const char *line,
+			      ssize_t len);
+
+/**
+ * wfd_rtsp_token_iter_next - Return next token
+ * @iter: token iterator
+ * @token: storage for the next token
+ *
+ * This parses the next token of the line and stores its span in @token. The
+ * tokens are the same as returned by wfd_rtsp_tokenize(), but nothing is
+ * copied or decoded. Returns false if the end of the line was reached.
+ */
+bool wfd_rtsp_token_iter_next(struct wfd_rtsp_token_iter *iter,
+			      struct wfd_rtsp_token *token);
+
+/**
+ * wfd_rtsp_token_copy - Copy token value
+ * @line: line the token was parsed from
+ * @token: token to copy
+ * @buf: output buffer, must be at least @token->length + 1 bytes
+ *
+ * This copies the value of @token into @buf, decoding any escape-sequences
+ * and removing binary-0s. The value is zero-terminated. Returns the length of
+ * the value, which is never bigger than @token->length.
+ */
+size_t wfd_rtsp_token_copy(const char *line,
+			   const struct wfd_rtsp_token *token,
+			   char *buf);
+
 /* RTSP messages */
 
 typedef void (*wfd_rtsp_log_t) (void *data,
@@ -870,10 +974,103 @@ enum wfd_rtsp_header_type {
 	WFD_RTSP_HEADER_CNT
 };
 
+/* bit of a header type in header masks */
+#define WFD_RTSP_HEADER_MASK(_type) (1ULL << (_type))
+#define WFD_RTSP_HEADER_MASK_ALL (~0ULL)
+
 const char *wfd_rtsp_header_get_name(unsigned int header);
 unsigned int wfd_rtsp_header_from_name(const char *header);
 unsigned int wfd_rtsp_header_from_name_n(const char *header, size_t len);
 
+enum wfd_rtsp_transport_lower {
+	WFD_RTSP_TRANSPORT_UNKNOWN,
+	WFD_RTSP_TRANSPORT_UDP,
+	WFD_RTSP_TRANSPORT_TCP,
+};
+
+enum wfd_rtsp_transport_flags {
+	WFD_RTSP_TRANSPORT_UNICAST			= (1U << 0),
+	WFD_RTSP_TRANSPORT_MULTICAST			= (1U << 1),
+	WFD_RTSP_TRANSPORT_CLIENT_PORT			= (1U << 2),
+	WFD_RTSP_TRANSPORT_SERVER_PORT			= (1U << 3),
+	WFD_RTSP_TRANSPORT_INTERLEAVED			= (1U << 4),
+};
+
+/**
+ * wfd_rtsp_transport - Parsed transport-spec
+ * @lower: lower transport of RTP/AVP, WFD_RTSP_TRANSPORT_UNKNOWN if the
+ *         transport-spec was not understood
+ * @flags: wfd_rtsp_transport_flags of the parameters present
+ * @client_port: client_port range
+ * @server_port: server_port range
+ * @interleaved: interleaved channel range
+ *
+ * If just a single value was given, the upper bound of its range equals the
+ * lower bound.
+ */
+struct wfd_rtsp_transport {
+	unsigned int lower;
+	unsigned int flags;
+	uint16_t client_port[2];
+	uint16_t server_port[2];
+	uint8_t interleaved[2];
+};
+
+/**
+ * wfd_rtsp_transport_parse - Parse Transport header value
+ * @value: header value, does not need to be sanitized or zero-terminated
+ * @len: length of @value
+ * @transport: storage for the result
+ *
+ * Parses the first transport-spec of @value that is RTP/AVP over UDP or TCP.
+ * Specs of other protocols and malformed specs (like reversed ranges) are
+ * skipped, unknown parameters are ignored. The decoder does this for the
+ * first Transport line it understands and stores the result in the transport
+ * member of the header; for headers indexed via
+ * WFD_RTSP_DECODER_F_LAZY_HEADERS, this can be called on the raw field.
+ *
+ * Returns 0 on success, -EINVAL if no spec of @value can be parsed.
+ */
+int wfd_rtsp_transport_parse(const char *value,
+			     size_t len,
+			     struct wfd_rtsp_transport *transport);
+
+/**
+ * wfd_rtsp_session - Parsed Session header
+ * @id: session-id, points into the parsed value and is not zero-terminated;
+ *      NULL if no valid session-id was found
+ * @length: length of @id
+ * @hash: hash of @id as returned by wfd_rtsp_session_hash()
+ * @timeout: timeout parameter in seconds, 0 if not given
+ */
+struct wfd_rtsp_session {
+	const char *id;
+	size_t length;
+	uint32_t hash;
+	unsigned long timeout;
+};
+
+/**
+ * wfd_rtsp_session_parse - Parse Session header value
+ * @value: header value, does not need to be sanitized or zero-terminated
+ * @len: length of @value
+ * @session: storage for the result
+ *
+ * Parses the session-id and timeout of @value. Unknown parameters are skipped.
+ * The decoder does this for the first valid Session line and stores the
+ * result in the session member of the header; for headers indexed via
+ * WFD_RTSP_DECODER_F_LAZY_HEADERS, this can be called on the raw field.
+ * @session->id points into @value.
+ *
+ * Returns 0 on success, -EINVAL if @value cannot be parsed.
+ */
+int wfd_rtsp_session_parse(const char *value,
+			   size_t len,
+			   struct wfd_rtsp_session *session);
+
+/* return hash of the session-id @id of length @len */
+uint32_t wfd_rtsp_session_hash(const char *id, size_t len);
+
 struct wfd_rtsp_msg {
 	unsigned int type;
 
@@ -899,7 +1096,14 @@ struct wfd_rtsp_msg {
 		};
 	} id;
 
+	/* Headers are stored sparsely: bit N of @header_mask is set if a
+	 * header of type N is present, @present_headers holds the @n_headers
+	 * present headers ordered by type. It is not indexed by type, use
+	 * wfd_rtsp_msg_get_header() to look up a header by type. */
+	uint64_t header_mask;
+	size_t n_headers;
 	struct wfd_rtsp_msg_header {
+		unsigned int type;
 		size_t count;
 		char **lines;
 		size_t *lengths;
@@ -907,8 +1111,26 @@ struct wfd_rtsp_msg {
 		union {
 			size_t content_length;
 			unsigned long cseq;
+			struct wfd_rtsp_transport transport;
+			struct wfd_rtsp_session session;
 		};
-	} headers[WFD_RTSP_HEADER_CNT];
+	} *present_headers;
+
+	/* Raw header lines, only filled by decoders with
+	 * WFD_RTSP_DECODER_F_LAZY_HEADERS set. @fields indexes the @n_fields
+	 * lines stored back to back in @raw in order of arrival, bit N of
+	 * @field_mask is set if a line of type N is present. @raw is not
+	 * zero-terminated. Use wfd_rtsp_msg_get_field() to access them. */
+	uint64_t field_mask;
+	size_t n_fields;
+	struct wfd_rtsp_msg_field {
+		unsigned int type;
+		size_t offset;		/* offset of the line in @raw */
+		size_t length;		/* length of the line */
+		size_t value;		/* offset of the value in the line */
+	} *fields;
+	char *raw;
+	size_t raw_size;
 
 	struct wfd_rtsp_msg_entity {
 		void *value;
@@ -916,6 +1138,96 @@ struct wfd_rtsp_msg {
 	} entity;
 };
 
+/**
+ * wfd_rtsp_msg_has_header - Check whether a header is present
+ * @msg: message to check
+ * @type: header type
+ *
+ * Returns true if @msg contains at least one header line of type @type.
+ */
+static inline bool wfd_rtsp_msg_has_header(const struct wfd_rtsp_msg *msg,
+					   unsigned int type)
+{
+	return type < WFD_RTSP_HEADER_CNT &&
+	       (msg->header_mask & (1ULL << type));
+}
+
+/**
+ * wfd_rtsp_msg_get_header - Get header of a given type
+ * @msg: message to search
+ * @type: header type
+ *
+ * Returns the header of type @type in @msg. If @msg doesn't contain such a
+ * header, an empty header with a count of 0 is returned instead, so this never
+ * returns NULL. This is the replacement for the former &msg->headers[type].
+ */
+const struct wfd_rtsp_msg_header *
+wfd_rtsp_msg_get_header(const struct wfd_rtsp_msg *msg, unsigned int type);
+
+/**
+ * wfd_rtsp_msg_get_field - Get raw value of a header line
+ * @msg: message to search
+ * @type: header type
+ * @idx: index of the line among all lines of type @type
+ * @len: storage for the length of the value, or NULL
+ *
+ * Returns the value of the @idx'th header line of type @type that was indexed
+ * with WFD_RTSP_DECODER_F_LAZY_HEADERS, or NULL if there is no such line. For
+ * WFD_RTSP_HEADER_UNKNOWN, the whole line is returned. The value points into
+ * @msg->raw and is neither sanitized nor zero-terminated: it may contain
+ * folded line-breaks and binary 0s. It can be passed to
+ * wfd_rtsp_token_iter_init() as is, which skips both.
+ */
+const char *wfd_rtsp_msg_get_field(const struct wfd_rtsp_msg *msg,
+				   unsigned int type,
+				   size_t idx,
+				   size_t *len);
+
+/**
+ * wfd_rtsp_msg_copy_field - Copy sanitized value of a header line
+ * @msg: message to search
+ * @type: header type
+ * @idx: index of the line among all lines of type @type
+ * @buf: destination buffer
+ * @size: size of @buf, must exceed the raw length of the value
+ *
+ * Same as wfd_rtsp_msg_get_field() but copies the value into @buf the way
+ * the decoder sanitizes header lines: folded lines are joined, binary 0s are
+ * dropped outside of quoted-strings and whitespace is collapsed. The copy is
+ * zero-terminated.
+ * Returns the length of the copy, -ENOENT if there is no such line or -ENOBUFS
+ * if @buf is too small.
+ */
+ssize_t wfd_rtsp_msg_copy_field(const struct wfd_rtsp_msg *msg,
+				unsigned int type,
+				size_t idx,
+				char *buf,
+				size_t size);
+
+/**
+ * wfd_rtsp_msg_ref - Retain a decoded message
+ * @msg: message to retain
+ *
+ * Messages delivered by a decoder are reference-counted. The decoder drops its
+ * own reference once the event callback returns, so any message that is still
+ * needed afterwards must be retained via wfd_rtsp_msg_ref(). The decoder then
+ * continues with a fresh message and the retained one, including all its header
+ * lines and its entity, stays valid until it's released via
+ * wfd_rtsp_msg_unref(). Released messages are recycled by the decoder they
+ * came from. They may be released from a different thread than the decoder
+ * runs in and they may outlive their decoder.
+ * This must only be called on messages that were delivered by a decoder.
+ */
+void wfd_rtsp_msg_ref(struct wfd_rtsp_msg *msg);
+
+/**
+ * wfd_rtsp_msg_unref - Release a decoded message
+ * @msg: message to release, or NULL
+ *
+ * Drops a reference taken via wfd_rtsp_msg_ref().
+ */
+void wfd_rtsp_msg_unref(struct wfd_rtsp_msg *msg);
+
 /* rtsp decoder */
 
 struct wfd_rtsp_decoder;
@@ -924,6 +1236,53 @@ enum wfd_rtsp_decoder_event_type {
 	WFD_RTSP_DECODER_MSG,
 	WFD_RTSP_DECODER_DATA,
 	WFD_RTSP_DECODER_ERROR,
+	WFD_RTSP_DECODER_BODY_CHUNK,
+	WFD_RTSP_DECODER_HEADERS,
+};
+
+/**
+ * wfd_rtsp_decoder_body - Entity handling
+ * @WFD_RTSP_DECODER_BODY_BUFFER: Collect the entity and submit it with the
+ *                                message once complete.
+ * @WFD_RTSP_DECODER_BODY_STREAM: Submit the message right away and pass the
+ *                                entity as WFD_RTSP_DECODER_BODY_CHUNK events.
+ * @WFD_RTSP_DECODER_BODY_DISCARD: Submit the message right away and drop the
+ *                                 entity.
+ */
+enum wfd_rtsp_decoder_body {
+	WFD_RTSP_DECODER_BODY_BUFFER,
+	WFD_RTSP_DECODER_BODY_STREAM,
+	WFD_RTSP_DECODER_BODY_DISCARD,
+};
+
+/**
+ * wfd_rtsp_decoder_error_reason - Reasons for WFD_RTSP_DECODER_ERROR events
+ * @WFD_RTSP_DECODER_E_SYNTAX: A message was malformed beyond repair.
+ * @WFD_RTSP_DECODER_E_LINE: A header-line exceeded @max_line.
+ * @WFD_RTSP_DECODER_E_HEADERS: A message exceeded @max_headers.
+ * @WFD_RTSP_DECODER_E_ENTITY: An entity to buffer exceeded @max_entity.
+ * @WFD_RTSP_DECODER_E_BUFFER: The input buffer exceeded @max_buffer.
+ * @WFD_RTSP_DECODER_E_BUDGET: The input buffer would exceed the global budget
+ *                             set via wfd_rtsp_decoder_set_budget().
+ * @WFD_RTSP_DECODER_E_SKIPPED: Input was skipped while resynchronizing.
+ *
+ * If the decoder cannot continue with the current message, the
+ * WFD_RTSP_DECODER_ERROR event is sent with @error.reason set accordingly.
+ * @error.data and @error.length describe the dropped input that was buffered
+ * for the current element of the message, if any. It is only valid during the
+ * callback. Unless WFD_RTSP_DECODER_F_RESYNC is set, wfd_rtsp_decoder_feed()
+ * then fails with -EMSGSIZE for message limits, -ENOBUFS for buffer limits or
+ * another negative error code, and the decoder must be reset before it can be
+ * used again.
+ */
+enum wfd_rtsp_decoder_error_reason {
+	WFD_RTSP_DECODER_E_SYNTAX,
+	WFD_RTSP_DECODER_E_LINE,
+	WFD_RTSP_DECODER_E_HEADERS,
+	WFD_RTSP_DECODER_E_ENTITY,
+	WFD_RTSP_DECODER_E_BUFFER,
+	WFD_RTSP_DECODER_E_BUDGET,
+	WFD_RTSP_DECODER_E_SKIPPED,
 };
 
 struct wfd_rtsp_decoder_event {
@@ -935,14 +1294,100 @@ struct wfd_rtsp_decoder_event {
 			uint8_t channel;
 			uint16_t size;
 			uint8_t *value;
+			size_t n_vec;
+			struct iovec vec[2];
 		} data;
 		struct wfd_rtsp_decoder_error {
+			unsigned int reason;
 			void *data;
 			size_t length;
 		} error;
+		struct wfd_rtsp_decoder_headers {
+			struct wfd_rtsp_msg *msg;
+			unsigned int body;
+		} headers;
+		struct wfd_rtsp_decoder_chunk {
+			const uint8_t *value;
+			size_t size;
+			size_t offset;
+			size_t total;
+		} chunk;
 	};
 };
 
+/**
+ * wfd_rtsp_decoder_flags - Decoder flags
+ * @WFD_RTSP_DECODER_F_ZERO_COPY: Deliver interleaved data without copying it.
+ *                                If a frame is contiguous in the input-buffer
+ *                                or internal buffer, @data.value points
+ *                                directly into it. Otherwise, @data.value is
+ *                                NULL and the frame is described by the
+ *                                2-element iovec @data.vec. In either case,
+ *                                the data is only valid during the callback
+ *                                and is not zero-terminated.
+ *
+ * @WFD_RTSP_DECODER_F_STREAM_BODY: Don't buffer entities. The
+ *                                  WFD_RTSP_DECODER_MSG event is sent as soon
+ *                                  as the headers are complete, with an empty
+ *                                  @msg->entity. The entity follows as
+ *                                  WFD_RTSP_DECODER_BODY_CHUNK events. Each
+ *                                  chunk describes @chunk.size bytes at
+ *                                  @chunk.offset of the @chunk.total bytes
+ *                                  announced by Content-Length, so the last
+ *                                  chunk is the one that reaches
+ *                                  @chunk.total. Chunks point into the
+ *                                  input-buffer and are only valid during the
+ *                                  callback.
+ * @WFD_RTSP_DECODER_F_HEADERS: Send a WFD_RTSP_DECODER_HEADERS event as soon
+ *                              as the empty line after the headers was
+ *                              received, before any entity is read. The
+ *                              callback can inspect @headers.msg and set
+ *                              @headers.body to one of wfd_rtsp_decoder_body
+ *                              to choose how the entity of this message is
+ *                              handled. It is preset according to
+ *                              WFD_RTSP_DECODER_F_STREAM_BODY. The
+ *                              WFD_RTSP_DECODER_MSG event follows as usual.
+ * @WFD_RTSP_DECODER_F_RESYNC: Don't give up on malformed input. Instead of
+ *                             failing, the decoder drops the broken message
+ *                             and skips input until something looks like the
+ *                             start of a message or data frame: "RTSP/", a
+ *                             known method name followed by a space, or '$'.
+ *                             Skipped input is reported via
+ *                             WFD_RTSP_DECODER_ERROR events with reason
+ *                             WFD_RTSP_DECODER_E_SKIPPED, pointing into the
+ *                             input-buffer. The first ID-line after a resync
+ *                             must be a response or a request with a known
+ *                             method, otherwise the decoder resyncs again.
+ *                             Errors raised once the header is complete,
+ *                             like WFD_RTSP_DECODER_E_ENTITY, drop the
+ *                             message and discard the rest of its entity
+ *                             instead, as its length is known.
+ *                             Memory allocation failures and errors returned
+ *                             by the callback are still fatal.
+ * @WFD_RTSP_DECODER_F_LAZY_HEADERS: Don't parse header lines into
+ *                                   @msg->present_headers. Instead, they're
+ *                                   copied into @msg->raw as is and indexed
+ *                                   in @msg->fields, to be accessed via
+ *                                   wfd_rtsp_msg_get_field(). Only
+ *                                   Content-Length and CSeq are parsed into
+ *                                   @msg->present_headers, too. Header names
+ *                                   must be plain tokens, as required by
+ *                                   RFC 2326, other lines are indexed as
+ *                                   WFD_RTSP_HEADER_UNKNOWN. The line limit
+ *                                   applies to the raw line without trailing
+ *                                   whitespace.
+ *
+ * Without WFD_RTSP_DECODER_F_ZERO_COPY, @data.value is a zero-terminated copy
+ * of the frame and @data.vec[0] describes the same buffer.
+ */
+enum wfd_rtsp_decoder_flags {
+	WFD_RTSP_DECODER_F_ZERO_COPY			= (1U << 0),
+	WFD_RTSP_DECODER_F_STREAM_BODY			= (1U << 1),
+	WFD_RTSP_DECODER_F_HEADERS			= (1U << 2),
+	WFD_RTSP_DECODER_F_RESYNC			= (1U << 3),
+	WFD_RTSP_DECODER_F_LAZY_HEADERS			= (1U << 4),
+};
+
 typedef int (*wfd_rtsp_decoder_event_t) (struct wfd_rtsp_decoder *dec,
 					 void *data,
 					 struct wfd_rtsp_decoder_event *event);
@@ -957,11 +1402,552 @@ void wfd_rtsp_decoder_reset(struct wfd_rtsp_decoder *dec);
 
 void wfd_rtsp_decoder_set_data(struct wfd_rtsp_decoder *dec, void *data);
 void *wfd_rtsp_decoder_get_data(struct wfd_rtsp_decoder *dec);
+void wfd_rtsp_decoder_set_flags(struct wfd_rtsp_decoder *dec,
+				unsigned int flags);
+unsigned int wfd_rtsp_decoder_get_flags(struct wfd_rtsp_decoder *dec);
+
+/**
+ * wfd_rtsp_decoder_limits - Decoder memory limits
+ * @max_line: Maximum length of a single header-line, excluding the line-break.
+ * @max_headers: Maximum number of header-lines per message, excluding the
+ *               request- or status-line.
+ * @max_entity: Maximum Content-Length of entities that are buffered. Streamed
+ *              and discarded entities are not limited. Buffered entities
+ *              grow as their input arrives, so the announced length alone
+ *              doesn't allocate memory.
+ * @max_buffer: Maximum number of input bytes buffered at any time, apart from
+ *              buffered entities.
+ * @max_events: Maximum number of events queued in pull-mode. Once reached,
+ *              wfd_rtsp_decoder_feed() fails with -EAGAIN without consuming
+ *              any input until events were pulled. A single feed may queue
+ *              past the limit, as its input is parsed as a whole.
+ *
+ * A limit of 0 means unlimited, which is the default for all limits.
+ */
+struct wfd_rtsp_decoder_limits {
+	size_t max_line;
+	size_t max_headers;
+	size_t max_entity;
+	size_t max_buffer;
+	size_t max_events;
+};
+
+void wfd_rtsp_decoder_set_limits(struct wfd_rtsp_decoder *dec,
+				 const struct wfd_rtsp_decoder_limits *limits);
+void wfd_rtsp_decoder_get_limits(struct wfd_rtsp_decoder *dec,
+				 struct wfd_rtsp_decoder_limits *limits);
+
+/**
+ * wfd_rtsp_decoder_set_budget - Set global buffer budget
+ * @max: maximum number of bytes, or 0 for unlimited
+ *
+ * Limits the memory all decoders together may allocate for buffering input.
+ * This covers the input ring-buffers, buffered entities and, in pull-mode,
+ * payloads of queued data frames and body chunks until they're recycled.
+ * Parsed headers are bounded by the line and header limits instead and are not
+ * charged. Memory already allocated is not affected, but decoders fail with
+ * WFD_RTSP_DECODER_E_BUDGET once they'd have to grow their buffers beyond the
+ * budget.
+ */
+void wfd_rtsp_decoder_set_budget(size_t max);
+
+/* return memory currently charged against the global budget */
+size_t wfd_rtsp_decoder_get_budget_used(void);
+
+/**
+ * wfd_rtsp_decoder_get_space - Query how much input the decoder accepts
+ * @dec: decoder object
+ *
+ * Returns the number of bytes that can be buffered by @dec before it hits its
+ * buffer or line limits, or the global budget. Callers should stop reading
+ * from their source while this is 0. Input that is passed through without
+ * buffering, like streamed entities, does not count against this. In
+ * pull-mode, this is 0 while @max_events events are queued.
+ * SIZE_MAX is returned if no limit applies, 0 if @dec is NULL or dead.
+ */
+size_t wfd_rtsp_decoder_get_space(struct wfd_rtsp_decoder *dec);
+
+/**
+ * wfd_rtsp_decoder_set_interest - Select headers to parse
+ * @dec: decoder object
+ * @mask: mask of header types, built via WFD_RTSP_HEADER_MASK()
+ *
+ * Header lines whose type is not in @mask are dropped without being parsed or
+ * copied into the message. This includes WFD_RTSP_HEADER_UNKNOWN lines, unless
+ * its bit is set. Content-Length is always parsed, as it's needed to frame the
+ * message. Dropped lines still count against the @max_headers limit.
+ * By default, all headers are parsed (WFD_RTSP_HEADER_MASK_ALL).
+ */
+void wfd_rtsp_decoder_set_interest(struct wfd_rtsp_decoder *dec,
+				   uint64_t mask);
+uint64_t wfd_rtsp_decoder_get_interest(struct wfd_rtsp_decoder *dec);
 
 int wfd_rtsp_decoder_feed(struct wfd_rtsp_decoder *dec,
 			  const void *buf,
 			  size_t len);
 
+/**
+ * wfd_rtsp_decoder_next - Return next pending event
+ * @dec: decoder object
+ * @ev: storage for the event
+ *
+ * If the decoder was created without event callback, it runs in pull-mode:
+ * wfd_rtsp_decoder_feed() only parses the input and queues all events, which
+ * are then retrieved one by one via this function. Events stay valid until the
+ * next call to wfd_rtsp_decoder_next(), wfd_rtsp_decoder_next_batch(),
+ * wfd_rtsp_decoder_reset() or wfd_rtsp_decoder_free(). Feeding more data does
+ * not invalidate them. Messages can be retained beyond that via
+ * wfd_rtsp_msg_ref().
+ * In pull-mode, payloads of data frames and body chunks are always copied and
+ * zero-terminated, as the input-buffer is gone once wfd_rtsp_decoder_feed()
+ * returns. WFD_RTSP_DECODER_F_HEADERS has no effect, as there is no callback
+ * to decide on the entity. The @max_events limit bounds the number of pending
+ * events.
+ *
+ * Returns 0 on success, -EAGAIN if no event is pending or another negative
+ * error code on failure.
+ */
+int wfd_rtsp_decoder_next(struct wfd_rtsp_decoder *dec,
+			  struct wfd_rtsp_decoder_event *ev);
+
+/**
+ * wfd_rtsp_decoder_next_batch - Return multiple pending events
+ * @dec: decoder object
+ * @evs: storage for the events
+ * @max: number of events @evs can hold
+ *
+ * Same as wfd_rtsp_decoder_next() but returns up to @max pending events in
+ * order. All of them stay valid until the next call to
+ * wfd_rtsp_decoder_next*().
+ *
+ * Returns the number of events stored in @evs, -EAGAIN if no event is pending
+ * or another negative error code on failure.
+ */
+ssize_t wfd_rtsp_decoder_next_batch(struct wfd_rtsp_decoder *dec,
+				    struct wfd_rtsp_decoder_event *evs,
+				    size_t max);
+
+/* rtsp framing */
+
+enum wfd_rtsp_frame_type {
+	WFD_RTSP_FRAME_MSG,
+	WFD_RTSP_FRAME_DATA,
+};
+
+/**
+ * wfd_rtsp_frame - Boundaries of a buffered message or data frame
+ * @type: WFD_RTSP_FRAME_MSG or WFD_RTSP_FRAME_DATA
+ * @offset: offset of the frame in the scanned buffer
+ * @length: total length of the frame, that is @head_length + @entity_length
+ * @head_length: length of the message header including the empty line, or 4
+ *               for the head of data frames
+ * @entity_length: Content-Length of messages, payload size of data frames
+ * @id_length: length of the ID-line of messages, without line-break
+ * @channel: channel-id of data frames
+ */
+struct wfd_rtsp_frame {
+	unsigned int type;
+	size_t offset;
+	size_t length;
+	size_t head_length;
+	size_t entity_length;
+	size_t id_length;
+	uint8_t channel;
+};
+
+/**
+ * wfd_rtsp_frame_scan - Find complete frames in a buffer
+ * @buf: buffer to scan, usually a peek into a socket buffer
+ * @len: length of @buf
+ * @frames: storage for the frames found, or NULL to only count them
+ * @max: maximum number of frames to find
+ * @consumed: set to the end of the last frame found, if not NULL
+ *
+ * Scans @buf for complete RTSP messages and interleaved data frames and
+ * reports their boundaries, without decoding them. This is much cheaper than
+ * feeding the decoder, as lines are neither sanitized nor tokenized and
+ * nothing is allocated, but it agrees with the decoder on where each frame
+ * ends. The ID-line is located via @offset and @id_length, so callers can
+ * look at the method or status to prioritize, drop or coalesce frames. A
+ * trailing incomplete frame is not reported.
+ *
+ * Returns the number of frames found, or a negative error code if the first
+ * frame is malformed. A malformed frame after valid ones just ends the scan.
+ */
+ssize_t wfd_rtsp_frame_scan(const void *buf,
+			    size_t len,
+			    struct wfd_rtsp_frame *frames,
+			    size_t max,
+			    size_t *consumed);
+
+/* rtsp encoder */
+
+struct wfd_rtsp_encoder;
+
+int wfd_rtsp_encoder_new(wfd_rtsp_log_t log_fn,
+			 void *log_data,
+			 struct wfd_rtsp_encoder **out);
+void wfd_rtsp_encoder_free(struct wfd_rtsp_encoder *enc);
+void wfd_rtsp_encoder_reset(struct wfd_rtsp_encoder *enc);
+
+/**
+ * wfd_rtsp_encoder_request - Start encoding a request
+ * @enc: encoder object
+ * @method: request method, must not be WFD_RTSP_METHOD_UNKNOWN
+ * @uri: request URI, or "*"
+ *
+ * Starts a new message with an RTSP/1.0 request-line. Headers are added via
+ * wfd_rtsp_encoder_header*() and the message is finished with
+ * wfd_rtsp_encoder_end(). Only one message can be open at a time.
+ *
+ * The encoder references strings instead of copying them, unless they're very
+ * short. Hence, @uri, header values and entities must stay valid and unchanged
+ * until the encoded output was consumed or the encoder was reset.
+ *
+ * Returns 0 on success, -EBUSY if a message is already open or another
+ * negative error code on failure. Failed calls don't add any output.
+ */
+int wfd_rtsp_encoder_request(struct wfd_rtsp_encoder *enc,
+			     unsigned int method,
+			     const char *uri);
+
+/**
+ * wfd_rtsp_encoder_response - Start encoding a response
+ * @enc: encoder object
+ * @status: status code
+ * @phrase: reason phrase, or NULL for the default description of @status
+ *
+ * Same as wfd_rtsp_encoder_request() but starts a response.
+ */
+int wfd_rtsp_encoder_response(struct wfd_rtsp_encoder *enc,
+			      unsigned int status,
+			      const char *phrase);
+
+/**
+ * wfd_rtsp_encoder_header - Add header line to the open message
+ * @enc: encoder object
+ * @type: header type, must be a known header other than Content-Length
+ * @value: header value, must not contain line-breaks
+ *
+ * Adds "<name>: <value>" to the open message. The name is taken from the
+ * static header-name table. wfd_rtsp_encoder_header_n() takes a @value that
+ * is not zero-terminated. wfd_rtsp_encoder_header_u() and
+ * wfd_rtsp_encoder_header_fmt() format the value into the encoder instead of
+ * referencing it, the former is meant for numeric headers like CSeq.
+ * Content-Length is added by wfd_rtsp_encoder_end().
+ */
+int wfd_rtsp_encoder_header(struct wfd_rtsp_encoder *enc,
+			    unsigned int type,
+			    const char *value);
+int wfd_rtsp_encoder_header_n(struct wfd_rtsp_encoder *enc,
+			      unsigned int type,
+			      const char *value,
+			      size_t len);
+int wfd_rtsp_encoder_header_u(struct wfd_rtsp_encoder *enc,
+			      unsigned int type,
+			      unsigned long value);
+int wfd_rtsp_encoder_header_fmt(struct wfd_rtsp_encoder *enc,
+				unsigned int type,
+				const char *format,
+				...)
+	__attribute__((__format__(printf, 3, 4)));
+
+/**
+ * wfd_rtsp_encoder_end - Finish the open message
+ * @enc: encoder object
+ * @entity: message entity, or NULL
+ * @size: size of @entity
+ *
+ * Adds the Content-Length header if @size is non-zero, the empty line and the
+ * referenced entity. The message is then part of the encoded output.
+ */
+int wfd_rtsp_encoder_end(struct wfd_rtsp_encoder *enc,
+			 const void *entity,
+			 size_t size);
+
+/**
+ * wfd_rtsp_encoder_data - Encode an interleaved data frame
+ * @enc: encoder object
+ * @channel: channel-id
+ * @data: payload, referenced like entities
+ * @size: size of @data, at most 65535
+ *
+ * Returns 0 on success, -EBUSY if a message is open, -EMSGSIZE if @size is too
+ * big or another negative error code on failure.
+ */
+int wfd_rtsp_encoder_data(struct wfd_rtsp_encoder *enc,
+			  uint8_t channel,
+			  const void *data,
+			  size_t size);
+
+/**
+ * wfd_rtsp_encoder_get_iov - Return encoded output
+ * @enc: encoder object
+ * @n: storage for the number of vectors
+ *
+ * Returns the encoded output of all finished messages and data frames that
+ * wasn't consumed, yet, as an array of *@n vectors for writev() or sendmsg().
+ * Callers must not pass more than IOV_MAX vectors at once. The array stays
+ * valid until the encoder is used again. NULL is returned if there is no
+ * output.
+ */
+const struct iovec *wfd_rtsp_encoder_get_iov(struct wfd_rtsp_encoder *enc,
+					     size_t *n);
+
+/* return number of bytes described by wfd_rtsp_encoder_get_iov() */
+size_t wfd_rtsp_encoder_get_size(struct wfd_rtsp_encoder *enc);
+
+/**
+ * wfd_rtsp_encoder_consume - Drop sent output
+ * @enc: encoder object
+ * @len: number of bytes that were sent
+ *
+ * Drops the first @len bytes of the encoded output, usually the return value
+ * of writev(). Once all output was consumed, the encoder reuses its buffers.
+ */
+void wfd_rtsp_encoder_consume(struct wfd_rtsp_encoder *enc, size_t len);
+
+/* rtsp response templates */
+
+struct wfd_rtsp_template;
+
+/**
+ * wfd_rtsp_template_new - Create response template
+ * @status: status code
+ * @phrase: reason phrase, or NULL for the default description of @status
+ * @out: storage for the new template
+ *
+ * Templates serialize the status-line and header lines of frequent responses
+ * once. Header lines are either fixed, added via
+ * wfd_rtsp_template_add_header(), or variable fields, added via
+ * wfd_rtsp_template_add_field(), whose values are passed to
+ * wfd_rtsp_encoder_template() each time the template is encoded.
+ * The template is referenced by the encoded output, so it must not be freed
+ * or extended before that output was consumed. Built templates can be shared
+ * between encoders.
+ */
+int wfd_rtsp_template_new(unsigned int status,
+			  const char *phrase,
+			  struct wfd_rtsp_template **out);
+void wfd_rtsp_template_free(struct wfd_rtsp_template *tpl);
+
+/* add fixed header line; @value is copied */
+int wfd_rtsp_template_add_header(struct wfd_rtsp_template *tpl,
+				 unsigned int type,
+				 const char *value);
+
+/* add variable header line; returns the index of its value or <0 on error */
+int wfd_rtsp_template_add_field(struct wfd_rtsp_template *tpl,
+				unsigned int type);
+
+/**
+ * wfd_rtsp_template_value - Value of a variable template field
+ * @str: zero-terminated value, referenced like header values, or NULL
+ * @num: number to format if @str is NULL
+ */
+struct wfd_rtsp_template_value {
+	const char *str;
+	unsigned long num;
+};
+
+/**
+ * wfd_rtsp_encoder_template - Encode a response from a template
+ * @enc: encoder object
+ * @tpl: template to encode
+ * @values: one value per field of @tpl, in the order they were added
+ * @n_values: number of fields of @tpl
+ * @entity: message entity, or NULL
+ * @size: size of @entity
+ *
+ * Encodes a complete response, like wfd_rtsp_encoder_response() followed by
+ * all header lines of @tpl and wfd_rtsp_encoder_end() would. No message must
+ * be open.
+ */
+int wfd_rtsp_encoder_template(struct wfd_rtsp_encoder *enc,
+			      const struct wfd_rtsp_template *tpl,
+			      const struct wfd_rtsp_template_value *values,
+			      size_t n_values,
+			      const void *entity,
+			      size_t size);
+
+/* rtsp session table */
+
+struct wfd_rtsp_session_table;
+
+/**
+ * wfd_rtsp_session_table_new - Create session table
+ * @out: storage for the new table
+ *
+ * Session tables map session-ids to caller data, so incoming requests can be
+ * routed to their session in constant time. Lookups compare the precomputed
+ * hash first, so the id itself is compared only once per hit.
+ */
+int wfd_rtsp_session_table_new(struct wfd_rtsp_session_table **out);
+void wfd_rtsp_session_table_free(struct wfd_rtsp_session_table *tbl);
+
+/* return number of sessions in @tbl */
+size_t wfd_rtsp_session_table_get_count(struct wfd_rtsp_session_table *tbl);
+
+/**
+ * wfd_rtsp_session_table_add - Add session
+ * @tbl: session table
+ * @id: session-id, does not need to be zero-terminated
+ * @len: length of @id
+ * @data: caller data to store for @id, must not be NULL
+ *
+ * A copy of @id is stored in @tbl.
+ * Returns 0 on success, -EEXIST if @id is already in @tbl or another negative
+ * error code on failure.
+ */
+int wfd_rtsp_session_table_add(struct wfd_rtsp_session_table *tbl,
+			       const char *id,
+			       size_t len,
+			       void *data);
+
+/* remove @id from @tbl and return its data, or NULL if not found */
+void *wfd_rtsp_session_table_remove(struct wfd_rtsp_session_table *tbl,
+				    const char *id,
+				    size_t len);
+
+/* return data of @id in @tbl, or NULL if not found */
+void *wfd_rtsp_session_table_find(struct wfd_rtsp_session_table *tbl,
+				  const char *id,
+				  size_t len);
+
+/**
+ * wfd_rtsp_session_table_lookup - Look up parsed session
+ * @tbl: session table
+ * @session: parsed Session header
+ *
+ * Same as wfd_rtsp_session_table_find() but uses the hash that was computed
+ * while parsing @session. Usually called with the session member of the
+ * Session header of a decoded message.
+ * Returns the data of the session, or NULL if not found.
+ */
+void *wfd_rtsp_session_table_lookup(struct wfd_rtsp_session_table *tbl,
+				    const struct wfd_rtsp_session *session);
+
+/* rtsp wfd parameters */
+
+enum wfd_rtsp_param_type {
+	WFD_RTSP_PARAM_UNKNOWN,
+
+	WFD_RTSP_PARAM_AUDIO_CODECS,
+	WFD_RTSP_PARAM_VIDEO_FORMATS,
+	WFD_RTSP_PARAM_3D_VIDEO_FORMATS,
+	WFD_RTSP_PARAM_CONTENT_PROTECTION,
+	WFD_RTSP_PARAM_DISPLAY_EDID,
+	WFD_RTSP_PARAM_COUPLED_SINK,
+	WFD_RTSP_PARAM_TRIGGER_METHOD,
+	WFD_RTSP_PARAM_PRESENTATION_URL,
+	WFD_RTSP_PARAM_CLIENT_RTP_PORTS,
+	WFD_RTSP_PARAM_ROUTE,
+	WFD_RTSP_PARAM_I2C,
+	WFD_RTSP_PARAM_AV_FORMAT_CHANGE_TIMING,
+	WFD_RTSP_PARAM_PREFERRED_DISPLAY_MODE,
+	WFD_RTSP_PARAM_UIBC_CAPABILITY,
+	WFD_RTSP_PARAM_UIBC_SETTING,
+	WFD_RTSP_PARAM_STANDBY_RESUME_CAPABILITY,
+	WFD_RTSP_PARAM_STANDBY,
+	WFD_RTSP_PARAM_CONNECTOR_TYPE,
+	WFD_RTSP_PARAM_IDR_REQUEST,
+
+	WFD_RTSP_PARAM_CNT
+};
+
+/* bit of a parameter type in parameter masks */
+#define WFD_RTSP_PARAM_MASK(_type) (1ULL << (_type))
+#define WFD_RTSP_PARAM_MASK_ALL (~0ULL)
+
+const char *wfd_rtsp_param_get_name(unsigned int param);
+unsigned int wfd_rtsp_param_from_name_n(const char *param, size_t len);
+
+#define WFD_RTSP_PARAMS_MAX 32
+#define WFD_RTSP_PARAMS_CODEC_MAX 4
+
+/**
+ * wfd_rtsp_params - Parsed text/parameters entity
+ * @present: bit N is set if a line of type N was indexed
+ * @parsed: bit N is set if the first line of type N was requested and its
+ *          value was parsed successfully; the typed members below are only
+ *          valid if their bit is set
+ * @n_params: number of lines in @params
+ * @params: all lines in order of appearance. @name and @value point into the
+ *          parsed entity and are not zero-terminated. @value is NULL for lines
+ *          without ':', like the ones of GET_PARAMETER requests.
+ * @audio_codecs: wfd_audio_codecs; unknown formats are skipped
+ * @n_video_formats: number of H.264 codecs in @video_formats
+ * @video_formats: wfd_video_formats, one entry per H.264 codec, all with the
+ *                 same native mode
+ * @video_preferred: preferred-display-mode-supported of wfd_video_formats
+ * @n_3d_formats: number of H.264 codecs in @formats_3d
+ * @formats_3d: wfd_3d_video_formats, one entry per H.264 codec
+ * @content_protection: wfd_content_protection
+ * @hdcp_port: HDCP control port of wfd_content_protection, 0 for none
+ * @coupled_sink: wfd_coupled_sink
+ * @client_rtp_ports: wfd_client_rtp_ports; @lower is one of
+ *                    wfd_rtsp_transport_lower, @port holds RTP port 0 and 1
+ *
+ * Codecs beyond WFD_RTSP_PARAMS_CODEC_MAX are checked, but not stored.
+ * Codecs with a max-hres and max-vres of "none" have neither stored.
+ */
+struct wfd_rtsp_params {
+	uint64_t present;
+	uint64_t parsed;
+
+	size_t n_params;
+	struct wfd_rtsp_param {
+		unsigned int type;
+		const char *name;
+		size_t name_len;
+		const char *value;
+		size_t value_len;
+	} params[WFD_RTSP_PARAMS_MAX];
+
+	struct wfd_ie_sub_audio_formats audio_codecs;
+	size_t n_video_formats;
+	struct wfd_ie_sub_video_formats video_formats[WFD_RTSP_PARAMS_CODEC_MAX];
+	uint8_t video_preferred;
+	size_t n_3d_formats;
+	struct wfd_ie_sub_3d_formats formats_3d[WFD_RTSP_PARAMS_CODEC_MAX];
+	struct wfd_ie_sub_content_protect content_protection;
+	uint16_t hdcp_port;
+	struct wfd_ie_sub_coupled_sink coupled_sink;
+	struct {
+		unsigned int lower;
+		uint16_t port[2];
+	} client_rtp_ports;
+};
+
+/**
+ * wfd_rtsp_params_parse - Parse text/parameters entity
+ * @params: storage for the result
+ * @body: entity to parse, usually @msg->entity of GET_PARAMETER and
+ *        SET_PARAMETER messages or their replies
+ * @size: size of @body
+ * @mask: mask of parameter types to parse, built via WFD_RTSP_PARAM_MASK()
+ *
+ * Indexes all lines of @body in a single pass and parses the values of the
+ * requested parameters straight into @params. Other lines are only indexed,
+ * their raw values can be accessed via @params->params. Nothing is allocated
+ * and @body is not modified, but @params refers to it, so it must stay valid
+ * as long as @params is used.
+ * Values that cannot be parsed don't fail the call, their bit in
+ * @params->parsed is just not set.
+ *
+ * Returns 0 on success, -EINVAL on invalid arguments or -ENOBUFS if @body has
+ * more than WFD_RTSP_PARAMS_MAX lines. In the latter case, @params describes
+ * the first WFD_RTSP_PARAMS_MAX lines.
+ */
+int wfd_rtsp_params_parse(struct wfd_rtsp_params *params,
+			  const void *body,
+			  size_t size,
+			  uint64_t mask);
+
+/* return first line of type @type in @params, or NULL if not found */
+const struct wfd_rtsp_param *
+wfd_rtsp_params_find(const struct wfd_rtsp_params *params, unsigned int type);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -23,15 +23,20 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include "libwfd.h"
+#include "rtsp_internal.h"
+#include "shl_arena.h"
 #include "shl_llog.h"
 #include "shl_macro.h"
 #include "shl_ring.h"
+#include "shl_scan.h"
 #include "shl_util.h"
 
 enum state {
@@ -42,6 +47,40 @@ enum state {
 	STATE_BODY,
 	STATE_DATA_HEAD,
 	STATE_DATA_BODY,
+	STATE_RESYNC,
+};
+
+struct decoder_pool {
+	unsigned long ref;
+	struct decoder_msg *free;
+};
+
+struct decoder_msg {
+	unsigned long ref;
+	struct decoder_pool *pool;
+	struct decoder_msg *next;
+
+	struct wfd_rtsp_msg msg;
+	size_t headers_size;
+	struct shl_arena arena;
+
+	/* raw header block and field index, kept across resets */
+	char *raw;
+	size_t raw_alloc;
+	struct wfd_rtsp_msg_field *fields;
+	size_t fields_alloc;
+
+	/* buffered entity, kept across resets unless it grew too big */
+	uint8_t *entity;
+	size_t entity_alloc;
+};
+
+struct decoder_slot {
+	struct decoder_slot *next;
+	struct wfd_rtsp_decoder_event ev;
+	struct decoder_msg *msg;
+	struct shl_arena arena;
+	size_t charge;
 };
 
 struct wfd_rtsp_decoder {
@@ -49,39 +88,108 @@ struct wfd_rtsp_decoder {
 	void *data;
 	llog_submit_t llog;
 	void *llog_data;
+	unsigned int flags;
 
-	struct wfd_rtsp_msg msg;
+	struct decoder_pool *pool;
+	struct decoder_msg *cur;
+	struct decoder_msg *spare;
+
+	struct wfd_rtsp_decoder_limits limits;
+	size_t n_lines;
+	uint64_t interest;
 
 	struct shl_ring buf;
+	size_t budget;
 	size_t buflen;
 	unsigned int state;
 	char last_chr;
 	size_t remaining_body;
+	unsigned int body_mode;
+	size_t body_size;
+	size_t entity_charge;
 
 	uint8_t data_channel;
 	size_t data_size;
 
+	struct decoder_slot *queue_first;
+	struct decoder_slot *queue_last;
+	struct decoder_slot *delivered;
+	struct decoder_slot *unused;
+	size_t n_queued;
+
+	unsigned int error;
+
 	bool quoted : 1;
 	bool dead : 1;
+	bool failed_cb : 1;
+	bool resyncing : 1;
 };
 
 /*
  * Lookup Tables
+ * Header and method names are looked up via perfect hashing, see
+ * rtsp_name_hash(). The slot tables below map each hash to the only known name
+ * with that hash, so a lookup costs one hash, a length check and one string
+ * comparison. The names carry their lengths, so input with embedded binary 0s
+ * is never compared past the end of a table string.
+ * If you add names, run test_rtsp: it fails if two names share a slot or a
+ * slot table is stale and prints a collision-free seed and the slot tables to
+ * paste here.
  */
 
-static const char *method_names[] = {
-	[WFD_RTSP_METHOD_ANNOUNCE]		= "ANNOUNCE",
-	[WFD_RTSP_METHOD_DESCRIBE]		= "DESCRIBE",
-	[WFD_RTSP_METHOD_GET_PARAMETER]	= "GET_PARAMETER",
-	[WFD_RTSP_METHOD_OPTIONS]		= "OPTIONS",
-	[WFD_RTSP_METHOD_PAUSE]		= "PAUSE",
-	[WFD_RTSP_METHOD_PLAY]		= "PLAY",
-	[WFD_RTSP_METHOD_RECORD]		= "RECORD",
-	[WFD_RTSP_METHOD_REDIRECT]		= "REDIRECT",
-	[WFD_RTSP_METHOD_SETUP]		= "SETUP",
-	[WFD_RTSP_METHOD_SET_PARAMETER]	= "SET_PARAMETER",
-	[WFD_RTSP_METHOD_TEARDOWN]		= "TEARDOWN",
-	[WFD_RTSP_METHOD_CNT]		= NULL,
+#define NAME(_name) { _name, sizeof(_name) - 1 }
+
+struct rtsp_name {
+	const char *name;
+	size_t len;
+};
+
+static unsigned int name_lookup(const struct rtsp_name *names,
+				const uint8_t *slots,
+				const char *name,
+				size_t len,
+				uint32_t seed,
+				unsigned int bits)
+{
+	unsigned int id;
+
+	if (len < 3)
+		return 0;
+
+	id = slots[rtsp_name_hash(name, len, seed, bits)];
+	if (!id || len != names[id].len || strncasecmp(name, names[id].name, len))
+		return 0;
+
+	return id;
+}
+
+static const struct rtsp_name method_names[] = {
+	[WFD_RTSP_METHOD_ANNOUNCE]		= NAME("ANNOUNCE"),
+	[WFD_RTSP_METHOD_DESCRIBE]		= NAME("DESCRIBE"),
+	[WFD_RTSP_METHOD_GET_PARAMETER]	= NAME("GET_PARAMETER"),
+	[WFD_RTSP_METHOD_OPTIONS]		= NAME("OPTIONS"),
+	[WFD_RTSP_METHOD_PAUSE]		= NAME("PAUSE"),
+	[WFD_RTSP_METHOD_PLAY]		= NAME("PLAY"),
+	[WFD_RTSP_METHOD_RECORD]		= NAME("RECORD"),
+	[WFD_RTSP_METHOD_REDIRECT]		= NAME("REDIRECT"),
+	[WFD_RTSP_METHOD_SETUP]		= NAME("SETUP"),
+	[WFD_RTSP_METHOD_SET_PARAMETER]	= NAME("SET_PARAMETER"),
+	[WFD_RTSP_METHOD_TEARDOWN]		= NAME("TEARDOWN"),
+	[WFD_RTSP_METHOD_CNT]		= { },
+};
+
+static const uint8_t method_slots[1 << RTSP_METHOD_HASH_BITS] = {
+	[0]	= WFD_RTSP_METHOD_PLAY,
+	[1]	= WFD_RTSP_METHOD_PAUSE,
+	[3]	= WFD_RTSP_METHOD_ANNOUNCE,
+	[5]	= WFD_RTSP_METHOD_SET_PARAMETER,
+	[7]	= WFD_RTSP_METHOD_RECORD,
+	[8]	= WFD_RTSP_METHOD_SETUP,
+	[10]	= WFD_RTSP_METHOD_OPTIONS,
+	[12]	= WFD_RTSP_METHOD_DESCRIBE,
+	[13]	= WFD_RTSP_METHOD_GET_PARAMETER,
+	[14]	= WFD_RTSP_METHOD_REDIRECT,
+	[15]	= WFD_RTSP_METHOD_TEARDOWN,
 };
 
 _shl_public_
@@ -90,19 +198,15 @@ const char *wfd_rtsp_method_get_name(unsigned int method)
 	if (method >= SHL_ARRAY_LENGTH(method_names))
 		return NULL;
 
-	return method_names[method];
+	return method_names[method].name;
 }
 
 _shl_public_
 unsigned int wfd_rtsp_method_from_name(const char *method)
 {
-	size_t i;
-
-	for (i = 0; i < SHL_ARRAY_LENGTH(method_names); ++i)
-		if (method_names[i] && !strcasecmp(method, method_names[i]))
-			return i;
-
-	return WFD_RTSP_METHOD_UNKNOWN;
+	return name_lookup(method_names, method_slots,
+			   method, strlen(method),
+			   RTSP_METHOD_HASH_SEED, RTSP_METHOD_HASH_BITS);
 }
 
 _shl_public_
@@ -195,52 +299,99 @@ const char *wfd_rtsp_status_get_description(unsigned int status)
 	return status_descriptions[status];
 }
 
-static const char *header_names[] = {
-	[WFD_RTSP_HEADER_ACCEPT]			= "Accept",
-	[WFD_RTSP_HEADER_ACCEPT_ENCODING]		= "Accept-Encoding",
-	[WFD_RTSP_HEADER_ACCEPT_LANGUAGE]		= "Accept-Language",
-	[WFD_RTSP_HEADER_ALLOW]				= "Allow",
-	[WFD_RTSP_HEADER_AUTHORIZATION]			= "Authorization",
-	[WFD_RTSP_HEADER_BANDWIDTH]			= "Bandwidth",
-	[WFD_RTSP_HEADER_BLOCKSIZE]			= "Blocksize",
-	[WFD_RTSP_HEADER_CACHE_CONTROL]			= "Cache-Control",
-	[WFD_RTSP_HEADER_CONFERENCE]			= "Conference",
-	[WFD_RTSP_HEADER_CONNECTION]			= "Connection",
-	[WFD_RTSP_HEADER_CONTENT_BASE]			= "Content-Base",
-	[WFD_RTSP_HEADER_CONTENT_ENCODING]		= "Content-Encoding",
-	[WFD_RTSP_HEADER_CONTENT_LANGUAGE]		= "Content-Language",
-	[WFD_RTSP_HEADER_CONTENT_LENGTH]		= "Content-Length",
-	[WFD_RTSP_HEADER_CONTENT_LOCATION]		= "Content-Location",
-	[WFD_RTSP_HEADER_CONTENT_TYPE]			= "Content-Type",
-	[WFD_RTSP_HEADER_CSEQ]				= "CSeq",
-	[WFD_RTSP_HEADER_DATE]				= "Date",
-	[WFD_RTSP_HEADER_EXPIRES]			= "Expires",
-	[WFD_RTSP_HEADER_FROM]				= "From",
-	[WFD_RTSP_HEADER_HOST]				= "Host",
-	[WFD_RTSP_HEADER_IF_MATCH]			= "If-Match",
-	[WFD_RTSP_HEADER_IF_MODIFIED_SINCE]		= "If-Modified-Since",
-	[WFD_RTSP_HEADER_LAST_MODIFIED]			= "Last-Modified",
-	[WFD_RTSP_HEADER_LOCATION]			= "Location",
-	[WFD_RTSP_HEADER_PROXY_AUTHENTICATE]		= "Proxy-Authenticate",
-	[WFD_RTSP_HEADER_PROXY_REQUIRE]			= "Proxy-Require",
-	[WFD_RTSP_HEADER_PUBLIC]			= "Public",
-	[WFD_RTSP_HEADER_RANGE]				= "Range",
-	[WFD_RTSP_HEADER_REFERER]			= "Referer",
-	[WFD_RTSP_HEADER_RETRY_AFTER]			= "Retry-After",
-	[WFD_RTSP_HEADER_REQUIRE]			= "Require",
-	[WFD_RTSP_HEADER_RTP_INFO]			= "RTP-Info",
-	[WFD_RTSP_HEADER_SCALE]				= "Scale",
-	[WFD_RTSP_HEADER_SPEED]				= "Speed",
-	[WFD_RTSP_HEADER_SERVER]			= "Server",
-	[WFD_RTSP_HEADER_SESSION]			= "Session",
-	[WFD_RTSP_HEADER_TIMESTAMP]			= "Timestamp",
-	[WFD_RTSP_HEADER_TRANSPORT]			= "Transport",
-	[WFD_RTSP_HEADER_UNSUPPORTED]			= "Unsupported",
-	[WFD_RTSP_HEADER_USER_AGENT]			= "User-Agent",
-	[WFD_RTSP_HEADER_VARY]				= "Vary",
-	[WFD_RTSP_HEADER_VIA]				= "Via",
-	[WFD_RTSP_HEADER_WWW_AUTHENTICATE]		= "WWW-Authenticate",
-	[WFD_RTSP_HEADER_CNT]				= NULL,
+static const struct rtsp_name header_names[] = {
+	[WFD_RTSP_HEADER_ACCEPT]			= NAME("Accept"),
+	[WFD_RTSP_HEADER_ACCEPT_ENCODING]		= NAME("Accept-Encoding"),
+	[WFD_RTSP_HEADER_ACCEPT_LANGUAGE]		= NAME("Accept-Language"),
+	[WFD_RTSP_HEADER_ALLOW]				= NAME("Allow"),
+	[WFD_RTSP_HEADER_AUTHORIZATION]			= NAME("Authorization"),
+	[WFD_RTSP_HEADER_BANDWIDTH]			= NAME("Bandwidth"),
+	[WFD_RTSP_HEADER_BLOCKSIZE]			= NAME("Blocksize"),
+	[WFD_RTSP_HEADER_CACHE_CONTROL]			= NAME("Cache-Control"),
+	[WFD_RTSP_HEADER_CONFERENCE]			= NAME("Conference"),
+	[WFD_RTSP_HEADER_CONNECTION]			= NAME("Connection"),
+	[WFD_RTSP_HEADER_CONTENT_BASE]			= NAME("Content-Base"),
+	[WFD_RTSP_HEADER_CONTENT_ENCODING]		= NAME("Content-Encoding"),
+	[WFD_RTSP_HEADER_CONTENT_LANGUAGE]		= NAME("Content-Language"),
+	[WFD_RTSP_HEADER_CONTENT_LENGTH]		= NAME("Content-Length"),
+	[WFD_RTSP_HEADER_CONTENT_LOCATION]		= NAME("Content-Location"),
+	[WFD_RTSP_HEADER_CONTENT_TYPE]			= NAME("Content-Type"),
+	[WFD_RTSP_HEADER_CSEQ]				= NAME("CSeq"),
+	[WFD_RTSP_HEADER_DATE]				= NAME("Date"),
+	[WFD_RTSP_HEADER_EXPIRES]			= NAME("Expires"),
+	[WFD_RTSP_HEADER_FROM]				= NAME("From"),
+	[WFD_RTSP_HEADER_HOST]				= NAME("Host"),
+	[WFD_RTSP_HEADER_IF_MATCH]			= NAME("If-Match"),
+	[WFD_RTSP_HEADER_IF_MODIFIED_SINCE]		= NAME("If-Modified-Since"),
+	[WFD_RTSP_HEADER_LAST_MODIFIED]			= NAME("Last-Modified"),
+	[WFD_RTSP_HEADER_LOCATION]			= NAME("Location"),
+	[WFD_RTSP_HEADER_PROXY_AUTHENTICATE]		= NAME("Proxy-Authenticate"),
+	[WFD_RTSP_HEADER_PROXY_REQUIRE]			= NAME("Proxy-Require"),
+	[WFD_RTSP_HEADER_PUBLIC]			= NAME("Public"),
+	[WFD_RTSP_HEADER_RANGE]				= NAME("Range"),
+	[WFD_RTSP_HEADER_REFERER]			= NAME("Referer"),
+	[WFD_RTSP_HEADER_RETRY_AFTER]			= NAME("Retry-After"),
+	[WFD_RTSP_HEADER_REQUIRE]			= NAME("Require"),
+	[WFD_RTSP_HEADER_RTP_INFO]			= NAME("RTP-Info"),
+	[WFD_RTSP_HEADER_SCALE]				= NAME("Scale"),
+	[WFD_RTSP_HEADER_SPEED]				= NAME("Speed"),
+	[WFD_RTSP_HEADER_SERVER]			= NAME("Server"),
+	[WFD_RTSP_HEADER_SESSION]			= NAME("Session"),
+	[WFD_RTSP_HEADER_TIMESTAMP]			= NAME("Timestamp"),
+	[WFD_RTSP_HEADER_TRANSPORT]			= NAME("Transport"),
+	[WFD_RTSP_HEADER_UNSUPPORTED]			= NAME("Unsupported"),
+	[WFD_RTSP_HEADER_USER_AGENT]			= NAME("User-Agent"),
+	[WFD_RTSP_HEADER_VARY]				= NAME("Vary"),
+	[WFD_RTSP_HEADER_VIA]				= NAME("Via"),
+	[WFD_RTSP_HEADER_WWW_AUTHENTICATE]		= NAME("WWW-Authenticate"),
+	[WFD_RTSP_HEADER_CNT]				= { },
+};
+
+static const uint8_t header_slots[1 << RTSP_HEADER_HASH_BITS] = {
+	[1]	= WFD_RTSP_HEADER_CONTENT_LOCATION,
+	[3]	= WFD_RTSP_HEADER_VIA,
+	[7]	= WFD_RTSP_HEADER_ACCEPT_ENCODING,
+	[9]	= WFD_RTSP_HEADER_AUTHORIZATION,
+	[12]	= WFD_RTSP_HEADER_PROXY_REQUIRE,
+	[13]	= WFD_RTSP_HEADER_HOST,
+	[16]	= WFD_RTSP_HEADER_ALLOW,
+	[17]	= WFD_RTSP_HEADER_SCALE,
+	[19]	= WFD_RTSP_HEADER_EXPIRES,
+	[22]	= WFD_RTSP_HEADER_VARY,
+	[24]	= WFD_RTSP_HEADER_DATE,
+	[25]	= WFD_RTSP_HEADER_WWW_AUTHENTICATE,
+	[31]	= WFD_RTSP_HEADER_RTP_INFO,
+	[32]	= WFD_RTSP_HEADER_UNSUPPORTED,
+	[33]	= WFD_RTSP_HEADER_IF_MODIFIED_SINCE,
+	[34]	= WFD_RTSP_HEADER_PUBLIC,
+	[36]	= WFD_RTSP_HEADER_RANGE,
+	[44]	= WFD_RTSP_HEADER_CONTENT_BASE,
+	[47]	= WFD_RTSP_HEADER_CACHE_CONTROL,
+	[50]	= WFD_RTSP_HEADER_SERVER,
+	[51]	= WFD_RTSP_HEADER_CONTENT_ENCODING,
+	[53]	= WFD_RTSP_HEADER_IF_MATCH,
+	[55]	= WFD_RTSP_HEADER_TIMESTAMP,
+	[57]	= WFD_RTSP_HEADER_ACCEPT_LANGUAGE,
+	[62]	= WFD_RTSP_HEADER_CSEQ,
+	[64]	= WFD_RTSP_HEADER_CONNECTION,
+	[65]	= WFD_RTSP_HEADER_REFERER,
+	[67]	= WFD_RTSP_HEADER_RETRY_AFTER,
+	[76]	= WFD_RTSP_HEADER_CONFERENCE,
+	[77]	= WFD_RTSP_HEADER_FROM,
+	[81]	= WFD_RTSP_HEADER_PROXY_AUTHENTICATE,
+	[87]	= WFD_RTSP_HEADER_SESSION,
+	[88]	= WFD_RTSP_HEADER_SPEED,
+	[89]	= WFD_RTSP_HEADER_LOCATION,
+	[95]	= WFD_RTSP_HEADER_CONTENT_LENGTH,
+	[97]	= WFD_RTSP_HEADER_TRANSPORT,
+	[103]	= WFD_RTSP_HEADER_CONTENT_LANGUAGE,
+	[104]	= WFD_RTSP_HEADER_BANDWIDTH,
+	[112]	= WFD_RTSP_HEADER_LAST_MODIFIED,
+	[115]	= WFD_RTSP_HEADER_BLOCKSIZE,
+	[116]	= WFD_RTSP_HEADER_REQUIRE,
+	[120]	= WFD_RTSP_HEADER_ACCEPT,
+	[122]	= WFD_RTSP_HEADER_CONTENT_TYPE,
+	[126]	= WFD_RTSP_HEADER_USER_AGENT,
 };
 
 _shl_public_
@@ -249,364 +400,1053 @@ const char *wfd_rtsp_header_get_name(unsigned int header)
 	if (header >= SHL_ARRAY_LENGTH(header_names))
 		return NULL;
 
-	return header_names[header];
+	return header_names[header].name;
 }
 
 _shl_public_
 unsigned int wfd_rtsp_header_from_name(const char *header)
 {
-	size_t i;
-
-	for (i = 0; i < SHL_ARRAY_LENGTH(header_names); ++i)
-		if (header_names[i] && !strcasecmp(header, header_names[i]))
-			return i;
-
-	return WFD_RTSP_HEADER_UNKNOWN;
+	return wfd_rtsp_header_from_name_n(header, strlen(header));
 }
 
 _shl_public_
 unsigned int wfd_rtsp_header_from_name_n(const char *header, size_t len)
 {
-	size_t i;
-
-	for (i = 0; i < SHL_ARRAY_LENGTH(header_names); ++i)
-		if (header_names[i] &&
-		    !strncasecmp(header, header_names[i], len) &&
-		    !header_names[i][len])
-			return i;
-
-	return WFD_RTSP_HEADER_UNKNOWN;
+	return name_lookup(header_names, header_slots,
+			   header, len,
+			   RTSP_HEADER_HASH_SEED, RTSP_HEADER_HASH_BITS);
 }
 
 /*
- * Helpers
+ * Messages
+ * Headers are kept in a dense array ordered by type, with a bitmap of the
+ * present types. The index of a present header is the number of present types
+ * below it, so lookups are O(1) and clearing a message only touches the few
+ * headers it actually carries.
  */
 
-static void msg_clear_id(struct wfd_rtsp_msg *msg)
-{
-	switch (msg->type) {
-	case WFD_RTSP_MSG_REQUEST:
-		free(msg->id.request.method);
-		free(msg->id.request.uri);
-		break;
-	case WFD_RTSP_MSG_RESPONSE:
-		free(msg->id.response.phrase);
-		break;
-	}
+shl_assert_cc(WFD_RTSP_HEADER_CNT <= 64);
 
-	free(msg->id.line);
-	shl_zero(msg->id);
-}
+static const struct wfd_rtsp_msg_header msg_no_header;
 
-static void msg_clear_headers(struct wfd_rtsp_msg *msg)
+static size_t msg_header_index(const struct wfd_rtsp_msg *msg,
+			       unsigned int type)
 {
-	struct wfd_rtsp_msg_header *h;
-	size_t i, j;
+	return __builtin_popcountll(msg->header_mask & ((1ULL << type) - 1));
+}
 
-	for (i = 0; i < WFD_RTSP_HEADER_CNT; ++i) {
-		h = &msg->headers[i];
+_shl_public_
+const struct wfd_rtsp_msg_header *
+wfd_rtsp_msg_get_header(const struct wfd_rtsp_msg *msg, unsigned int type)
+{
+	if (!msg || !wfd_rtsp_msg_has_header(msg, type))
+		return &msg_no_header;
 
-		for (j = 0; j < h->count; ++j)
-			free(h->lines[j]);
+	return &msg->present_headers[msg_header_index(msg, type)];
+}
 
-		free(h->lines);
-		free(h->lengths);
-	}
+/*
+ * Message Pool
+ * Messages are reference-counted objects with their own arena. The decoder
+ * holds one reference to the message it currently parses and drops it once the
+ * message was submitted. If nobody else took a reference, the message is reset
+ * in place and parsing continues with it. Otherwise, the decoder continues with
+ * a fresh message from its pool and the submitted one lives on until its last
+ * reference is dropped, at which point it returns to the pool.
+ * References may be dropped from other threads. Hence, the free-list is a
+ * lock-free stack which is pushed to by wfd_rtsp_msg_unref() and only ever
+ * taken as a whole by the decoder. Each live message pins the pool, so if the
+ * decoder is freed first, the last message returned frees the pool.
+ */
 
-	shl_zero(msg->headers);
-}
+/* entities up to this size are preallocated and kept for reuse */
+#define ENTITY_PREALLOC (64 * 1024)
 
-static void msg_clear_entity(struct wfd_rtsp_msg *msg)
+static void msg_reset(struct decoder_msg *m)
 {
-	free(msg->entity.value);
-	shl_zero(msg->entity);
+	shl_zero(m->msg);
+	m->headers_size = 0;
+	shl_arena_reset(&m->arena);
+
+	if (m->entity_alloc > ENTITY_PREALLOC) {
+		free(m->entity);
+		m->entity = NULL;
+		m->entity_alloc = 0;
+	}
 }
 
-static void msg_clear(struct wfd_rtsp_msg *msg)
+static void msg_list_free(struct decoder_msg *m)
 {
-	msg_clear_id(msg);
-	msg_clear_headers(msg);
-	msg_clear_entity(msg);
+	struct decoder_msg *next;
+
+	for ( ; m; m = next) {
+		next = m->next;
+		shl_arena_clear(&m->arena);
+		free(m->fields);
+		free(m->raw);
+		free(m->entity);
+		free(m);
+	}
 }
 
-static int decoder_call(struct wfd_rtsp_decoder *dec,
-			struct wfd_rtsp_decoder_event *ev)
+static void pool_unref(struct decoder_pool *pool)
 {
-	return dec->event_fn(dec, dec->data, ev);
+	if (__atomic_sub_fetch(&pool->ref, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	msg_list_free(pool->free);
+	free(pool);
 }
 
-static int decoder_submit(struct wfd_rtsp_decoder *dec)
+static void pool_put(struct decoder_msg *m)
 {
-	struct wfd_rtsp_decoder_event ev = { };
-	int r;
+	struct decoder_pool *pool = m->pool;
 
-	ev.type = WFD_RTSP_DECODER_MSG;
-	ev.msg = &dec->msg;
-	r = decoder_call(dec, &ev);
-	msg_clear(&dec->msg);
+	msg_reset(m);
 
-	return r;
+	m->next = __atomic_load_n(&pool->free, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&pool->free, &m->next, m, true,
+					    __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED))
+		/* retry */ ;
+
+	pool_unref(pool);
 }
 
-static int decoder_submit_data(struct wfd_rtsp_decoder *dec, uint8_t *p)
+static struct decoder_msg *pool_get(struct wfd_rtsp_decoder *dec)
 {
-	struct wfd_rtsp_decoder_event ev = { };
+	struct decoder_msg *m;
 
-	ev.type = WFD_RTSP_DECODER_DATA;
-	ev.data.channel = dec->data_channel;
-	ev.data.size = dec->data_size;
-	ev.data.value = p;
-	return decoder_call(dec, &ev);
-}
+	if (!dec->spare)
+		dec->spare = __atomic_exchange_n(&dec->pool->free, NULL,
+						 __ATOMIC_ACQUIRE);
 
-/*
- * Header ID-line Handling
- * This parses both, the REQUEST and RESPONSE lines of an RTSP method. It is
- * always the first header line and defines the type of message. If it is
- * unrecognized, we set it to UNKNOWN.
- * Note that regardless of the ID-line, all following lines are parsed as
- * generic headers followed by an optional entity.
- */
+	m = dec->spare;
+	if (m) {
+		dec->spare = m->next;
+	} else {
+		m = calloc(1, sizeof(*m));
+		if (!m)
+			return NULL;
 
-static int decoder_parse_request(struct wfd_rtsp_decoder *dec,
-				 char *line,
-				 size_t len)
+		m->pool = dec->pool;
+	}
+
+	m->ref = 1;
+	m->next = NULL;
+	__atomic_add_fetch(&dec->pool->ref, 1, __ATOMIC_RELAXED);
+
+	return m;
+}
+
+_shl_public_
+void wfd_rtsp_msg_ref(struct wfd_rtsp_msg *msg)
 {
-	unsigned int major, minor;
-	size_t cmdlen, urllen;
-	char *next, *prev, *cmd, *url;
+	struct decoder_msg *m;
 
-	/* Requests look like this:
-	 *   <cmd> <url> RTSP/<major>.<minor>
-	 * We try to match <cmd> here, but accept invalid commands. <url> is
-	 * never parsed (it can become pretty complex if done properly). */
+	if (!msg)
+		return;
 
-	next = line;
+	m = shl_container_of(msg, struct decoder_msg, msg);
+	__atomic_add_fetch(&m->ref, 1, __ATOMIC_RELAXED);
+}
 
-	/* parse <cmd> */
-	cmd = line;
-	next = strchr(next, ' ');
-	if (!next || next == cmd)
-		goto error;
-	cmdlen = next - cmd;
+_shl_public_
+void wfd_rtsp_msg_unref(struct wfd_rtsp_msg *msg)
+{
+	struct decoder_msg *m;
 
-	/* skip " " */
-	++next;
+	if (!msg)
+		return;
 
-	/* parse <url> */
-	url = next;
-	next = strchr(next, ' ');
-	if (!next || next == url)
-		goto error;
-	urllen = next - url;
+	m = shl_container_of(msg, struct decoder_msg, msg);
+	if (__atomic_sub_fetch(&m->ref, 1, __ATOMIC_ACQ_REL))
+		return;
 
-	/* skip " " */
-	++next;
+	pool_put(m);
+}
 
-	/* parse "RTSP/" */
-	if (strncasecmp(next, "RTSP/", 5))
-		goto error;
-	next += 5;
+/*
+ * Helpers
+ */
 
-	/* parse "%u" */
-	prev = next;
-	shl_atoi_u(prev, 10, (const char**)&next, &major);
-	if (next == prev || *next != '.')
-		goto error;
+/*
+ * All storage of the current message is allocated from its arena. Once the
+ * message was submitted, we reset the arena and the message in one go, so
+ * there's nothing to free per line. If the message was retained, we switch to
+ * a fresh one instead. On failure, dec->cur is NULL and the next feed retries.
+ */
 
-	/* skip "." */
-	++next;
+static int decoder_clear_msg(struct wfd_rtsp_decoder *dec)
+{
+	struct decoder_msg *m = dec->cur;
 
-	/* parse "%u" */
-	prev = next;
-	shl_atoi_u(prev, 10, (const char**)&next, &minor);
-	if (next == prev || *next)
-		goto error;
+	dec->n_lines = 0;
 
-	cmd = strndup(cmd, cmdlen);
-	url = strndup(url, urllen);
-	if (!cmd || !url) {
-		free(cmd);
-		return llog_ENOMEM(dec);
+	if (m && __atomic_load_n(&m->ref, __ATOMIC_ACQUIRE) == 1) {
+		msg_reset(m);
+		return 0;
 	}
 
-	dec->msg.type = WFD_RTSP_MSG_REQUEST;
-	dec->msg.id.line = line;
-	dec->msg.id.length = len;
-	dec->msg.id.request.method = cmd;
-	dec->msg.id.request.type = wfd_rtsp_method_from_name(cmd);
-	dec->msg.id.request.uri = url;
-	dec->msg.id.request.major = major;
-	dec->msg.id.request.minor = minor;
+	if (m)
+		wfd_rtsp_msg_unref(&m->msg);
 
-	return 0;
+	dec->cur = pool_get(dec);
+	if (!dec->cur)
+		return llog_ENOMEM(dec);
 
-error:
-	/* Invalid request line.. Set type to UNKNOWN and let the caller deal
-	 * with it. We will not try to send any error to avoid triggering
-	 * another error if the remote side doesn't understand proper RTSP (or
-	 * if our implementation is buggy). */
-	dec->msg.type = WFD_RTSP_MSG_UNKNOWN;
-	dec->msg.id.line = line;
-	dec->msg.id.length = len;
 	return 0;
 }
 
-static int decoder_parse_response(struct wfd_rtsp_decoder *dec,
-				  char *line,
-				  size_t len)
+/* return header of given type, adding an empty one if not present, yet */
+static struct wfd_rtsp_msg_header *
+decoder_get_header(struct wfd_rtsp_decoder *dec, unsigned int type)
 {
-	unsigned int major, minor, code;
-	char *prev, *next, *str;
-
-	/* Responses look like this:
-	 *   RTSP/<major>.<minor> <code> <string..>
-	 *   RTSP/%u.%u %u %s
-	 * We first parse the RTSP version and code. Everything appended to
-	 * this is optional and represents the error string. */
+	struct wfd_rtsp_msg *msg = &dec->cur->msg;
+	struct wfd_rtsp_msg_header *h;
+	size_t idx, size;
+
+	idx = msg_header_index(msg, type);
+	if (msg->header_mask & (1ULL << type))
+		return &msg->present_headers[idx];
+
+	if (msg->n_headers >= dec->cur->headers_size) {
+		size = dec->cur->headers_size ? dec->cur->headers_size * 2 : 4;
+		h = shl_arena_realloc(&dec->cur->arena, msg->present_headers,
+				      dec->cur->headers_size * sizeof(*h),
+				      size * sizeof(*h));
+		if (!h)
+			return NULL;
+
+		msg->present_headers = h;
+		dec->cur->headers_size = size;
+	}
 
-	/* skip "RTSP/", already parsed by parent */
-	next = &line[5];
+	h = &msg->present_headers[idx];
+	memmove(h + 1, h, (msg->n_headers - idx) * sizeof(*h));
+	shl_zero(*h);
+	h->type = type;
+	++msg->n_headers;
+	msg->header_mask |= 1ULL << type;
 
-	/* parse "%u" */
-	prev = next;
-	shl_atoi_u(prev, 10, (const char**)&next, &major);
-	if (next == prev || *next != '.')
-		goto error;
+	return h;
+}
 
-	/* skip "." */
-	++next;
+/*
+ * Limits
+ * Only input that is buffered costs memory, so buffer limits and the global
+ * budget are enforced whenever we push into the ring-buffer. The budget is
+ * charged with the size of each ring-buffer rather than its fill level, as
+ * that's what is actually allocated; it's released once the decoder is freed.
+ * Line and header limits bound the arena of a message, the entity limit is
+ * checked right when we know the entity is going to be buffered. Buffered
+ * entities bypass the ring-buffer and are charged separately, and so are
+ * payloads copied into queued events in pull-mode. Message arenas are bounded
+ * by the line and header limits and are not charged.
+ */
 
-	/* parse "%u" */
-	prev = next;
-	shl_atoi_u(prev, 10, (const char**)&next, &minor);
-	if (next == prev || *next != ' ')
-		goto error;
+#define LINE_SLACK 3
 
-	/* skip " " */
-	++next;
+static size_t budget_max;
+static size_t budget_used;
 
-	/* parse: %u */
-	prev = next;
-	shl_atoi_u(prev, 10, (const char**)&next, &code);
-	if (next == prev)
-		goto error;
-	if (*next && *next != ' ')
-		goto error;
+/* the error event is sent by decoder_fail() once the error propagated */
+static int decoder_limit(struct wfd_rtsp_decoder *dec, unsigned int reason)
+{
+	llog_debug(dec, "RTSP decoder limit %u exceeded", reason);
 
-	/* skip " " */
-	if (*next)
-		++next;
+	dec->error = reason;
 
-	/* parse: %s */
-	str = strdup(next);
-	if (!str)
-		return llog_ENOMEM(dec);
+	switch (reason) {
+	case WFD_RTSP_DECODER_E_BUFFER:
+	case WFD_RTSP_DECODER_E_BUDGET:
+		return -ENOBUFS;
+	default:
+		return -EMSGSIZE;
+	}
+}
 
-	dec->msg.type = WFD_RTSP_MSG_RESPONSE;
-	dec->msg.id.line = line;
-	dec->msg.id.length = len;
-	dec->msg.id.response.major = major;
-	dec->msg.id.response.minor = minor;
-	dec->msg.id.response.status = code;
-	dec->msg.id.response.phrase = str;
+static bool budget_charge(size_t size)
+{
+	size_t max, used;
 
-	return 0;
+	max = __atomic_load_n(&budget_max, __ATOMIC_RELAXED);
+	used = __atomic_add_fetch(&budget_used, size, __ATOMIC_RELAXED);
+	if (!max || used <= max)
+		return true;
 
-error:
-	/* Couldn't parse line. Avoid sending an error message as we could
-	 * trigger another error and end up in an endless error loop. Instead,
-	 * set message type to UNKNOWN and let the caller deal with it. */
-	dec->msg.type = WFD_RTSP_MSG_UNKNOWN;
-	dec->msg.id.line = line;
-	dec->msg.id.length = len;
-	return 0;
+	__atomic_sub_fetch(&budget_used, size, __ATOMIC_RELAXED);
+	return false;
 }
 
-static int decoder_parse_id(struct wfd_rtsp_decoder *dec, char *line, size_t len)
+static void budget_release(size_t size)
 {
-	if (!strncasecmp(line, "RTSP/", 5))
-		return decoder_parse_response(dec, line, len);
-	else
-		return decoder_parse_request(dec, line, len);
+	__atomic_sub_fetch(&budget_used, size, __ATOMIC_RELAXED);
 }
 
 /*
- * RTSP Header Parser
- * This parses RTSP header lines. These follow the ID-line and may contain
- * arbitrary additional information. Note that we parse any kind of message that
- * we cannot identify as UNKNOWN. Thus, the caller can implement arbitrary
- * additional parsers.
- *
- * Furthermore, if a header-line cannot be parsed correctly, even though the
- * header-type is known, we still add it as UNKNOWN. Therefore, if the caller
- * implements extensions to *known* header lines, it still needs to go through
- * all unknown lines. It's not enough to go through the lines of the given type.
+ * Event Queue
+ * Without event callback, the decoder runs in pull-mode. Events are queued
+ * instead of dispatched and retrieved via wfd_rtsp_decoder_next(). Each queued
+ * event owns a slot, so parsing can continue while events are pending. A slot
+ * holds a reference to its submitted message, payloads of data frames and body
+ * chunks are copied into the slot's arena as the input-buffer is gone once
+ * wfd_rtsp_decoder_feed() returns. These copies are buffered input, so they're
+ * charged against the global budget until the slot is recycled.
+ * Slots handed to the caller are recycled on the next call to
+ * wfd_rtsp_decoder_next*(), their arenas keep their memory for reuse. Like
+ * unused room in the ring-buffer, that memory is not charged.
+ * Input is still parsed eagerly by wfd_rtsp_decoder_feed(), so the number of
+ * pending events is bounded by @max_events: once reached, feeding is refused
+ * as a whole until the caller pulled some events.
  */
 
-static int header_append(struct wfd_rtsp_msg_header *h, char *line, size_t len)
+static bool decoder_queue_full(struct wfd_rtsp_decoder *dec)
 {
-	char **tlines;
-	size_t *tlengths;
-	size_t num;
+	return !dec->event_fn && dec->limits.max_events &&
+	       dec->n_queued >= dec->limits.max_events;
+}
 
-	num = h->count + 2;
+static void slot_list_free(struct decoder_slot *slot)
+{
+	struct decoder_slot *next;
+
+	for ( ; slot; slot = next) {
+		next = slot->next;
+		wfd_rtsp_msg_unref(slot->msg ? &slot->msg->msg : NULL);
+		budget_release(slot->charge);
+		shl_arena_clear(&slot->arena);
+		free(slot);
+	}
+}
 
-	tlines = realloc(h->lines, num * sizeof(*h->lines));
-	if (!tlines)
-		return -ENOMEM;
-	h->lines = tlines;
+static void slot_list_recycle(struct wfd_rtsp_decoder *dec,
+			      struct decoder_slot **list)
+{
+	struct decoder_slot *slot;
 
-	tlengths = realloc(h->lengths, num * sizeof(*h->lengths));
-	if (!tlengths)
-		return -ENOMEM;
-	h->lengths = tlengths;
+	while ((slot = *list)) {
+		*list = slot->next;
+		if (slot->msg) {
+			wfd_rtsp_msg_unref(&slot->msg->msg);
+			slot->msg = NULL;
+		}
+		budget_release(slot->charge);
+		slot->charge = 0;
+		shl_arena_reset(&slot->arena);
+		slot->next = dec->unused;
+		dec->unused = slot;
+	}
+}
 
-	h->lines[h->count] = line;
-	h->lengths[h->count] = len;
-	++h->count;
-	h->lines[h->count] = NULL;
-	h->lengths[h->count] = 0;
+/* Payloads are charged; error data is a copy of input that's charged already
+ * and must not fail, or the decoder couldn't resync from a budget error. */
+static int slot_charge(struct wfd_rtsp_decoder *dec,
+		       struct decoder_slot *slot,
+		       size_t size)
+{
+	if (!budget_charge(size))
+		return decoder_limit(dec, WFD_RTSP_DECODER_E_BUDGET);
 
+	slot->charge += size;
 	return 0;
 }
 
-static int decoder_add_unknown_line(struct wfd_rtsp_decoder *dec,
-				    char *line,
-				    size_t len)
+static void *slot_copy(struct decoder_slot *slot,
+		       const struct iovec *vec,
+		       size_t n_vec,
+		       size_t size)
 {
-	struct wfd_rtsp_msg_header *h;
-	int r;
+	uint8_t *buf, *p;
+	size_t i;
 
-	/* Cannot parse header line. Append it at the end of the line-array
-	 * of type UNKNOWN. Let the caller deal with it. */
+	/* zero-terminate just like non-zero-copy frames */
+	buf = shl_arena_alloc(&slot->arena, size + 1);
+	if (!buf)
+		return NULL;
 
-	h = &dec->msg.headers[WFD_RTSP_HEADER_UNKNOWN];
-	r = header_append(h, line, len);
-	return r < 0 ? llog_ERR(dec, r) : 0;
+	for (i = 0, p = buf; i < n_vec; ++i) {
+		memcpy(p, vec[i].iov_base, vec[i].iov_len);
+		p += vec[i].iov_len;
+	}
+	buf[size] = 0;
+
+	return buf;
 }
 
-static int decoder_parse_content_length(struct wfd_rtsp_decoder *dec,
-					char *line,
-					size_t len,
-					char *tokens,
-					size_t num)
+static int decoder_queue(struct wfd_rtsp_decoder *dec,
+			 struct wfd_rtsp_decoder_event *ev)
 {
-	struct wfd_rtsp_msg_header *h;
+	struct decoder_slot *slot;
+	struct iovec vec;
+	void *buf;
 	int r;
-	size_t clen;
-	char *next;
-
-	h = &dec->msg.headers[WFD_RTSP_HEADER_CONTENT_LENGTH];
 
-	r = shl_atoi_z(tokens, 10, (const char**)&next, &clen);
-	if (r < 0 || *next) {
+	slot = dec->unused;
+	if (slot) {
+		dec->unused = slot->next;
+	} else {
+		slot = calloc(1, sizeof(*slot));
+		if (!slot)
+			return llog_ENOMEM(dec);
+	}
+
+	slot->ev = *ev;
+
+	switch (ev->type) {
+	case WFD_RTSP_DECODER_MSG:
+		/* the decoder continues with a fresh message */
+		wfd_rtsp_msg_ref(&dec->cur->msg);
+		slot->msg = dec->cur;
+		break;
+	case WFD_RTSP_DECODER_DATA:
+		r = slot_charge(dec, slot, ev->data.size + 1);
+		if (r < 0)
+			goto error;
+
+		buf = slot_copy(slot, ev->data.vec, ev->data.n_vec,
+				ev->data.size);
+		if (!buf)
+			goto error_nomem;
+
+		slot->ev.data.value = buf;
+		slot->ev.data.n_vec = 1;
+		slot->ev.data.vec[0].iov_base = buf;
+		slot->ev.data.vec[0].iov_len = ev->data.size;
+		break;
+	case WFD_RTSP_DECODER_BODY_CHUNK:
+		r = slot_charge(dec, slot, ev->chunk.size + 1);
+		if (r < 0)
+			goto error;
+
+		vec.iov_base = (void*)ev->chunk.value;
+		vec.iov_len = ev->chunk.size;
+		buf = slot_copy(slot, &vec, 1, ev->chunk.size);
+		if (!buf)
+			goto error_nomem;
+
+		slot->ev.chunk.value = buf;
+		break;
+	case WFD_RTSP_DECODER_ERROR:
+		if (!ev->error.length)
+			break;
+
+		vec.iov_base = ev->error.data;
+		vec.iov_len = ev->error.length;
+		buf = slot_copy(slot, &vec, 1, ev->error.length);
+		if (!buf)
+			goto error_nomem;
+
+		slot->ev.error.data = buf;
+		break;
+	}
+
+	slot->next = NULL;
+	if (dec->queue_last)
+		dec->queue_last->next = slot;
+	else
+		dec->queue_first = slot;
+	dec->queue_last = slot;
+	++dec->n_queued;
+
+	return 0;
+
+error_nomem:
+	r = llog_ENOMEM(dec);
+error:
+	budget_release(slot->charge);
+	slot->charge = 0;
+	shl_arena_reset(&slot->arena);
+	slot->next = dec->unused;
+	dec->unused = slot;
+	return r;
+}
+
+static int decoder_call(struct wfd_rtsp_decoder *dec,
+			struct wfd_rtsp_decoder_event *ev)
+{
+	int r;
+
+	if (!dec->event_fn)
+		return decoder_queue(dec, ev);
+
+	r = dec->event_fn(dec, dec->data, ev);
+	if (r < 0)
+		dec->failed_cb = true;
+
+	return r;
+}
+
+static int decoder_submit(struct wfd_rtsp_decoder *dec)
+{
+	struct wfd_rtsp_decoder_event ev = { };
+	int r;
+
+	ev.type = WFD_RTSP_DECODER_MSG;
+	ev.msg = &dec->cur->msg;
+	r = decoder_call(dec, &ev);
+	if (decoder_clear_msg(dec) < 0 && r >= 0)
+		r = -ENOMEM;
+
+	return r;
+}
+
+static int decoder_submit_data(struct wfd_rtsp_decoder *dec,
+			       const uint8_t *p)
+{
+	struct wfd_rtsp_decoder_event ev = { };
+	struct iovec *vec = ev.data.vec;
+	uint8_t *buf;
+	int r;
+
+	/* The frame is either passed as contiguous buffer @p, or, if @p is
+	 * NULL, it is the whole content of the ring-buffer. */
+
+	ev.type = WFD_RTSP_DECODER_DATA;
+	ev.data.channel = dec->data_channel;
+	ev.data.size = dec->data_size;
+
+	/* in pull-mode, the queue copies the frame anyway */
+	if ((dec->flags & WFD_RTSP_DECODER_F_ZERO_COPY) || !dec->event_fn) {
+		if (p) {
+			vec[0].iov_base = (void*)p;
+			vec[0].iov_len = dec->data_size;
+			ev.data.n_vec = 1;
+		} else {
+			ev.data.n_vec = shl_ring_peek(&dec->buf, vec);
+		}
+
+		if (ev.data.n_vec == 1)
+			ev.data.value = vec[0].iov_base;
+	} else {
+		/* data frames are only parsed in between messages, so the
+		 * arena is unused and we can borrow it for the copy */
+		buf = shl_arena_alloc(&dec->cur->arena, dec->data_size + 1);
+		if (!buf)
+			return llog_ENOMEM(dec);
+
+		/* Not really needed, but in case it's actually a text-payload
+		 * make sure it's 0-terminated to work around client bugs. */
+		buf[dec->data_size] = 0;
+
+		if (p)
+			memcpy(buf, p, dec->data_size);
+		else
+			shl_ring_copy(&dec->buf, buf, dec->data_size);
+
+		ev.data.value = buf;
+		ev.data.n_vec = 1;
+		vec[0].iov_base = buf;
+		vec[0].iov_len = dec->data_size;
+	}
+
+	r = decoder_call(dec, &ev);
+	shl_arena_reset(&dec->cur->arena);
+
+	return r;
+}
+
+static int decoder_submit_chunk(struct wfd_rtsp_decoder *dec,
+				const void *p,
+				size_t len)
+{
+	struct wfd_rtsp_decoder_event ev = { };
+
+	ev.type = WFD_RTSP_DECODER_BODY_CHUNK;
+	ev.chunk.value = p;
+	ev.chunk.size = len;
+	ev.chunk.offset = dec->body_size - dec->remaining_body;
+	ev.chunk.total = dec->body_size;
+
+	dec->remaining_body -= len;
+	return decoder_call(dec, &ev);
+}
+
+static bool decoder_in_line(struct wfd_rtsp_decoder *dec)
+{
+	switch (dec->state) {
+	case STATE_NEW:
+	case STATE_HEADER:
+	case STATE_HEADER_QUOTE:
+	case STATE_HEADER_NL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static int decoder_push(struct wfd_rtsp_decoder *dec,
+			const void *buf,
+			size_t len)
+{
+	const struct wfd_rtsp_decoder_limits *lim = &dec->limits;
+	size_t used, size, grow = 0;
+	int r;
+
+	used = shl_ring_get_size(&dec->buf);
+
+	/* A line is only complete once the first character of the next line
+	 * tells it's not continued, so allow for that and the line-break. The
+	 * exact length is checked once the line is complete. */
+	if (lim->max_line && decoder_in_line(dec) &&
+	    used + len > lim->max_line + LINE_SLACK)
+		return decoder_limit(dec, WFD_RTSP_DECODER_E_LINE);
+	if (lim->max_buffer && used + len > lim->max_buffer)
+		return decoder_limit(dec, WFD_RTSP_DECODER_E_BUFFER);
+
+	size = shl_ring_get_push_size(&dec->buf, len);
+	if (size > dec->budget) {
+		grow = size - dec->budget;
+		if (!budget_charge(grow))
+			return decoder_limit(dec, WFD_RTSP_DECODER_E_BUDGET);
+	}
+
+	r = shl_ring_push(&dec->buf, buf, len);
+	if (r < 0) {
+		budget_release(grow);
+		return llog_ERR(dec, r);
+	}
+
+	dec->budget += grow;
+	return 0;
+}
+
+_shl_public_
+void wfd_rtsp_decoder_set_limits(struct wfd_rtsp_decoder *dec,
+				 const struct wfd_rtsp_decoder_limits *limits)
+{
+	if (!dec)
+		return;
+
+	if (limits)
+		dec->limits = *limits;
+	else
+		shl_zero(dec->limits);
+}
+
+_shl_public_
+void wfd_rtsp_decoder_get_limits(struct wfd_rtsp_decoder *dec,
+				 struct wfd_rtsp_decoder_limits *limits)
+{
+	if (!dec || !limits)
+		return;
+
+	*limits = dec->limits;
+}
+
+_shl_public_
+void wfd_rtsp_decoder_set_budget(size_t max)
+{
+	__atomic_store_n(&budget_max, max, __ATOMIC_RELAXED);
+}
+
+_shl_public_
+size_t wfd_rtsp_decoder_get_budget_used(void)
+{
+	return __atomic_load_n(&budget_used, __ATOMIC_RELAXED);
+}
+
+_shl_public_
+size_t wfd_rtsp_decoder_get_space(struct wfd_rtsp_decoder *dec)
+{
+	const struct wfd_rtsp_decoder_limits *lim;
+	size_t used, space = SIZE_MAX, max, total;
+
+	if (!dec || dec->dead || decoder_queue_full(dec))
+		return 0;
+
+	lim = &dec->limits;
+	used = shl_ring_get_size(&dec->buf);
+
+	if (lim->max_line && decoder_in_line(dec))
+		space = shl_min(space, lim->max_line + LINE_SLACK -
+					shl_min(used, lim->max_line + LINE_SLACK));
+	if (lim->max_buffer)
+		space = shl_min(space, lim->max_buffer -
+					shl_min(used, lim->max_buffer));
+
+	/* free room in our own buffer doesn't cost any budget */
+	max = __atomic_load_n(&budget_max, __ATOMIC_RELAXED);
+	if (max) {
+		total = __atomic_load_n(&budget_used, __ATOMIC_RELAXED);
+		total = max - shl_min(total, max);
+		total += dec->budget - used;
+		space = shl_min(space, total);
+	}
+
+	return space;
+}
+
+/*
+ * Entities
+ * The length of buffered entities is known once the header is complete, so we
+ * copy the input straight into the final entity buffer of the message. Each
+ * byte of the entity is copied exactly once and the ring-buffer is never
+ * involved. The announced length is not trusted, though: only up to
+ * ENTITY_PREALLOC bytes are allocated upfront, the rest grows geometrically as
+ * input actually arrives. As the entity is buffered input, its buffer is
+ * charged against the global budget until the message was submitted.
+ */
+
+static void decoder_release_entity(struct wfd_rtsp_decoder *dec)
+{
+	budget_release(dec->entity_charge);
+	dec->entity_charge = 0;
+}
+
+/* make room for @size bytes of the entity, including the terminating 0 */
+static int decoder_grow_entity(struct wfd_rtsp_decoder *dec, size_t size)
+{
+	struct decoder_msg *m = dec->cur;
+	size_t charge = 0;
+	uint8_t *t;
+
+	if (size > dec->entity_charge) {
+		charge = size - dec->entity_charge;
+		if (!budget_charge(charge))
+			return decoder_limit(dec, WFD_RTSP_DECODER_E_BUDGET);
+	}
+
+	if (size > m->entity_alloc) {
+		t = realloc(m->entity, size);
+		if (!t) {
+			budget_release(charge);
+			return llog_ENOMEM(dec);
+		}
+
+		m->entity = t;
+		m->entity_alloc = size;
+	}
+
+	dec->entity_charge += charge;
+	return 0;
+}
+
+static int decoder_alloc_entity(struct wfd_rtsp_decoder *dec)
+{
+	return decoder_grow_entity(dec, shl_min(dec->remaining_body + 1,
+						(size_t)ENTITY_PREALLOC));
+}
+
+static int decoder_fill_entity(struct wfd_rtsp_decoder *dec,
+			       const void *p,
+			       size_t len)
+{
+	size_t off, size;
+	int r;
+
+	off = dec->body_size - dec->remaining_body;
+	if (off + len + 1 > dec->entity_charge) {
+		size = shl_max(off + len + 1, dec->entity_charge * 2);
+		size = shl_min(size, dec->body_size + 1);
+		r = decoder_grow_entity(dec, size);
+		if (r < 0)
+			return r;
+	}
+
+	memcpy(&dec->cur->entity[off], p, len);
+	dec->remaining_body -= len;
+	return 0;
+}
+
+/*
+ * Header ID-line Handling
+ * This parses both, the REQUEST and RESPONSE lines of an RTSP method. It is
+ * always the first header line and defines the type of message. If it is
+ * unrecognized, we set it to UNKNOWN.
+ * Note that regardless of the ID-line, all following lines are parsed as
+ * generic headers followed by an optional entity.
+ */
+
+static int decoder_parse_request(struct wfd_rtsp_decoder *dec,
+				 char *line,
+				 size_t len)
+{
+	unsigned int major, minor;
+	size_t cmdlen, urllen;
+	char *next, *prev, *cmd, *url;
+
+	/* Requests look like this:
+	 *   <cmd> <url> RTSP/<major>.<minor>
+	 * We try to match <cmd> here, but accept invalid commands. <url> is
+	 * never parsed (it can become pretty complex if done properly). */
+
+	next = line;
+
+	/* parse <cmd> */
+	cmd = line;
+	next = strchr(next, ' ');
+	if (!next || next == cmd)
+		goto error;
+	cmdlen = next - cmd;
+
+	/* skip " " */
+	++next;
+
+	/* parse <url> */
+	url = next;
+	next = strchr(next, ' ');
+	if (!next || next == url)
+		goto error;
+	urllen = next - url;
+
+	/* skip " " */
+	++next;
+
+	/* parse "RTSP/" */
+	if (strncasecmp(next, "RTSP/", 5))
+		goto error;
+	next += 5;
+
+	/* parse "%u" */
+	prev = next;
+	shl_atoi_u(prev, 10, (const char**)&next, &major);
+	if (next == prev || *next != '.')
+		goto error;
+
+	/* skip "." */
+	++next;
+
+	/* parse "%u" */
+	prev = next;
+	shl_atoi_u(prev, 10, (const char**)&next, &minor);
+	if (next == prev || *next)
+		goto error;
+
+	cmd = shl_arena_strndup(&dec->cur->arena, cmd, cmdlen);
+	url = shl_arena_strndup(&dec->cur->arena, url, urllen);
+	if (!cmd || !url)
+		return llog_ENOMEM(dec);
+
+	dec->cur->msg.type = WFD_RTSP_MSG_REQUEST;
+	dec->cur->msg.id.line = line;
+	dec->cur->msg.id.length = len;
+	dec->cur->msg.id.request.method = cmd;
+	dec->cur->msg.id.request.type = wfd_rtsp_method_from_name(cmd);
+	dec->cur->msg.id.request.uri = url;
+	dec->cur->msg.id.request.major = major;
+	dec->cur->msg.id.request.minor = minor;
+
+	return 0;
+
+error:
+	/* Invalid request line.. Set type to UNKNOWN and let the caller deal
+	 * with it. We will not try to send any error to avoid triggering
+	 * another error if the remote side doesn't understand proper RTSP (or
+	 * if our implementation is buggy). */
+	dec->cur->msg.type = WFD_RTSP_MSG_UNKNOWN;
+	dec->cur->msg.id.line = line;
+	dec->cur->msg.id.length = len;
+	return 0;
+}
+
+static int decoder_parse_response(struct wfd_rtsp_decoder *dec,
+				  char *line,
+				  size_t len)
+{
+	unsigned int major, minor, code;
+	char *prev, *next;
+
+	/* Responses look like this:
+	 *   RTSP/<major>.<minor> <code> <string..>
+	 *   RTSP/%u.%u %u %s
+	 * We first parse the RTSP version and code. Everything appended to
+	 * this is optional and represents the error string. */
+
+	/* skip "RTSP/", already parsed by parent */
+	next = &line[5];
+
+	/* parse "%u" */
+	prev = next;
+	shl_atoi_u(prev, 10, (const char**)&next, &major);
+	if (next == prev || *next != '.')
+		goto error;
+
+	/* skip "." */
+	++next;
+
+	/* parse "%u" */
+	prev = next;
+	shl_atoi_u(prev, 10, (const char**)&next, &minor);
+	if (next == prev || *next != ' ')
+		goto error;
+
+	/* skip " " */
+	++next;
+
+	/* parse: %u */
+	prev = next;
+	shl_atoi_u(prev, 10, (const char**)&next, &code);
+	if (next == prev)
+		goto error;
+	if (*next && *next != ' ')
+		goto error;
+
+	/* skip " " */
+	if (*next)
+		++next;
+
+	/* parse: %s
+	 * The phrase is the tail of the zero-terminated line, so we can
+	 * point into the line directly. */
+
+	dec->cur->msg.type = WFD_RTSP_MSG_RESPONSE;
+	dec->cur->msg.id.line = line;
+	dec->cur->msg.id.length = len;
+	dec->cur->msg.id.response.major = major;
+	dec->cur->msg.id.response.minor = minor;
+	dec->cur->msg.id.response.status = code;
+	dec->cur->msg.id.response.phrase = next;
+
+	return 0;
+
+error:
+	/* Couldn't parse line. Avoid sending an error message as we could
+	 * trigger another error and end up in an endless error loop. Instead,
+	 * set message type to UNKNOWN and let the caller deal with it. */
+	dec->cur->msg.type = WFD_RTSP_MSG_UNKNOWN;
+	dec->cur->msg.id.line = line;
+	dec->cur->msg.id.length = len;
+	return 0;
+}
+
+static int decoder_parse_id(struct wfd_rtsp_decoder *dec, char *line, size_t len)
+{
+	if (!strncasecmp(line, "RTSP/", 5))
+		return decoder_parse_response(dec, line, len);
+	else
+		return decoder_parse_request(dec, line, len);
+}
+
+/*
+ * RTSP Header Parser
+ * This parses RTSP header lines. These follow the ID-line and may contain
+ * arbitrary additional information. Note that we parse any kind of message that
+ * we cannot identify as UNKNOWN. Thus, the caller can implement arbitrary
+ * additional parsers.
+ *
+ * Furthermore, if a header-line cannot be parsed correctly, even though the
+ * header-type is known, we still add it as UNKNOWN. Therefore, if the caller
+ * implements extensions to *known* header lines, it still needs to go through
+ * all unknown lines. It's not enough to go through the lines of the given type.
+ */
+
+/*
+ * Lines and lengths of a header share a single block, which is doubled
+ * whenever it's full. Both arrays are zero-terminated, so @count lines need
+ * @count + 1 slots. The capacity is implied by @count, hence we don't have to
+ * track it in the public header.
+ */
+
+static size_t header_capacity(size_t count)
+{
+	return SHL_ALIGN_POWER2(shl_max_t(size_t, 4U, count + 1));
+}
+
+static int header_append(struct wfd_rtsp_decoder *dec,
+			 struct wfd_rtsp_msg_header *h,
+			 char *line,
+			 size_t len)
+{
+	char **tlines;
+	size_t *tlengths;
+	size_t num;
+
+	num = header_capacity(h->count + 1);
+	if (!h->count || num > header_capacity(h->count)) {
+		tlines = shl_arena_alloc(&dec->cur->arena,
+					 num * (sizeof(*h->lines) +
+						sizeof(*h->lengths)));
+		if (!tlines)
+			return -ENOMEM;
+
+		tlengths = (size_t*)&tlines[num];
+		if (h->count) {
+			memcpy(tlines, h->lines,
+			       h->count * sizeof(*h->lines));
+			memcpy(tlengths, h->lengths,
+			       h->count * sizeof(*h->lengths));
+		}
+
+		h->lines = tlines;
+		h->lengths = tlengths;
+	}
+
+	h->lines[h->count] = line;
+	h->lengths[h->count] = len;
+	++h->count;
+	h->lines[h->count] = NULL;
+	h->lengths[h->count] = 0;
+
+	return 0;
+}
+
+/* Content-Length is needed for framing, so it's wanted regardless of interest */
+static bool decoder_wants_header(struct wfd_rtsp_decoder *dec,
+				 unsigned int type)
+{
+	return type == WFD_RTSP_HEADER_CONTENT_LENGTH ||
+	       (dec->interest & WFD_RTSP_HEADER_MASK(type));
+}
+
+static int decoder_add_unknown_line(struct wfd_rtsp_decoder *dec,
+				    char *line,
+				    size_t len)
+{
+	struct wfd_rtsp_msg_header *h;
+	int r;
+
+	/* Cannot parse header line. Append it at the end of the line-array
+	 * of type UNKNOWN. Let the caller deal with it. */
+	if (!decoder_wants_header(dec, WFD_RTSP_HEADER_UNKNOWN))
+		return 0;
+
+	h = decoder_get_header(dec, WFD_RTSP_HEADER_UNKNOWN);
+	if (!h)
+		return llog_ENOMEM(dec);
+
+	r = header_append(dec, h, line, len);
+	return r < 0 ? llog_ERR(dec, r) : 0;
+}
+
+int rtsp_parse_content_length(const char *value, size_t len, size_t *out)
+{
+	const char *next;
+	size_t clen;
+	int r;
+
+	/* Lengths that leave no room for the terminating 0 are invalid, too.
+	 * We'd fail to allocate the entity anyway. */
+	r = shl_atoi_zn(value, len, 10, &next, &clen);
+	if (r < 0 || next != value + len || clen == SIZE_MAX)
+		return -EINVAL;
+
+	*out = clen;
+	return 0;
+}
+
+static int decoder_parse_content_length(struct wfd_rtsp_decoder *dec,
+					char *line,
+					size_t len,
+					const char *value,
+					size_t vlen)
+{
+	struct wfd_rtsp_msg_header *h;
+	int r;
+	size_t clen;
+
+	r = rtsp_parse_content_length(value, vlen, &clen);
+	if (r < 0) {
 		/* Screwed content-length line? We cannot recover from that as
 		 * the attached entity is of unknown length. Abort.. */
-		return -EINVAL;
+		return r;
 	}
 
-	r = header_append(h, line, len);
+	h = decoder_get_header(dec, WFD_RTSP_HEADER_CONTENT_LENGTH);
+	if (!h)
+		return llog_ENOMEM(dec);
+
+	r = header_append(dec, h, line, len);
 	if (r < 0)
 		return llog_ERR(dec, r);
 
@@ -620,23 +1460,25 @@ static int decoder_parse_content_length(struct wfd_rtsp_decoder *dec,
 static int decoder_parse_cseq(struct wfd_rtsp_decoder *dec,
 			      char *line,
 			      size_t len,
-			      char *tokens,
-			      size_t num)
+			      const char *value,
+			      size_t vlen)
 {
 	struct wfd_rtsp_msg_header *h;
 	int r;
 	unsigned long val;
-	char *next;
-
-	h = &dec->msg.headers[WFD_RTSP_HEADER_CSEQ];
+	const char *next;
 
-	r = shl_atoi_ul(tokens, 10, (const char**)&next, &val);
-	if (r < 0 || *next) {
+	r = shl_atoi_uln(value, vlen, 10, &next, &val);
+	if (r < 0 || next != value + vlen) {
 		/* Screwed cseq line? Append it as unknown line. */
 		return decoder_add_unknown_line(dec, line, len);
 	}
 
-	r = header_append(h, line, len);
+	h = decoder_get_header(dec, WFD_RTSP_HEADER_CSEQ);
+	if (!h)
+		return llog_ENOMEM(dec);
+
+	r = header_append(dec, h, line, len);
 	if (r < 0)
 		return llog_ERR(dec, r);
 
@@ -646,57 +1488,416 @@ static int decoder_parse_cseq(struct wfd_rtsp_decoder *dec,
 	return 0;
 }
 
+/*
+ * Transport Header
+ * Transport lines carry a list of transport-specs, in order of preference:
+ *   <protocol>/<profile>[/<lower-transport>] *(";" <parameter>)
+ * Only the first spec we understand is parsed, and only the parameters a
+ * session needs to set up its streams. Everything is read in place, nothing
+ * is allocated. Values of unknown parameters may be quoted-strings, so we
+ * skip them properly to find the next parameter or spec.
+ */
+
+static const char *transport_skip_lws(const char *p, const char *end)
+{
+	while (p < end && (rtsp_char_get_class(*p) & RTSP_CHAR_LWS))
+		++p;
+
+	return p;
+}
+
+/* return end of the token at @p, which ends at LWS or any of @delim */
+static const char *transport_token(const char *p,
+				   const char *end,
+				   const char *delim)
+{
+	while (p < end && !(rtsp_char_get_class(*p) & RTSP_CHAR_LWS) &&
+	       !strchr(delim, *p))
+		++p;
+
+	return p;
+}
+
+static bool transport_is(const char *p, const char *end, const char *word)
+{
+	size_t l = strlen(word);
+
+	return (size_t)(end - p) == l && !strncasecmp(p, word, l);
+}
+
+static int transport_parse_range(const char *p,
+				 const char *end,
+				 unsigned long max,
+				 unsigned long *out)
+{
+	const char *next;
+	unsigned long v;
+	size_t i;
+	int r;
+
+	for (i = 0; i < 2; ++i) {
+		r = shl_atoi_uln(p, end - p, 10, &next, &v);
+		if (r < 0 || next == p || v > max)
+			return -EINVAL;
+
+		out[i] = v;
+		p = next;
+		if (p == end)
+			break;
+		if (i || *p != '-')
+			return -EINVAL;
+		++p;
+	}
+
+	/* single values are ranges of one */
+	if (!i)
+		out[1] = out[0];
+	else if (out[1] < out[0])
+		return -EINVAL;
+
+	return 0;
+}
+
+/* return end of the spec at @p, which is the next ',' outside of quotes */
+static const char *transport_skip_spec(const char *p, const char *end)
+{
+	for ( ; p < end && *p != ','; ++p) {
+		if (*p != '"')
+			continue;
+
+		for (++p; p < end && *p != '"'; ++p)
+			if (*p == '\\' && p + 1 < end)
+				++p;
+		if (p == end)
+			break;
+	}
+
+	return p;
+}
+
+/* parse the single transport-spec @p to @end */
+static int transport_parse_spec(const char *p,
+				const char *end,
+				struct wfd_rtsp_transport *out)
+{
+	struct wfd_rtsp_transport t = { };
+	const char *name, *name_end, *v, *v_end;
+	unsigned long range[2];
+
+	/* <protocol>/<profile>[/<lower-transport>] */
+	p = transport_skip_lws(p, end);
+	v = p;
+	p = transport_token(p, end, ";,");
+	if (transport_is(v, p, "RTP/AVP") || transport_is(v, p, "RTP/AVP/UDP"))
+		t.lower = WFD_RTSP_TRANSPORT_UDP;
+	else if (transport_is(v, p, "RTP/AVP/TCP"))
+		t.lower = WFD_RTSP_TRANSPORT_TCP;
+	else
+		return -EINVAL;
+
+	for (;;) {
+		p = transport_skip_lws(p, end);
+		if (p == end)
+			break;
+		if (*p != ';')
+			return -EINVAL;
+
+		/* <name>[=<value>] */
+		p = transport_skip_lws(p + 1, end);
+		name = p;
+		p = name_end = transport_token(p, end, ";,=");
+		v = v_end = NULL;
+
+		p = transport_skip_lws(p, end);
+		if (p < end && *p == '=') {
+			p = v = transport_skip_lws(p + 1, end);
+			if (p < end && *p == '"') {
+				for (++p; p < end && *p != '"'; ++p)
+					if (*p == '\\' && p + 1 < end)
+						++p;
+				if (p == end)
+					return -EINVAL;
+				++p;
+			} else {
+				p = transport_token(p, end, ";,");
+			}
+			v_end = p;
+		}
+
+		if (transport_is(name, name_end, "unicast")) {
+			t.flags |= WFD_RTSP_TRANSPORT_UNICAST;
+		} else if (transport_is(name, name_end, "multicast")) {
+			t.flags |= WFD_RTSP_TRANSPORT_MULTICAST;
+		} else if (transport_is(name, name_end, "client_port")) {
+			if (!v || transport_parse_range(v, v_end, 65535, range))
+				return -EINVAL;
+			t.client_port[0] = range[0];
+			t.client_port[1] = range[1];
+			t.flags |= WFD_RTSP_TRANSPORT_CLIENT_PORT;
+		} else if (transport_is(name, name_end, "server_port")) {
+			if (!v || transport_parse_range(v, v_end, 65535, range))
+				return -EINVAL;
+			t.server_port[0] = range[0];
+			t.server_port[1] = range[1];
+			t.flags |= WFD_RTSP_TRANSPORT_SERVER_PORT;
+		} else if (transport_is(name, name_end, "interleaved")) {
+			if (!v || transport_parse_range(v, v_end, 255, range))
+				return -EINVAL;
+			t.interleaved[0] = range[0];
+			t.interleaved[1] = range[1];
+			t.flags |= WFD_RTSP_TRANSPORT_INTERLEAVED;
+		}
+	}
+
+	*out = t;
+	return 0;
+}
+
+_shl_public_
+int wfd_rtsp_transport_parse(const char *value,
+			     size_t len,
+			     struct wfd_rtsp_transport *transport)
+{
+	const char *p, *end, *spec_end;
+
+	if (!value || !transport)
+		return -EINVAL;
+
+	p = value;
+	end = value + len;
+
+	/* specs we don't understand are skipped, the next one might do */
+	while (p < end) {
+		spec_end = transport_skip_spec(p, end);
+		if (!transport_parse_spec(p, spec_end, transport))
+			return 0;
+
+		p = spec_end < end ? spec_end + 1 : end;
+	}
+
+	return -EINVAL;
+}
+
+static int decoder_parse_transport(struct wfd_rtsp_decoder *dec,
+				   char *line,
+				   size_t len,
+				   const char *value,
+				   size_t vlen)
+{
+	struct wfd_rtsp_msg_header *h;
+	int r;
+
+	h = decoder_get_header(dec, WFD_RTSP_HEADER_TRANSPORT);
+	if (!h)
+		return llog_ENOMEM(dec);
+
+	r = header_append(dec, h, line, len);
+	if (r < 0)
+		return llog_ERR(dec, r);
+
+	/* The first spec that we understand is the preferred one, on this
+	 * line or any later one. Lines without any are kept, it's up to the
+	 * caller to deal with them. */
+	if (h->transport.lower == WFD_RTSP_TRANSPORT_UNKNOWN)
+		wfd_rtsp_transport_parse(value, vlen, &h->transport);
+
+	return 0;
+}
+
+/*
+ * Session Header
+ * Session lines carry the session-id and an optional timeout:
+ *   <session-id> *(";" <parameter>)
+ * Session-ids are opaque and case-sensitive. They're hashed right away so
+ * requests can be routed via wfd_rtsp_session_table_lookup() without another
+ * pass over the id. Parameters use the same syntax as transport parameters.
+ */
+
+_shl_public_
+int wfd_rtsp_session_parse(const char *value,
+			   size_t len,
+			   struct wfd_rtsp_session *session)
+{
+	struct wfd_rtsp_session s = { };
+	const char *p, *end, *name, *name_end, *v, *next;
+	unsigned long timeout;
+	int r;
+
+	if (!value || !session)
+		return -EINVAL;
+
+	p = value;
+	end = value + len;
+
+	/* <session-id> consists of plain token characters */
+	p = transport_skip_lws(p, end);
+	s.id = p;
+	while (p < end && !rtsp_char_get_class(*p))
+		++p;
+	s.length = p - s.id;
+	if (!s.length)
+		return -EINVAL;
+
+	for (;;) {
+		p = transport_skip_lws(p, end);
+		if (p == end)
+			break;
+		if (*p != ';')
+			return -EINVAL;
+
+		/* <name>[=<value>] */
+		p = transport_skip_lws(p + 1, end);
+		name = p;
+		p = name_end = transport_token(p, end, ";=");
+		v = NULL;
+
+		p = transport_skip_lws(p, end);
+		if (p < end && *p == '=') {
+			v = transport_skip_lws(p + 1, end);
+			p = transport_token(v, end, ";");
+		}
+
+		if (transport_is(name, name_end, "timeout")) {
+			if (!v)
+				return -EINVAL;
+			r = shl_atoi_uln(v, p - v, 10, &next, &timeout);
+			if (r < 0 || next == v || next != p)
+				return -EINVAL;
+			s.timeout = timeout;
+		}
+	}
+
+	s.hash = wfd_rtsp_session_hash(s.id, s.length);
+	*session = s;
+	return 0;
+}
+
+static int decoder_parse_session(struct wfd_rtsp_decoder *dec,
+				 char *line,
+				 size_t len,
+				 const char *value,
+				 size_t vlen)
+{
+	struct wfd_rtsp_msg_header *h;
+	int r;
+
+	h = decoder_get_header(dec, WFD_RTSP_HEADER_SESSION);
+	if (!h)
+		return llog_ENOMEM(dec);
+
+	r = header_append(dec, h, line, len);
+	if (r < 0)
+		return llog_ERR(dec, r);
+
+	/* Only the first valid line counts, like for transport headers. The
+	 * id points into the line, which lives as long as the message. */
+	if (!h->session.id)
+		wfd_rtsp_session_parse(value, vlen, &h->session);
+
+	return 0;
+}
+
+/* return token value; only tokens that need decoding are copied */
+static const char *decoder_get_token(struct wfd_rtsp_decoder *dec,
+				     const char *line,
+				     const struct wfd_rtsp_token *t,
+				     size_t *len)
+{
+	char *v;
+
+	if (!(t->flags & WFD_RTSP_TOKEN_ESCAPED)) {
+		*len = t->length;
+		return &line[t->offset];
+	}
+
+	v = shl_arena_alloc(&dec->cur->arena, t->length + 1);
+	if (!v)
+		return NULL;
+
+	*len = wfd_rtsp_token_copy(line, t, v);
+	return v;
+}
+
 static int decoder_parse_header(struct wfd_rtsp_decoder *dec,
 				char *line,
 				size_t len)
 {
+	struct wfd_rtsp_token_iter iter;
+	struct wfd_rtsp_token t;
+	struct wfd_rtsp_msg_header *h;
 	unsigned int type;
-	char *next, *tokens;
-	ssize_t num;
+	const char *v;
+	size_t vlen, vstart;
 	int r;
 
-	num = wfd_rtsp_tokenize(line, len, &tokens);
-	if (num < 0)
-		return llog_ENOMEM(dec);
-	if (num < 2)
-		goto error;
-
 	/* Header lines look like this:
-	 *   <name>: <value> */
-	next = tokens;
+	 *   <name>: <value>
+	 * Only the name and the first value token are ever needed, so we
+	 * iterate the tokens in place instead of tokenizing the whole line. */
+	wfd_rtsp_token_iter_init(&iter, line, len);
 
 	/* parse <name> */
-	type = wfd_rtsp_header_from_name(next);
-	next = wfd_rtsp_next_token(next);
-	--num;
+	if (!wfd_rtsp_token_iter_next(&iter, &t))
+		goto error;
+	v = decoder_get_token(dec, line, &t, &vlen);
+	if (!v)
+		return llog_ENOMEM(dec);
+	type = wfd_rtsp_header_from_name_n(v, vlen);
 
 	/* parse ":" */
-	if (strcmp(next, ":"))
+	if (!wfd_rtsp_token_iter_next(&iter, &t))
+		goto error;
+	if (t.length != 1 || line[t.offset] != ':' ||
+	    (t.flags & WFD_RTSP_TOKEN_ESCAPED))
 		goto error;
-	next = wfd_rtsp_next_token(next);
-	--num;
+	vstart = t.offset + 1;
+
+	/* lines that weren't identified on the raw input are filtered here;
+	 * malformed lines are UNKNOWN, whatever their name */
+	if (!decoder_wants_header(dec, type))
+		return 0;
+
+	/* first <value> token, empty if there is none */
+	if (wfd_rtsp_token_iter_next(&iter, &t)) {
+		v = decoder_get_token(dec, line, &t, &vlen);
+		if (!v)
+			return llog_ENOMEM(dec);
+	} else {
+		v = "";
+		vlen = 0;
+	}
 
 	/* dispatch to header specific parser */
 	switch (type) {
 	case WFD_RTSP_HEADER_CONTENT_LENGTH:
-		r = decoder_parse_content_length(dec, line, len, next, num);
+		r = decoder_parse_content_length(dec, line, len, v, vlen);
 		break;
 	case WFD_RTSP_HEADER_CSEQ:
-		r = decoder_parse_cseq(dec, line, len, next, num);
+		r = decoder_parse_cseq(dec, line, len, v, vlen);
+		break;
+	case WFD_RTSP_HEADER_TRANSPORT:
+		r = decoder_parse_transport(dec, line, len, &line[vstart],
+					    len - vstart);
+		break;
+	case WFD_RTSP_HEADER_SESSION:
+		r = decoder_parse_session(dec, line, len, &line[vstart],
+					  len - vstart);
 		break;
 	default:
 		/* no parser for given type available; append to list */
-		r = header_append(&dec->msg.headers[type], line, len);
+		h = decoder_get_header(dec, type);
+		if (!h)
+			return llog_ENOMEM(dec);
+
+		r = header_append(dec, h, line, len);
 		if (r < 0)
 			llog_vERR(dec, r);
 		break;
 	}
 
-	free(tokens);
 	return r;
 
 error:
-	free(tokens);
 	return decoder_add_unknown_line(dec, line, len);
 }
 
@@ -711,6 +1912,7 @@ static size_t sanitize_header_line(struct wfd_rtsp_decoder *dec,
 				   char *line, size_t len)
 {
 	char *src, *dst, c, prev, last_c;
+	unsigned int type;
 	size_t i;
 	bool quoted, escaped;
 
@@ -741,12 +1943,14 @@ static size_t sanitize_header_line(struct wfd_rtsp_decoder *dec,
 				}
 			}
 		} else {
+			type = rtsp_char_get_class(c);
+
 			/* ignore any binary 0 */
-			if (c == '\0')
+			if (type & RTSP_CHAR_ZERO)
 				continue;
 
 			/* turn new-lines/tabs into white-space */
-			if (c == '\r' || c == '\n' || c == '\t') {
+			if (type & RTSP_CHAR_LWS) {
 				c = ' ';
 				last_c = c;
 			}
@@ -776,13 +1980,296 @@ static size_t sanitize_header_line(struct wfd_rtsp_decoder *dec,
 	return dst - line;
 }
 
+/* verify the first ID-line after a resync */
+static int decoder_verify_id(struct wfd_rtsp_decoder *dec)
+{
+	const struct wfd_rtsp_msg *msg = &dec->cur->msg;
+
+	if (msg->type == WFD_RTSP_MSG_RESPONSE ||
+	    (msg->type == WFD_RTSP_MSG_REQUEST &&
+	     msg->id.request.type != WFD_RTSP_METHOD_UNKNOWN)) {
+		dec->resyncing = false;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Header Interest
+ * Callers can restrict the headers they care about. Header lines of other
+ * types are dropped before they're copied out of the ring-buffer, so they cost
+ * neither arena-memory nor a sanitize and tokenizer pass. The header name is
+ * identified on the raw line; whenever that's ambiguous, the line takes the
+ * regular path and is filtered once its name is parsed. Content-Length is
+ * needed for framing and always parsed.
+ */
+
+#define INTEREST_PEEK 32
+
+_shl_public_
+void wfd_rtsp_decoder_set_interest(struct wfd_rtsp_decoder *dec,
+				   uint64_t mask)
+{
+	if (!dec)
+		return;
+
+	dec->interest = mask;
+}
+
+_shl_public_
+uint64_t wfd_rtsp_decoder_get_interest(struct wfd_rtsp_decoder *dec)
+{
+	if (!dec)
+		return 0;
+
+	return dec->interest;
+}
+
+/*
+ * Identify the header type of a raw line from its first @l bytes. @whole is
+ * true if that's the complete line. The value of a typed header starts at
+ * *value; for UNKNOWN lines, that's the whole line. Returns false if the raw
+ * input is ambiguous and the line needs to be sanitized first.
+ */
+static bool header_scan_name(const char *line,
+			     size_t l,
+			     bool whole,
+			     unsigned int *type,
+			     size_t *value)
+{
+	size_t n, i;
+
+	/* <name> is a plain token; anything else is left to the parser */
+	for (n = 0; n < l && !rtsp_char_get_class(line[n]); ++n)
+		/* empty */ ;
+	if (!n)
+		return false;
+
+	for (i = n; i < l; ++i)
+		if (!(rtsp_char_get_class(line[i]) &
+		      (RTSP_CHAR_LWS | RTSP_CHAR_CTL)))
+			break;
+
+	/* binary 0s are dropped by the tokenizer and may join tokens */
+	if (i < l && !line[i])
+		return false;
+
+	if (i < l && line[i] == ':') {
+		*type = wfd_rtsp_header_from_name_n(line, n);
+		for (++i; i < l && (rtsp_char_get_class(line[i]) & RTSP_CHAR_LWS); ++i)
+			/* empty */ ;
+		*value = *type == WFD_RTSP_HEADER_UNKNOWN ? 0 : i;
+	} else if (i < l || whole) {
+		*type = WFD_RTSP_HEADER_UNKNOWN;
+		*value = 0;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Identify the header type of a sanitized line the way decoder_parse_header()
+ * does, for lines header_scan_name() cannot read (leading CTLs, quoted names,
+ * ..). Sanitized lines have no binary 0s, so only escaped quoted-strings need
+ * decoding, and those never decode into a header name.
+ */
+static void header_token_name(const char *line,
+			      size_t l,
+			      unsigned int *type,
+			      size_t *value)
+{
+	struct wfd_rtsp_token_iter iter;
+	struct wfd_rtsp_token name, t;
+	size_t i;
+
+	*type = WFD_RTSP_HEADER_UNKNOWN;
+	*value = 0;
+
+	wfd_rtsp_token_iter_init(&iter, line, l);
+	if (!wfd_rtsp_token_iter_next(&iter, &name) ||
+	    (name.flags & WFD_RTSP_TOKEN_ESCAPED))
+		return;
+
+	if (!wfd_rtsp_token_iter_next(&iter, &t) || t.length != 1 ||
+	    line[t.offset] != ':' || (t.flags & WFD_RTSP_TOKEN_ESCAPED))
+		return;
+
+	*type = wfd_rtsp_header_from_name_n(&line[name.offset], name.length);
+	if (*type == WFD_RTSP_HEADER_UNKNOWN)
+		return;
+
+	for (i = t.offset + 1; i < l && (rtsp_char_get_class(line[i]) & RTSP_CHAR_LWS); ++i)
+		/* empty */ ;
+	*value = i;
+}
+
+static bool decoder_skip_header(struct wfd_rtsp_decoder *dec)
+{
+	char name[INTEREST_PEEK];
+	unsigned int type;
+	size_t l, value;
+
+	if (dec->interest == WFD_RTSP_HEADER_MASK_ALL)
+		return false;
+
+	/* the limit applies to the sanitized line, which is never longer */
+	if (dec->limits.max_line && dec->buflen > dec->limits.max_line)
+		return false;
+
+	l = shl_min(dec->buflen, sizeof(name));
+	shl_ring_copy(&dec->buf, name, l);
+
+	if (!header_scan_name(name, l, l == dec->buflen, &type, &value))
+		return false;
+
+	return !decoder_wants_header(dec, type);
+}
+
+/*
+ * Lazy Headers
+ * With WFD_RTSP_DECODER_F_LAZY_HEADERS, header lines are appended to a single
+ * raw block per message and indexed by type and value offset. Neither the
+ * sanitizer nor the tokenizer run on them, unless the name cannot be
+ * identified on the raw line; such names are tokenized just like in the
+ * parser. Values are sanitized on demand by wfd_rtsp_msg_copy_field().
+ * Content-Length and CSeq are still parsed as usual, the decoder needs the
+ * former and every user needs the latter.
+ * The block and index buffers belong to the pooled message, so they're only
+ * grown while warming up.
+ */
+
+static const struct wfd_rtsp_msg_field *
+msg_find_field(const struct wfd_rtsp_msg *msg, unsigned int type, size_t idx)
+{
+	size_t i;
+
+	if (!msg || type >= WFD_RTSP_HEADER_CNT ||
+	    !(msg->field_mask & WFD_RTSP_HEADER_MASK(type)))
+		return NULL;
+
+	for (i = 0; i < msg->n_fields; ++i)
+		if (msg->fields[i].type == type && !idx--)
+			return &msg->fields[i];
+
+	return NULL;
+}
+
+_shl_public_
+const char *wfd_rtsp_msg_get_field(const struct wfd_rtsp_msg *msg,
+				   unsigned int type,
+				   size_t idx,
+				   size_t *len)
+{
+	const struct wfd_rtsp_msg_field *f;
+
+	f = msg_find_field(msg, type, idx);
+	if (!f)
+		return NULL;
+
+	if (len)
+		*len = f->length - f->value;
+	return &msg->raw[f->offset + f->value];
+}
+
+_shl_public_
+ssize_t wfd_rtsp_msg_copy_field(const struct wfd_rtsp_msg *msg,
+				unsigned int type,
+				size_t idx,
+				char *buf,
+				size_t size)
+{
+	const char *v;
+	size_t len;
+
+	v = wfd_rtsp_msg_get_field(msg, type, idx, &len);
+	if (!v)
+		return -ENOENT;
+	if (!buf || size <= len)
+		return -ENOBUFS;
+
+	/* sanitizing never grows a line */
+	memcpy(buf, v, len);
+	buf[len] = 0;
+	return sanitize_header_line(NULL, buf, len);
+}
+
+/* returns >0 if the line needs to be parsed, too */
+static int decoder_index_header(struct wfd_rtsp_decoder *dec)
+{
+	struct decoder_msg *m = dec->cur;
+	struct wfd_rtsp_msg *msg = &m->msg;
+	struct wfd_rtsp_msg_field *f;
+	unsigned int type;
+	size_t l, value;
+	char *line;
+
+	if (!shl_greedy_realloc((void**)&m->raw, &m->raw_alloc,
+				msg->raw_size + dec->buflen + 1) ||
+	    !shl_greedy_realloc((void**)&m->fields, &m->fields_alloc,
+				(msg->n_fields + 1) * sizeof(*f)))
+		return llog_ENOMEM(dec);
+
+	msg->raw = m->raw;
+	msg->fields = m->fields;
+
+	line = &msg->raw[msg->raw_size];
+	l = dec->buflen;
+	shl_ring_copy(&dec->buf, line, l);
+
+	if (!header_scan_name(line, l, true, &type, &value)) {
+		l = sanitize_header_line(dec, line, l);
+		if (!header_scan_name(line, l, true, &type, &value))
+			header_token_name(line, l, &type, &value);
+	}
+
+	while (l > 0 && (rtsp_char_get_class(line[l - 1]) & RTSP_CHAR_LWS))
+		--l;
+
+	if (dec->limits.max_line && l > dec->limits.max_line)
+		return decoder_limit(dec, WFD_RTSP_DECODER_E_LINE);
+
+	/* lines we couldn't identify before copying them may be dropped now */
+	if (!decoder_wants_header(dec, type))
+		return 0;
+
+	f = &msg->fields[msg->n_fields++];
+	f->type = type;
+	f->offset = msg->raw_size;
+	f->length = l;
+	f->value = shl_min(value, l);
+
+	msg->raw_size += l;
+	msg->field_mask |= WFD_RTSP_HEADER_MASK(type);
+
+	return type == WFD_RTSP_HEADER_CONTENT_LENGTH ||
+	       type == WFD_RTSP_HEADER_CSEQ;
+}
+
 static int decoder_finish_header_line(struct wfd_rtsp_decoder *dec)
 {
 	char *line;
 	size_t l;
 	int r;
 
-	line = malloc(dec->buflen + 1);
+	if (dec->cur->msg.id.line) {
+		if (dec->limits.max_headers &&
+		    ++dec->n_lines > dec->limits.max_headers)
+			return decoder_limit(dec, WFD_RTSP_DECODER_E_HEADERS);
+
+		if (decoder_skip_header(dec))
+			return 0;
+
+		if (dec->flags & WFD_RTSP_DECODER_F_LAZY_HEADERS) {
+			r = decoder_index_header(dec);
+			if (r <= 0)
+				return r;
+		}
+	}
+
+	line = shl_arena_alloc(&dec->cur->arena, dec->buflen + 1);
 	if (!line)
 		return llog_ENOMEM(dec);
 
@@ -790,13 +2277,16 @@ static int decoder_finish_header_line(struct wfd_rtsp_decoder *dec)
 	line[dec->buflen] = 0;
 	l = sanitize_header_line(dec, line, dec->buflen);
 
-	if (!dec->msg.id.line)
+	if (dec->limits.max_line && l > dec->limits.max_line)
+		return decoder_limit(dec, WFD_RTSP_DECODER_E_LINE);
+
+	if (!dec->cur->msg.id.line) {
 		r = decoder_parse_id(dec, line, l);
-	else
+		if (r >= 0 && dec->resyncing)
+			r = decoder_verify_id(dec);
+	} else {
 		r = decoder_parse_header(dec, line, l);
-
-	if (r < 0)
-		free(line);
+	}
 
 	return r;
 }
@@ -827,7 +2317,7 @@ int wfd_rtsp_decoder_new(wfd_rtsp_decoder_event_t event_fn,
 {
 	struct wfd_rtsp_decoder *dec;
 
-	if (!event_fn || !out)
+	if (!out)
 		return llog_dEINVAL(log_fn, data);
 
 	dec = calloc(1, sizeof(*dec));
@@ -836,11 +2326,27 @@ int wfd_rtsp_decoder_new(wfd_rtsp_decoder_event_t event_fn,
 
 	dec->event_fn = event_fn;
 	dec->data = data;
+	dec->interest = WFD_RTSP_HEADER_MASK_ALL;
 	dec->llog = log_fn;
 	dec->llog_data = log_data;
 
+	dec->pool = calloc(1, sizeof(*dec->pool));
+	if (!dec->pool)
+		goto err_dec;
+
+	dec->pool->ref = 1;
+	dec->cur = pool_get(dec);
+	if (!dec->cur)
+		goto err_pool;
+
 	*out = dec;
 	return 0;
+
+err_pool:
+	free(dec->pool);
+err_dec:
+	free(dec);
+	return llog_dENOMEM(log_fn, data);
 }
 
 _shl_public_
@@ -849,7 +2355,19 @@ void wfd_rtsp_decoder_free(struct wfd_rtsp_decoder *dec)
 	if (!dec)
 		return;
 
-	msg_clear(&dec->msg);
+	slot_list_free(dec->queue_first);
+	slot_list_free(dec->delivered);
+	slot_list_free(dec->unused);
+
+	/* retained messages keep the pool alive until they're returned */
+	wfd_rtsp_msg_unref(dec->cur ? &dec->cur->msg : NULL);
+	msg_list_free(dec->spare);
+	msg_list_free(__atomic_exchange_n(&dec->pool->free, NULL,
+					  __ATOMIC_ACQUIRE));
+	pool_unref(dec->pool);
+
+	decoder_release_entity(dec);
+	budget_release(dec->budget);
 	shl_ring_clear(&dec->buf);
 	free(dec);
 }
@@ -860,19 +2378,30 @@ void wfd_rtsp_decoder_reset(struct wfd_rtsp_decoder *dec)
 	if (!dec)
 		return;
 
-	msg_clear(&dec->msg);
+	decoder_clear_msg(dec);
 	shl_ring_flush(&dec->buf);
 
+	slot_list_recycle(dec, &dec->queue_first);
+	slot_list_recycle(dec, &dec->delivered);
+	dec->queue_last = NULL;
+	dec->n_queued = 0;
+
 	dec->buflen = 0;
 	dec->last_chr = 0;
 	dec->state = 0;
 	dec->remaining_body = 0;
+	dec->body_mode = WFD_RTSP_DECODER_BODY_BUFFER;
+	dec->body_size = 0;
+	decoder_release_entity(dec);
 
 	dec->data_channel = 0;
 	dec->data_size = 0;
 
+	dec->error = WFD_RTSP_DECODER_E_SYNTAX;
 	dec->quoted = false;
 	dec->dead = false;
+	dec->failed_cb = false;
+	dec->resyncing = false;
 }
 
 _shl_public_
@@ -893,6 +2422,25 @@ void *wfd_rtsp_decoder_get_data(struct wfd_rtsp_decoder *dec)
 	return dec->data;
 }
 
+_shl_public_
+void wfd_rtsp_decoder_set_flags(struct wfd_rtsp_decoder *dec,
+				unsigned int flags)
+{
+	if (!dec)
+		return;
+
+	dec->flags = flags;
+}
+
+_shl_public_
+unsigned int wfd_rtsp_decoder_get_flags(struct wfd_rtsp_decoder *dec)
+{
+	if (!dec)
+		return 0;
+
+	return dec->flags;
+}
+
 static int decoder_feed_char_new(struct wfd_rtsp_decoder *dec, char ch)
 {
 	switch (ch) {
@@ -931,20 +2479,67 @@ static int decoder_feed_char_new(struct wfd_rtsp_decoder *dec, char ch)
 	return 0;
 }
 
+/*
+ * The empty line after the headers was received. If requested, we first let
+ * the caller decide what to do with the entity. Buffered entities continue in
+ * STATE_BODY and the message is submitted once the entity is complete. All
+ * other messages are submitted right away; streamed or discarded entities
+ * never enter the ring-buffer.
+ */
+static int decoder_finish_headers(struct wfd_rtsp_decoder *dec)
+{
+	struct wfd_rtsp_decoder_event ev = { };
+	int r;
+
+	dec->body_size = dec->remaining_body;
+	if (dec->flags & WFD_RTSP_DECODER_F_STREAM_BODY)
+		dec->body_mode = WFD_RTSP_DECODER_BODY_STREAM;
+	else
+		dec->body_mode = WFD_RTSP_DECODER_BODY_BUFFER;
+
+	/* nobody could decide on the entity in pull-mode */
+	if ((dec->flags & WFD_RTSP_DECODER_F_HEADERS) && dec->event_fn) {
+		ev.type = WFD_RTSP_DECODER_HEADERS;
+		ev.headers.msg = &dec->cur->msg;
+		ev.headers.body = dec->body_mode;
+		r = decoder_call(dec, &ev);
+		if (r < 0)
+			return r;
+
+		switch (ev.headers.body) {
+		case WFD_RTSP_DECODER_BODY_BUFFER:
+		case WFD_RTSP_DECODER_BODY_STREAM:
+		case WFD_RTSP_DECODER_BODY_DISCARD:
+			dec->body_mode = ev.headers.body;
+			break;
+		default:
+			return llog_EINVAL(dec);
+		}
+	}
+
+	if (!dec->remaining_body ||
+	    dec->body_mode != WFD_RTSP_DECODER_BODY_BUFFER)
+		return decoder_submit(dec);
+
+	if (dec->limits.max_entity && dec->remaining_body > dec->limits.max_entity)
+		return decoder_limit(dec, WFD_RTSP_DECODER_E_ENTITY);
+
+	return decoder_alloc_entity(dec);
+}
+
 static int decoder_feed_char_header(struct wfd_rtsp_decoder *dec, char ch)
 {
 	int r;
 
 	switch (ch) {
 	case '\r':
-		if (dec->last_chr == '\r' || dec->last_chr == '\n') {
+		if (rtsp_is_header_end(dec->last_chr, ch)) {
 			/* \r\r means empty new-line. We actually allow \r\r\n,
 			 * too. \n\r means empty new-line, too, but might also
 			 * be finished off as \n\r\n so go to STATE_HEADER_NL
 			 * to optionally complete the new-line.
 			 * However, if the body is empty, we need to finish the
 			 * msg early as there might be no \n coming.. */
-			dec->state = STATE_HEADER_NL;
 
 			/* First finish the last header line if any. Don't
 			 * include the current \r as it is already part of the
@@ -953,16 +2548,16 @@ static int decoder_feed_char_header(struct wfd_rtsp_decoder *dec, char ch)
 			if (r < 0)
 				return r;
 
+			dec->state = STATE_HEADER_NL;
+
 			/* discard buffer *and* whitespace */
 			shl_ring_pull(&dec->buf, dec->buflen + 1);
 			dec->buflen = 0;
 
-			/* No remaining body. Finish message! */
-			if (!dec->remaining_body) {
-				r = decoder_submit(dec);
-				if (r < 0)
-					return r;
-			}
+			/* No remaining body? Finish message! */
+			r = decoder_finish_headers(dec);
+			if (r < 0)
+				return r;
 		} else {
 			/* '\r' following any character just means newline
 			 * (optionally followed by \n). We don't do anything as
@@ -971,7 +2566,7 @@ static int decoder_feed_char_header(struct wfd_rtsp_decoder *dec, char ch)
 		}
 		break;
 	case '\n':
-		if (dec->last_chr == '\n') {
+		if (rtsp_is_header_end(dec->last_chr, ch)) {
 			/* We got \n\n, which means we need to finish the
 			 * current header-line. If there's no remaining body,
 			 * we immediately finish the message and go to
@@ -987,14 +2582,14 @@ static int decoder_feed_char_header(struct wfd_rtsp_decoder *dec, char ch)
 			shl_ring_pull(&dec->buf, dec->buflen + 1);
 			dec->buflen = 0;
 
-			if (dec->remaining_body) {
+			if (dec->remaining_body)
 				dec->state = STATE_BODY;
-			} else {
+			else
 				dec->state = STATE_NEW;
-				r = decoder_submit(dec);
-				if (r < 0)
-					return r;
-			}
+
+			r = decoder_finish_headers(dec);
+			if (r < 0)
+				return r;
 		} else if (dec->last_chr == '\r') {
 			/* We got an \r\n. We cannot finish the header line as
 			 * it might be a continuation line. Next character
@@ -1016,7 +2611,7 @@ static int decoder_feed_char_header(struct wfd_rtsp_decoder *dec, char ch)
 		++dec->buflen;
 		break;
 	default:
-		if (dec->last_chr == '\r' || dec->last_chr == '\n') {
+		if (rtsp_is_line_end(dec->last_chr, ch)) {
 			/* Last line is complete and this is no whitespace,
 			 * thus it's not a continuation line.
 			 * Finish the line. */
@@ -1062,9 +2657,42 @@ static int decoder_feed_char_header_quote(struct wfd_rtsp_decoder *dec, char ch)
 	return 0;
 }
 
+static int decoder_finish_body(struct wfd_rtsp_decoder *dec)
+{
+	int r;
+
+	/* full body received, submit it and go to STATE_NEW */
+
+	dec->cur->entity[dec->body_size] = 0;
+	dec->cur->msg.entity.value = dec->cur->entity;
+	dec->cur->msg.entity.size = dec->body_size;
+	decoder_release_entity(dec);
+	r = decoder_submit(dec);
+
+	dec->state = STATE_NEW;
+	return r;
+}
+
+/* stream or discard part of an entity without buffering it */
+static int decoder_pass_body(struct wfd_rtsp_decoder *dec,
+			     const void *p,
+			     size_t len)
+{
+	int r = 0;
+
+	if (dec->body_mode == WFD_RTSP_DECODER_BODY_STREAM)
+		r = decoder_submit_chunk(dec, p, len);
+	else
+		dec->remaining_body -= len;
+
+	if (!dec->remaining_body)
+		dec->state = STATE_NEW;
+
+	return r;
+}
+
 static int decoder_feed_char_body(struct wfd_rtsp_decoder *dec, char ch)
 {
-	char *line;
 	int r;
 
 	/* If remaining_body was already 0, the message had no body. Note that
@@ -1076,31 +2704,24 @@ static int decoder_feed_char_body(struct wfd_rtsp_decoder *dec, char ch)
 		return decoder_feed_char_new(dec, ch);
 	}
 
-	/* *any* character is allowed as body */
-	++dec->buflen;
-
-	if (!--dec->remaining_body) {
-		/* full body received, copy it and go to STATE_NEW */
-
-		line = malloc(dec->buflen + 1);
-		if (!line)
-			return llog_ENOMEM(dec);
-
-		shl_ring_copy(&dec->buf, line, dec->buflen);
-		line[dec->buflen] = 0;
-
-		dec->msg.entity.value = line;
-		dec->msg.entity.size = dec->buflen;
-		r = decoder_submit(dec);
-
-		dec->state = STATE_NEW;
-		shl_ring_pull(&dec->buf, dec->buflen);
-		dec->buflen = 0;
+	if (dec->body_mode != WFD_RTSP_DECODER_BODY_BUFFER) {
+		/* @ch is the only content of the ring-buffer */
+		shl_ring_pull(&dec->buf, 1);
+		return decoder_pass_body(dec, &ch, 1);
+	}
 
-		if (r < 0)
-			return r;
+	/* *any* character is allowed as body */
+	shl_ring_pull(&dec->buf, 1);
+	r = decoder_fill_entity(dec, &ch, 1);
+	if (r < 0) {
+		/* @ch is consumed, the rest may still be discarded */
+		--dec->remaining_body;
+		return r;
 	}
 
+	if (!dec->remaining_body)
+		return decoder_finish_body(dec);
+
 	return 0;
 }
 
@@ -1148,43 +2769,319 @@ static int decoder_feed_char_data_head(struct wfd_rtsp_decoder *dec, char ch)
 		dec->data_channel = buf[0];
 		dec->data_size = (((uint16_t)buf[1]) << 8) | (uint16_t)buf[2];
 		dec->state = STATE_DATA_BODY;
+
+		/* empty frames are finished right away */
+		if (!dec->data_size) {
+			dec->state = STATE_NEW;
+			return decoder_submit_data(dec, (const uint8_t*)"");
+		}
 	}
 
 	return 0;
 }
 
-static int decoder_feed_char_data_body(struct wfd_rtsp_decoder *dec, char ch)
+/*
+ * Bulk Handlers
+ * Bodies and interleaved data frames have a known length, so once we're in
+ * STATE_BODY or STATE_DATA_BODY, we can consume everything up to that length
+ * in one step. Data frames that are contiguous in the input are delivered
+ * right from the input-buffer, only partial frames are spilled into the
+ * ring-buffer. Streamed bodies are always delivered from the input-buffer.
+ */
+
+static ssize_t decoder_feed_body(struct wfd_rtsp_decoder *dec,
+				 const char *buf,
+				 size_t len)
 {
-	uint8_t *buf;
+	size_t l;
 	int r;
 
-	/* Read @dec->data_size bytes of raw data. */
+	l = shl_min(dec->remaining_body, len);
 
-	if (++dec->buflen >= dec->data_size) {
-		buf = malloc(dec->data_size + 1);
-		if (!buf)
-			return llog_ENOMEM(dec);
+	if (dec->body_mode != WFD_RTSP_DECODER_BODY_BUFFER) {
+		r = decoder_pass_body(dec, buf, l);
+		return r < 0 ? r : (ssize_t)l;
+	}
 
-		/* Not really needed, but in case it's actually a text-payload
-		 * make sure it's 0-terminated to work around client bugs. */
-		buf[dec->data_size] = 0;
+	r = decoder_fill_entity(dec, buf, l);
+	if (r < 0)
+		return r;
 
-		shl_ring_copy(&dec->buf, buf, dec->data_size);
+	if (!dec->remaining_body) {
+		r = decoder_finish_body(dec);
+		if (r < 0)
+			return r;
+	}
 
-		r = decoder_submit_data(dec, buf);
-		free(buf);
+	return l;
+}
 
-		dec->state = STATE_NEW;
-		shl_ring_pull(&dec->buf, dec->buflen);
-		dec->buflen = 0;
+static ssize_t decoder_feed_data_body(struct wfd_rtsp_decoder *dec,
+				      const char *buf,
+				      size_t len)
+{
+	size_t l;
+	int r;
+
+	l = shl_min(dec->data_size - dec->buflen, len);
 
+	if (!dec->buflen && l == dec->data_size) {
+		/* whole frame is part of the input; bypass the ring-buffer */
+		r = decoder_submit_data(dec, (const uint8_t*)buf);
+	} else {
+		r = decoder_push(dec, buf, l);
 		if (r < 0)
 			return r;
+
+		dec->buflen += l;
+		if (dec->buflen < dec->data_size)
+			return l;
+
+		r = decoder_submit_data(dec, NULL);
+		shl_ring_pull(&dec->buf, dec->buflen);
+		dec->buflen = 0;
+	}
+
+	dec->state = STATE_NEW;
+	return r < 0 ? r : (ssize_t)l;
+}
+
+/*
+ * Resynchronization
+ * With WFD_RTSP_DECODER_F_RESYNC, errors in the input drop the current message
+ * instead of killing the decoder. We then skip input until something looks
+ * like the start of a message or data frame. Candidates are found by scanning
+ * for their first bytes with a scan-table, so garbage is skipped in blocks.
+ * A candidate cut off by the end of the input is accepted, as we cannot look
+ * ahead. Instead, the ID-line of the first message after a resync is verified
+ * and if it's bogus, we simply resync again.
+ */
+
+static struct shl_scan_table resync_start;
+
+__attribute__((__constructor__))
+static void resync_init(void)
+{
+	const char *first = "$Rr";
+	unsigned int i;
+
+	for (i = 0; first[i]; ++i)
+		shl_scan_table_add(&resync_start, first[i]);
+
+	for (i = 0; i < WFD_RTSP_METHOD_CNT; ++i) {
+		if (!method_names[i].name)
+			continue;
+
+		shl_scan_table_add(&resync_start, method_names[i].name[0]);
+		shl_scan_table_add(&resync_start,
+				   tolower(method_names[i].name[0]));
+	}
+}
+
+static bool resync_has_prefix(const char *buf,
+			      size_t len,
+			      const char *prefix,
+			      size_t plen)
+{
+	return !strncasecmp(buf, prefix, shl_min(len, plen));
+}
+
+static bool resync_is_start(const char *buf, size_t len)
+{
+	unsigned int i;
+	size_t l;
+
+	if (*buf == '$' || resync_has_prefix(buf, len, "RTSP/", 5))
+		return true;
+
+	for (i = 0; i < WFD_RTSP_METHOD_CNT; ++i) {
+		if (!method_names[i].name)
+			continue;
+
+		l = method_names[i].len;
+		if (resync_has_prefix(buf, len, method_names[i].name, l) &&
+		    (len <= l || buf[l] == ' '))
+			return true;
+	}
+
+	return false;
+}
+
+static ssize_t decoder_feed_resync(struct wfd_rtsp_decoder *dec,
+				   const char *buf,
+				   size_t len)
+{
+	struct wfd_rtsp_decoder_event ev = { };
+	size_t l = 0;
+	int r;
+
+	for (;;) {
+		l += shl_scan_table_any(&resync_start, &buf[l], len - l);
+		if (l >= len || resync_is_start(&buf[l], len - l))
+			break;
+
+		++l;
+	}
+
+	/* the candidate itself is parsed by the state-machine */
+	if (l < len)
+		dec->state = STATE_NEW;
+	if (!l)
+		return 0;
+
+	ev.type = WFD_RTSP_DECODER_ERROR;
+	ev.error.reason = WFD_RTSP_DECODER_E_SKIPPED;
+	ev.error.data = (void*)buf;
+	ev.error.length = l;
+	r = decoder_call(dec, &ev);
+
+	return r < 0 ? r : (ssize_t)l;
+}
+
+/*
+ * Errors raised once the header is complete, like an entity exceeding its
+ * limit, leave the framing intact. The entity length is known, so its
+ * remaining bytes are skipped instead of being scanned for a new message.
+ */
+static bool decoder_in_body(struct wfd_rtsp_decoder *dec)
+{
+	return (dec->state == STATE_BODY || dec->state == STATE_HEADER_NL) &&
+	       dec->remaining_body;
+}
+
+/*
+ * Report an error of the current message and, if requested, drop it and start
+ * resynchronizing, or discard its entity if the header was complete.
+ * Allocation failures and callback errors are passed on unchanged, everything
+ * else is reported via WFD_RTSP_DECODER_ERROR.
+ */
+static int decoder_fail(struct wfd_rtsp_decoder *dec, int err)
+{
+	struct wfd_rtsp_decoder_event ev = { };
+	int r;
+
+	if (err == -ENOMEM || dec->failed_cb)
+		return err;
+
+	ev.type = WFD_RTSP_DECODER_ERROR;
+	ev.error.reason = dec->error;
+	if (dec->buflen) {
+		ev.error.data = shl_arena_alloc(&dec->cur->arena, dec->buflen);
+		if (!ev.error.data)
+			return llog_ENOMEM(dec);
+
+		ev.error.length = shl_ring_copy(&dec->buf, ev.error.data,
+						dec->buflen);
+	}
+
+	r = decoder_call(dec, &ev);
+	if (r < 0)
+		return r;
+	if (!(dec->flags & WFD_RTSP_DECODER_F_RESYNC))
+		return err;
+
+	r = decoder_clear_msg(dec);
+	if (r < 0)
+		return r;
+
+	if (decoder_in_body(dec)) {
+		llog_debug(dec, "RTSP decoder discards entity after error %d",
+			   err);
+
+		dec->body_mode = WFD_RTSP_DECODER_BODY_DISCARD;
+		decoder_release_entity(dec);
+		dec->error = WFD_RTSP_DECODER_E_SYNTAX;
+		return 0;
 	}
 
+	llog_debug(dec, "RTSP decoder resyncs after error %d", err);
+
+	shl_ring_flush(&dec->buf);
+	dec->buflen = 0;
+	dec->last_chr = 0;
+	dec->state = STATE_RESYNC;
+	dec->remaining_body = 0;
+	dec->body_mode = WFD_RTSP_DECODER_BODY_BUFFER;
+	dec->body_size = 0;
+	decoder_release_entity(dec);
+	dec->data_size = 0;
+	dec->error = WFD_RTSP_DECODER_E_SYNTAX;
+	dec->quoted = false;
+	dec->resyncing = true;
+
 	return 0;
 }
 
+/*
+ * Span Scanner
+ * Most bytes of a header-line are of no interest to the state-machine. They
+ * just increment dec->buflen and get remembered as dec->last_chr. Instead of
+ * feeding them one-by-one, we search for the next byte that might change the
+ * state and skip everything in front of it in one step. Only that delimiter is
+ * then passed to the per-char state-machine.
+ * The search itself is done by the shl-scanner, which classifies whole blocks
+ * of input via SIMD if the CPU supports it. Bodies and data frames are handed
+ * to the bulk handlers.
+ */
+
+/* shared with the framing scanner, see rtsp_internal.h */
+const struct shl_scan rtsp_scan_lws = SHL_SCAN_INIT(" \t\r\n");
+const struct shl_scan rtsp_scan_header = SHL_SCAN_INIT("\r\n\"");
+const struct shl_scan rtsp_scan_quote = SHL_SCAN_INIT("\"\\");
+
+static ssize_t decoder_feed_span(struct wfd_rtsp_decoder *dec,
+				 const char *buf,
+				 size_t len)
+{
+	size_t l;
+	int r;
+
+	switch (dec->state) {
+	case STATE_NEW:
+		/* leading LWS is ignored */
+		l = shl_scan_none(&rtsp_scan_lws, buf, len);
+		break;
+	case STATE_HEADER:
+		/* first char after a new-line might finish the line */
+		if (rtsp_is_line_break(dec->last_chr))
+			return 0;
+
+		l = shl_scan_any(&rtsp_scan_header, buf, len);
+		break;
+	case STATE_HEADER_QUOTE:
+		/* escaped characters are handled by the state-machine */
+		if (dec->last_chr == '\\' && !dec->quoted)
+			return 0;
+
+		l = shl_scan_any(&rtsp_scan_quote, buf, len);
+		if (l > 0)
+			dec->quoted = false;
+		break;
+	case STATE_BODY:
+		/* empty bodies are forwarded by the state-machine */
+		if (!dec->remaining_body)
+			return 0;
+
+		return decoder_feed_body(dec, buf, len);
+	case STATE_DATA_BODY:
+		return decoder_feed_data_body(dec, buf, len);
+	case STATE_RESYNC:
+		return decoder_feed_resync(dec, buf, len);
+	default:
+		return 0;
+	}
+
+	if (!l)
+		return 0;
+
+	r = decoder_push(dec, buf, l);
+	if (r < 0)
+		return r;
+
+	dec->buflen += l;
+	return l;
+}
+
 static int decoder_feed_char(struct wfd_rtsp_decoder *dec, char ch)
 {
 	int r = 0;
@@ -1208,9 +3105,6 @@ static int decoder_feed_char(struct wfd_rtsp_decoder *dec, char ch)
 	case STATE_DATA_HEAD:
 		r = decoder_feed_char_data_head(dec, ch);
 		break;
-	case STATE_DATA_BODY:
-		r = decoder_feed_char_data_body(dec, ch);
-		break;
 	}
 
 	return r;
@@ -1221,8 +3115,11 @@ int wfd_rtsp_decoder_feed(struct wfd_rtsp_decoder *dec,
 		      const void *buf,
 		      size_t len)
 {
-	char ch;
+	const char *src = buf;
+	bool rescan = false;
+	ssize_t l;
 	size_t i;
+	char ch;
 	int r;
 
 	if (!dec)
@@ -1233,26 +3130,52 @@ int wfd_rtsp_decoder_feed(struct wfd_rtsp_decoder *dec,
 		return 0;
 	if (!buf)
 		return llog_EINVAL(dec);
+	if (decoder_queue_full(dec))
+		return -EAGAIN;
+	if (!dec->cur && decoder_clear_msg(dec) < 0)
+		return -ENOMEM;
 
-	/* We keep dec->buflen as cache for the current parsed-buffer size. We
-	 * need to push the whole input-buffer into our parser-buffer and go
-	 * through it one-by-one. The parser increments dec->buflen for each of
-	 * these and once we're done, we verify our state is consistent. */
+	/* We keep dec->buflen as cache for the current parsed-buffer size.
+	 * Input is only pushed into the parser-buffer as it is consumed, so
+	 * anything that is not completed by this input is kept for the next
+	 * call. Runs of uninteresting bytes, bodies and data frames are
+	 * consumed in one step via the span-scanner, only delimiters actually
+	 * go through the per-char state-machine. The parser increments
+	 * dec->buflen for each consumed byte and once we're done, we verify
+	 * our state is consistent. */
+
+	for (i = 0; i < len; ) {
+		l = decoder_feed_span(dec, &src[i], len - i);
+		if (l > 0) {
+			i += l;
+			dec->last_chr = src[i - 1];
+			continue;
+		} else if (!l) {
+			ch = src[i++];
+			r = decoder_push(dec, &ch, 1);
+			if (r < 0)
+				goto fail;
 
-	dec->buflen = shl_ring_get_size(&dec->buf);
-	r = shl_ring_push(&dec->buf, buf, len);
-	if (r < 0) {
-		llog_vERR(dec, r);
-		goto error;
-	}
+			r = decoder_feed_char(dec, ch);
+			if (r >= 0) {
+				dec->last_chr = ch;
+				continue;
+			}
 
-	for (i = 0; i < len; ++i) {
-		ch = ((const char*)buf)[i];
-		r = decoder_feed_char(dec, ch);
+			/* @ch isn't part of the buffered line yet and might
+			 * start the next message, so rescan it on resync */
+			rescan = dec->buflen > 0;
+		} else {
+			r = l;
+		}
+
+fail:
+		r = decoder_fail(dec, r);
 		if (r < 0)
 			goto error;
-
-		dec->last_chr = ch;
+		if (rescan)
+			--i;
+		rescan = false;
 	}
 
 	/* check for internal parser inconsistencies; should not happen! */
@@ -1268,3 +3191,49 @@ error:
 	dec->dead = true;
 	return r;
 }
+
+_shl_public_
+int wfd_rtsp_decoder_next(struct wfd_rtsp_decoder *dec,
+			  struct wfd_rtsp_decoder_event *ev)
+{
+	ssize_t r;
+
+	r = wfd_rtsp_decoder_next_batch(dec, ev, 1);
+	return r < 0 ? r : 0;
+}
+
+_shl_public_
+ssize_t wfd_rtsp_decoder_next_batch(struct wfd_rtsp_decoder *dec,
+				    struct wfd_rtsp_decoder_event *evs,
+				    size_t max)
+{
+	struct decoder_slot *slot, **last;
+	size_t n;
+
+	if (!dec)
+		return -EINVAL;
+	if (dec->event_fn || !evs)
+		return llog_EINVAL(dec);
+
+	/* events returned by the previous call are no longer valid */
+	slot_list_recycle(dec, &dec->delivered);
+
+	if (!dec->queue_first)
+		return -EAGAIN;
+
+	last = &dec->delivered;
+	for (n = 0; n < max && (slot = dec->queue_first); ++n) {
+		dec->queue_first = slot->next;
+		slot->next = NULL;
+		*last = slot;
+		last = &slot->next;
+
+		evs[n] = slot->ev;
+	}
+
+	if (!dec->queue_first)
+		dec->queue_last = NULL;
+	dec->n_queued -= n;
+
+	return n;
+}
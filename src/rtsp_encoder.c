@@ -0,0 +1,855 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "libwfd.h"
+#include "shl_llog.h"
+#include "shl_macro.h"
+#include "shl_util.h"
+
+/*
+ * RTSP Encoder
+ * The encoder assembles outgoing messages and data frames as a list of pieces
+ * which is handed to the caller as iovec array, ready for writev() or
+ * sendmsg(). Entities, payloads, header values and the static name tables
+ * are referenced, not copied. Only pieces shorter than ENC_INLINE bytes are
+ * copied into a scratch buffer, together with everything that has to be
+ * formatted. Adjacent scratch pieces are merged, so a header line with a
+ * referenced value costs three vectors and short lines just one.
+ * Pieces store scratch offsets rather than pointers, as the scratch buffer may
+ * move while it grows. All buffers are kept across resets, so once they've
+ * grown to the size of a typical batch, encoding doesn't allocate anymore.
+ */
+
+#define ENC_INLINE 16
+
+struct enc_piece {
+	const char *base;	/* NULL for pieces in the scratch buffer */
+	size_t off;
+	size_t len;
+};
+
+struct wfd_rtsp_encoder {
+	llog_submit_t llog;
+	void *llog_data;
+
+	char *scratch;
+	size_t scratch_size;
+	size_t scratch_len;
+
+	struct enc_piece *pieces;
+	size_t pieces_size;
+	size_t n_pieces;
+	size_t first;		/* first piece that wasn't consumed, yet */
+	size_t done;		/* end of the last finished frame */
+	size_t size;		/* bytes of finished frames not consumed */
+
+	struct iovec *vec;
+	size_t vec_size;
+
+	size_t frame;		/* first piece of the frame being built */
+
+	bool in_msg : 1;
+};
+
+/* values are mostly too short for the scanners to pay off */
+static bool enc_has_nl(const char *s, size_t len)
+{
+	return len && (memchr(s, '\r', len) || memchr(s, '\n', len));
+}
+
+/*
+ * Pieces
+ * Each public builder saves the current end of the piece list and scratch
+ * buffer and restores it on failure, so a failed call leaves no partial
+ * output behind. Scratch pieces are only merged within a frame, so the
+ * length of the last piece is all that has to be saved besides that.
+ */
+
+struct enc_mark {
+	size_t n_pieces;
+	size_t scratch_len;
+	size_t last_len;
+};
+
+static void enc_mark(struct wfd_rtsp_encoder *enc, struct enc_mark *m)
+{
+	m->n_pieces = enc->n_pieces;
+	m->scratch_len = enc->scratch_len;
+	m->last_len = enc->n_pieces ? enc->pieces[enc->n_pieces - 1].len : 0;
+}
+
+static int enc_rollback(struct wfd_rtsp_encoder *enc,
+			const struct enc_mark *m,
+			int err)
+{
+	enc->n_pieces = m->n_pieces;
+	enc->scratch_len = m->scratch_len;
+	if (enc->n_pieces)
+		enc->pieces[enc->n_pieces - 1].len = m->last_len;
+	return err;
+}
+
+static struct enc_piece *enc_add_piece(struct wfd_rtsp_encoder *enc)
+{
+	if (!shl_greedy_realloc((void**)&enc->pieces, &enc->pieces_size,
+				(enc->n_pieces + 1) * sizeof(*enc->pieces)))
+		return NULL;
+
+	return &enc->pieces[enc->n_pieces++];
+}
+
+/* return @len bytes of scratch space, to be committed via enc_commit() */
+static char *enc_reserve(struct wfd_rtsp_encoder *enc, size_t len)
+{
+	if (!shl_greedy_realloc((void**)&enc->scratch, &enc->scratch_size,
+				enc->scratch_len + len))
+		return NULL;
+
+	return &enc->scratch[enc->scratch_len];
+}
+
+static int enc_commit(struct wfd_rtsp_encoder *enc, size_t len)
+{
+	struct enc_piece *p;
+
+	if (!len)
+		return 0;
+
+	/* extend the last piece of this frame if it ends right here */
+	p = enc->n_pieces > enc->frame ? &enc->pieces[enc->n_pieces - 1] : NULL;
+	if (!p || p->base || p->off + p->len != enc->scratch_len) {
+		p = enc_add_piece(enc);
+		if (!p)
+			return llog_ENOMEM(enc);
+
+		p->base = NULL;
+		p->off = enc->scratch_len;
+		p->len = 0;
+	}
+
+	p->len += len;
+	enc->scratch_len += len;
+	return 0;
+}
+
+static int enc_copy(struct wfd_rtsp_encoder *enc, const void *s, size_t len)
+{
+	char *d;
+
+	d = enc_reserve(enc, len);
+	if (!d)
+		return llog_ENOMEM(enc);
+
+	memcpy(d, s, len);
+	return enc_commit(enc, len);
+}
+
+static int enc_ref(struct wfd_rtsp_encoder *enc, const void *s, size_t len)
+{
+	struct enc_piece *p;
+
+	if (len < ENC_INLINE)
+		return enc_copy(enc, s, len);
+
+	p = enc_add_piece(enc);
+	if (!p)
+		return llog_ENOMEM(enc);
+
+	p->base = s;
+	p->off = 0;
+	p->len = len;
+	return 0;
+}
+
+#define enc_str(_enc, _s) enc_copy((_enc), (_s), sizeof(_s) - 1)
+
+static int enc_num(struct wfd_rtsp_encoder *enc, unsigned long num)
+{
+	char buf[sizeof(num) * 3], *p;
+
+	p = &buf[sizeof(buf)];
+	do {
+		*--p = '0' + num % 10;
+		num /= 10;
+	} while (num);
+
+	return enc_copy(enc, p, &buf[sizeof(buf)] - p);
+}
+
+static void enc_start(struct wfd_rtsp_encoder *enc)
+{
+	enc->frame = enc->n_pieces;
+}
+
+static void enc_finish(struct wfd_rtsp_encoder *enc)
+{
+	size_t i;
+
+	for (i = enc->frame; i < enc->n_pieces; ++i)
+		enc->size += enc->pieces[i].len;
+
+	enc->done = enc->n_pieces;
+	enc->frame = enc->n_pieces;
+}
+
+/*
+ * Messages
+ */
+
+_shl_public_
+int wfd_rtsp_encoder_request(struct wfd_rtsp_encoder *enc,
+			     unsigned int method,
+			     const char *uri)
+{
+	struct enc_mark m;
+	const char *name;
+	size_t len;
+	int r;
+
+	if (!enc)
+		return -EINVAL;
+	if (enc->in_msg)
+		return -EBUSY;
+
+	name = wfd_rtsp_method_get_name(method);
+	if (!name || !uri)
+		return llog_EINVAL(enc);
+
+	len = strcspn(uri, " \t\r\n");
+	if (!len || uri[len])
+		return llog_EINVAL(enc);
+
+	enc_mark(enc, &m);
+	enc_start(enc);
+
+	if ((r = enc_ref(enc, name, strlen(name))) < 0 ||
+	    (r = enc_str(enc, " ")) < 0 ||
+	    (r = enc_ref(enc, uri, len)) < 0 ||
+	    (r = enc_str(enc, " RTSP/1.0\r\n")) < 0)
+		return enc_rollback(enc, &m, r);
+
+	enc->in_msg = true;
+	return 0;
+}
+
+_shl_public_
+int wfd_rtsp_encoder_response(struct wfd_rtsp_encoder *enc,
+			      unsigned int status,
+			      const char *phrase)
+{
+	struct enc_mark m;
+	size_t len;
+	int r;
+
+	if (!enc)
+		return -EINVAL;
+	if (enc->in_msg)
+		return -EBUSY;
+
+	if (!phrase)
+		phrase = wfd_rtsp_status_get_description(status);
+	if (!phrase || status < 100 || status > 999)
+		return llog_EINVAL(enc);
+
+	len = strlen(phrase);
+	if (enc_has_nl(phrase, len))
+		return llog_EINVAL(enc);
+
+	enc_mark(enc, &m);
+	enc_start(enc);
+
+	if ((r = enc_str(enc, "RTSP/1.0 ")) < 0 ||
+	    (r = enc_num(enc, status)) < 0 ||
+	    (r = enc_str(enc, " ")) < 0 ||
+	    (r = enc_ref(enc, phrase, len)) < 0 ||
+	    (r = enc_str(enc, "\r\n")) < 0)
+		return enc_rollback(enc, &m, r);
+
+	enc->in_msg = true;
+	return 0;
+}
+
+static int enc_header_name(struct wfd_rtsp_encoder *enc, unsigned int type)
+{
+	const char *name;
+	int r;
+
+	/* Content-Length is added by wfd_rtsp_encoder_end() */
+	name = wfd_rtsp_header_get_name(type);
+	if (!name || type == WFD_RTSP_HEADER_CONTENT_LENGTH)
+		return llog_EINVAL(enc);
+
+	r = enc_ref(enc, name, strlen(name));
+	if (r < 0)
+		return r;
+
+	return enc_str(enc, ": ");
+}
+
+_shl_public_
+int wfd_rtsp_encoder_header_n(struct wfd_rtsp_encoder *enc,
+			      unsigned int type,
+			      const char *value,
+			      size_t len)
+{
+	struct enc_mark m;
+	int r;
+
+	if (!enc)
+		return -EINVAL;
+	if (!enc->in_msg || (!value && len))
+		return llog_EINVAL(enc);
+	if (enc_has_nl(value, len))
+		return llog_EINVAL(enc);
+
+	enc_mark(enc, &m);
+
+	if ((r = enc_header_name(enc, type)) < 0 ||
+	    (r = enc_ref(enc, value, len)) < 0 ||
+	    (r = enc_str(enc, "\r\n")) < 0)
+		return enc_rollback(enc, &m, r);
+
+	return 0;
+}
+
+_shl_public_
+int wfd_rtsp_encoder_header(struct wfd_rtsp_encoder *enc,
+			    unsigned int type,
+			    const char *value)
+{
+	return wfd_rtsp_encoder_header_n(enc, type, value,
+					 value ? strlen(value) : 0);
+}
+
+_shl_public_
+int wfd_rtsp_encoder_header_u(struct wfd_rtsp_encoder *enc,
+			      unsigned int type,
+			      unsigned long value)
+{
+	struct enc_mark m;
+	int r;
+
+	if (!enc)
+		return -EINVAL;
+	if (!enc->in_msg)
+		return llog_EINVAL(enc);
+
+	enc_mark(enc, &m);
+
+	if ((r = enc_header_name(enc, type)) < 0 ||
+	    (r = enc_num(enc, value)) < 0 ||
+	    (r = enc_str(enc, "\r\n")) < 0)
+		return enc_rollback(enc, &m, r);
+
+	return 0;
+}
+
+_shl_public_
+int wfd_rtsp_encoder_header_fmt(struct wfd_rtsp_encoder *enc,
+				unsigned int type,
+				const char *format,
+				...)
+{
+	struct enc_mark m;
+	va_list args;
+	size_t avail;
+	char *d;
+	int r, l;
+
+	if (!enc)
+		return -EINVAL;
+	if (!enc->in_msg || !format)
+		return llog_EINVAL(enc);
+
+	enc_mark(enc, &m);
+
+	r = enc_header_name(enc, type);
+	if (r < 0)
+		return enc_rollback(enc, &m, r);
+
+	/* format into the free scratch space, grow and retry if too small */
+	avail = shl_max_t(size_t, ENC_INLINE,
+			  enc->scratch_size - enc->scratch_len);
+	d = enc_reserve(enc, avail);
+	if (!d)
+		return enc_rollback(enc, &m, llog_ENOMEM(enc));
+
+	va_start(args, format);
+	l = vsnprintf(d, avail, format, args);
+	va_end(args);
+
+	if (l >= 0 && (size_t)l >= avail) {
+		d = enc_reserve(enc, l + 1);
+		if (!d)
+			return enc_rollback(enc, &m, llog_ENOMEM(enc));
+
+		va_start(args, format);
+		l = vsnprintf(d, l + 1, format, args);
+		va_end(args);
+	}
+
+	if (l < 0)
+		return enc_rollback(enc, &m, llog_EINVAL(enc));
+	if (enc_has_nl(d, l))
+		return enc_rollback(enc, &m, llog_EINVAL(enc));
+
+	if ((r = enc_commit(enc, l)) < 0 ||
+	    (r = enc_str(enc, "\r\n")) < 0)
+		return enc_rollback(enc, &m, r);
+
+	return 0;
+}
+
+/* add Content-Length, the empty line and the entity */
+static int enc_tail(struct wfd_rtsp_encoder *enc,
+		    const void *entity,
+		    size_t size)
+{
+	int r;
+
+	if (!size)
+		return enc_str(enc, "\r\n");
+
+	if ((r = enc_str(enc, "Content-Length: ")) < 0 ||
+	    (r = enc_num(enc, size)) < 0 ||
+	    (r = enc_str(enc, "\r\n\r\n")) < 0)
+		return r;
+
+	return enc_ref(enc, entity, size);
+}
+
+_shl_public_
+int wfd_rtsp_encoder_end(struct wfd_rtsp_encoder *enc,
+			 const void *entity,
+			 size_t size)
+{
+	struct enc_mark m;
+	int r;
+
+	if (!enc)
+		return -EINVAL;
+	if (!enc->in_msg || (!entity && size))
+		return llog_EINVAL(enc);
+
+	enc_mark(enc, &m);
+
+	r = enc_tail(enc, entity, size);
+	if (r < 0)
+		return enc_rollback(enc, &m, r);
+
+	enc->in_msg = false;
+	enc_finish(enc);
+	return 0;
+}
+
+/*
+ * Interleaved Data
+ * Data frames are a 4 byte header, the '$' sign, channel and 16bit payload
+ * length in network byte order, followed by the referenced payload.
+ */
+
+_shl_public_
+int wfd_rtsp_encoder_data(struct wfd_rtsp_encoder *enc,
+			  uint8_t channel,
+			  const void *data,
+			  size_t size)
+{
+	struct enc_mark m;
+	char head[4];
+	int r;
+
+	if (!enc)
+		return -EINVAL;
+	if (enc->in_msg)
+		return -EBUSY;
+	if (!data && size)
+		return llog_EINVAL(enc);
+	if (size > 0xffff)
+		return -EMSGSIZE;
+
+	head[0] = '$';
+	head[1] = channel;
+	head[2] = size >> 8;
+	head[3] = size & 0xff;
+
+	enc_mark(enc, &m);
+	enc_start(enc);
+
+	if ((r = enc_copy(enc, head, sizeof(head))) < 0 ||
+	    (r = enc_ref(enc, data, size)) < 0)
+		return enc_rollback(enc, &m, r);
+
+	enc_finish(enc);
+	return 0;
+}
+
+/*
+ * Response Templates
+ * Most responses only differ in CSeq and Session. A template stores the
+ * serialized status-line and header lines once, with the offsets where the
+ * values of its variable fields go. Encoding a template references the
+ * static text between those offsets and formats or references the values in
+ * between, so a keepalive reply costs a number format and a handful of
+ * vectors. Templates are never modified once built, so they can be shared
+ * between encoders.
+ */
+
+struct wfd_rtsp_template {
+	char *text;
+	size_t text_size;
+	size_t len;
+
+	size_t *fields;		/* offsets of the field values in @text */
+	size_t fields_size;
+	size_t n_fields;
+};
+
+static int tpl_append(struct wfd_rtsp_template *tpl,
+		      const char *s,
+		      size_t len)
+{
+	if (!shl_greedy_realloc((void**)&tpl->text, &tpl->text_size,
+				tpl->len + len))
+		return -ENOMEM;
+
+	memcpy(&tpl->text[tpl->len], s, len);
+	tpl->len += len;
+	return 0;
+}
+
+#define tpl_str(_tpl, _s) tpl_append((_tpl), (_s), sizeof(_s) - 1)
+
+static int tpl_header(struct wfd_rtsp_template *tpl, unsigned int type)
+{
+	const char *name;
+	int r;
+
+	name = wfd_rtsp_header_get_name(type);
+	if (!name || type == WFD_RTSP_HEADER_CONTENT_LENGTH)
+		return -EINVAL;
+
+	r = tpl_append(tpl, name, strlen(name));
+	if (r < 0)
+		return r;
+
+	return tpl_str(tpl, ": ");
+}
+
+_shl_public_
+int wfd_rtsp_template_new(unsigned int status,
+			  const char *phrase,
+			  struct wfd_rtsp_template **out)
+{
+	struct wfd_rtsp_template *tpl;
+	char num[4];
+	int r;
+
+	if (!out)
+		return -EINVAL;
+
+	if (!phrase)
+		phrase = wfd_rtsp_status_get_description(status);
+	if (!phrase || status < 100 || status > 999 ||
+	    enc_has_nl(phrase, strlen(phrase)))
+		return -EINVAL;
+
+	tpl = calloc(1, sizeof(*tpl));
+	if (!tpl)
+		return -ENOMEM;
+
+	num[0] = '0' + status / 100;
+	num[1] = '0' + status / 10 % 10;
+	num[2] = '0' + status % 10;
+	num[3] = ' ';
+
+	if ((r = tpl_str(tpl, "RTSP/1.0 ")) < 0 ||
+	    (r = tpl_append(tpl, num, sizeof(num))) < 0 ||
+	    (r = tpl_append(tpl, phrase, strlen(phrase))) < 0 ||
+	    (r = tpl_str(tpl, "\r\n")) < 0) {
+		wfd_rtsp_template_free(tpl);
+		return r;
+	}
+
+	*out = tpl;
+	return 0;
+}
+
+_shl_public_
+void wfd_rtsp_template_free(struct wfd_rtsp_template *tpl)
+{
+	if (!tpl)
+		return;
+
+	free(tpl->fields);
+	free(tpl->text);
+	free(tpl);
+}
+
+_shl_public_
+int wfd_rtsp_template_add_header(struct wfd_rtsp_template *tpl,
+				 unsigned int type,
+				 const char *value)
+{
+	size_t len, old;
+	int r;
+
+	if (!tpl || !value)
+		return -EINVAL;
+
+	len = strlen(value);
+	if (enc_has_nl(value, len))
+		return -EINVAL;
+
+	old = tpl->len;
+	if ((r = tpl_header(tpl, type)) < 0 ||
+	    (r = tpl_append(tpl, value, len)) < 0 ||
+	    (r = tpl_str(tpl, "\r\n")) < 0) {
+		tpl->len = old;
+		return r;
+	}
+
+	return 0;
+}
+
+_shl_public_
+int wfd_rtsp_template_add_field(struct wfd_rtsp_template *tpl,
+				unsigned int type)
+{
+	size_t old;
+	int r;
+
+	if (!tpl)
+		return -EINVAL;
+
+	if (!shl_greedy_realloc((void**)&tpl->fields, &tpl->fields_size,
+				(tpl->n_fields + 1) * sizeof(*tpl->fields)))
+		return -ENOMEM;
+
+	old = tpl->len;
+	if ((r = tpl_header(tpl, type)) < 0 ||
+	    (r = tpl_str(tpl, "\r\n")) < 0) {
+		tpl->len = old;
+		return r;
+	}
+
+	/* the value goes right before the line-break */
+	tpl->fields[tpl->n_fields] = tpl->len - 2;
+	return tpl->n_fields++;
+}
+
+_shl_public_
+int wfd_rtsp_encoder_template(struct wfd_rtsp_encoder *enc,
+			      const struct wfd_rtsp_template *tpl,
+			      const struct wfd_rtsp_template_value *values,
+			      size_t n_values,
+			      const void *entity,
+			      size_t size)
+{
+	const struct wfd_rtsp_template_value *v;
+	struct enc_mark m;
+	size_t i, prev, len;
+	int r;
+
+	if (!enc)
+		return -EINVAL;
+	if (enc->in_msg)
+		return -EBUSY;
+	if (!tpl || n_values != tpl->n_fields || (!values && n_values) ||
+	    (!entity && size))
+		return llog_EINVAL(enc);
+
+	enc_mark(enc, &m);
+	enc_start(enc);
+
+	prev = 0;
+	for (i = 0; i < n_values; ++i) {
+		v = &values[i];
+
+		r = enc_ref(enc, &tpl->text[prev], tpl->fields[i] - prev);
+		if (r < 0)
+			return enc_rollback(enc, &m, r);
+
+		if (v->str) {
+			len = strlen(v->str);
+			if (enc_has_nl(v->str, len))
+				return enc_rollback(enc, &m, llog_EINVAL(enc));
+			r = enc_ref(enc, v->str, len);
+		} else {
+			r = enc_num(enc, v->num);
+		}
+		if (r < 0)
+			return enc_rollback(enc, &m, r);
+
+		prev = tpl->fields[i];
+	}
+
+	if ((r = enc_ref(enc, &tpl->text[prev], tpl->len - prev)) < 0 ||
+	    (r = enc_tail(enc, entity, size)) < 0)
+		return enc_rollback(enc, &m, r);
+
+	enc_finish(enc);
+	return 0;
+}
+
+/*
+ * Output
+ * Only finished frames are handed out. An open message stays pending until
+ * wfd_rtsp_encoder_end() is called.
+ */
+
+_shl_public_
+const struct iovec *wfd_rtsp_encoder_get_iov(struct wfd_rtsp_encoder *enc,
+					     size_t *n)
+{
+	const struct enc_piece *p;
+	size_t i, num;
+
+	if (!enc || !n)
+		return NULL;
+
+	num = enc->done - enc->first;
+	*n = num;
+	if (!num)
+		return NULL;
+
+	if (!shl_greedy_realloc((void**)&enc->vec, &enc->vec_size,
+				num * sizeof(*enc->vec))) {
+		*n = 0;
+		llog_vENOMEM(enc);
+		return NULL;
+	}
+
+	for (i = 0; i < num; ++i) {
+		p = &enc->pieces[enc->first + i];
+		if (p->base)
+			enc->vec[i].iov_base = (void*)(p->base + p->off);
+		else
+			enc->vec[i].iov_base = enc->scratch + p->off;
+		enc->vec[i].iov_len = p->len;
+	}
+
+	return enc->vec;
+}
+
+_shl_public_
+size_t wfd_rtsp_encoder_get_size(struct wfd_rtsp_encoder *enc)
+{
+	if (!enc)
+		return 0;
+
+	return enc->size;
+}
+
+_shl_public_
+void wfd_rtsp_encoder_consume(struct wfd_rtsp_encoder *enc, size_t len)
+{
+	struct enc_piece *p;
+	size_t l;
+
+	if (!enc)
+		return;
+
+	len = shl_min(len, enc->size);
+	enc->size -= len;
+
+	while (len) {
+		p = &enc->pieces[enc->first];
+		l = shl_min(len, p->len);
+		p->off += l;
+		p->len -= l;
+		len -= l;
+
+		if (!p->len)
+			++enc->first;
+	}
+
+	/* rewind once everything was sent */
+	if (enc->first == enc->done && !enc->in_msg) {
+		enc->first = 0;
+		enc->done = 0;
+		enc->frame = 0;
+		enc->n_pieces = 0;
+		enc->scratch_len = 0;
+	}
+}
+
+/*
+ * Encoder Objects
+ */
+
+_shl_public_
+int wfd_rtsp_encoder_new(wfd_rtsp_log_t log_fn,
+			 void *log_data,
+			 struct wfd_rtsp_encoder **out)
+{
+	struct wfd_rtsp_encoder *enc;
+
+	if (!out)
+		return llog_dEINVAL(log_fn, log_data);
+
+	enc = calloc(1, sizeof(*enc));
+	if (!enc)
+		return llog_dENOMEM(log_fn, log_data);
+
+	enc->llog = log_fn;
+	enc->llog_data = log_data;
+
+	*out = enc;
+	return 0;
+}
+
+_shl_public_
+void wfd_rtsp_encoder_free(struct wfd_rtsp_encoder *enc)
+{
+	if (!enc)
+		return;
+
+	free(enc->vec);
+	free(enc->pieces);
+	free(enc->scratch);
+	free(enc);
+}
+
+_shl_public_
+void wfd_rtsp_encoder_reset(struct wfd_rtsp_encoder *enc)
+{
+	if (!enc)
+		return;
+
+	enc->scratch_len = 0;
+	enc->n_pieces = 0;
+	enc->first = 0;
+	enc->done = 0;
+	enc->size = 0;
+	enc->frame = 0;
+	enc->in_msg = false;
+}
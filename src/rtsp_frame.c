@@ -0,0 +1,284 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libwfd.h"
+#include "rtsp_internal.h"
+#include "shl_macro.h"
+#include "shl_scan.h"
+
+/*
+ * RTSP Framing Scanner
+ * This finds the boundaries of complete messages and interleaved data frames
+ * in a buffer, without decoding them. Lines are split by the same rules and
+ * scan-sets as in the decoder state-machine (see rtsp_internal.h), so both
+ * agree on where a message ends. The only header that is looked at is
+ * Content-Length, and only its first value token. Those are found with the
+ * same token-iterator the decoder uses, so both read the same length.
+ * Nothing is copied or allocated, except for the rare tokens that need
+ * decoding.
+ */
+
+/* return token value; tokens that need decoding are copied into @buf, or into
+ * @mem if they might not fit */
+static const char *frame_get_token(const char *line,
+				   const struct wfd_rtsp_token *t,
+				   char *buf,
+				   size_t size,
+				   char **mem,
+				   size_t *len)
+{
+	if (!(t->flags & WFD_RTSP_TOKEN_ESCAPED)) {
+		*len = t->length;
+		return &line[t->offset];
+	}
+
+	if (t->length >= size) {
+		*mem = malloc(t->length + 1);
+		if (!*mem)
+			return NULL;
+		buf = *mem;
+	}
+
+	*len = wfd_rtsp_token_copy(line, t, buf);
+	return buf;
+}
+
+static int frame_parse_length(const char *line, size_t len, size_t *clen)
+{
+	struct wfd_rtsp_token_iter iter;
+	struct wfd_rtsp_token t;
+	char buf[32], *mem = NULL;
+	const char *v;
+	size_t vlen;
+	int r;
+
+	/* parse <name>, this is the same as in decoder_parse_header() */
+	wfd_rtsp_token_iter_init(&iter, line, len);
+	if (!wfd_rtsp_token_iter_next(&iter, &t))
+		return 0;
+
+	v = frame_get_token(line, &t, buf, sizeof(buf), &mem, &vlen);
+	if (!v)
+		return -ENOMEM;
+
+	r = wfd_rtsp_header_from_name_n(v, vlen);
+	free(mem);
+	mem = NULL;
+	if (r != WFD_RTSP_HEADER_CONTENT_LENGTH)
+		return 0;
+
+	/* parse ":", lines without it aren't Content-Length lines */
+	if (!wfd_rtsp_token_iter_next(&iter, &t))
+		return 0;
+	if (t.length != 1 || line[t.offset] != ':' ||
+	    (t.flags & WFD_RTSP_TOKEN_ESCAPED))
+		return 0;
+
+	/* first <value> token, empty if there is none */
+	if (!wfd_rtsp_token_iter_next(&iter, &t))
+		return rtsp_parse_content_length("", 0, clen);
+
+	v = frame_get_token(line, &t, buf, sizeof(buf), &mem, &vlen);
+	if (!v)
+		return -ENOMEM;
+
+	r = rtsp_parse_content_length(v, vlen, clen);
+	free(mem);
+	return r;
+}
+
+static int frame_finish_line(const char *buf,
+			     size_t start,
+			     size_t end,
+			     struct wfd_rtsp_frame *f,
+			     size_t *clen)
+{
+	/* the line includes its line-break and continuations */
+	if (f->id_length)
+		return frame_parse_length(&buf[start], end - start, clen);
+
+	while (end > start &&
+	       (rtsp_char_get_class(buf[end - 1]) & RTSP_CHAR_LWS))
+		--end;
+
+	f->id_length = end - start;
+	return 0;
+}
+
+/* returns 1 if the message at @start is complete, 0 if not, or <0 on error */
+static int frame_scan_msg(const char *buf,
+			  size_t len,
+			  size_t start,
+			  struct wfd_rtsp_frame *f)
+{
+	size_t i, line = start, clen = 0;
+	char c, last;
+	int r;
+
+	f->type = WFD_RTSP_FRAME_MSG;
+
+	/* the first char starts the ID-line, whatever it is */
+	last = buf[start];
+	i = start + 1;
+
+	while (i < len) {
+		c = buf[i];
+
+		if (rtsp_is_header_end(last, c)) {
+			/* empty line, the header is complete */
+			r = frame_finish_line(buf, line, i, f, &clen);
+			if (r < 0)
+				return r;
+
+			/* an empty \r line might be followed by \n; we cannot
+			 * tell where the entity starts before we know */
+			++i;
+			if (c == '\r') {
+				if (i < len && buf[i] == '\n')
+					++i;
+				else if (i >= len && clen)
+					return 0;
+			}
+
+			if (clen > len - i)
+				return 0;
+
+			f->head_length = i - start;
+			f->entity_length = clen;
+			f->length = f->head_length + clen;
+			return 1;
+		}
+
+		if (rtsp_is_line_end(last, c)) {
+			r = frame_finish_line(buf, line, i, f, &clen);
+			if (r < 0)
+				return r;
+
+			line = i;
+		}
+
+		/* line-breaks and whitespace are handled one by one */
+		if (rtsp_char_get_class(c) & RTSP_CHAR_LWS) {
+			last = c;
+			++i;
+			continue;
+		}
+
+		if (c == '"') {
+			for (++i; ; i += 2) {
+				i += shl_scan_any(&rtsp_scan_quote, &buf[i],
+						  len - i);
+				if (i >= len)
+					return 0;
+				if (buf[i] == '"')
+					break;
+
+				/* skip backslash and the escaped char */
+				if (len - i < 2)
+					return 0;
+			}
+
+			last = '"';
+			++i;
+			continue;
+		}
+
+		i += 1 + shl_scan_any(&rtsp_scan_header, &buf[i + 1],
+				      len - i - 1);
+		last = buf[i - 1];
+	}
+
+	return 0;
+}
+
+static int frame_scan_data(const char *buf,
+			   size_t len,
+			   size_t start,
+			   struct wfd_rtsp_frame *f)
+{
+	const uint8_t *p = (const uint8_t*)&buf[start];
+
+	/* '$', 1 byte channel-id and 2 byte data-length */
+	if (len - start < 4)
+		return 0;
+
+	f->type = WFD_RTSP_FRAME_DATA;
+	f->channel = p[1];
+	f->head_length = 4;
+	f->entity_length = (((uint16_t)p[2]) << 8) | (uint16_t)p[3];
+	f->length = f->head_length + f->entity_length;
+
+	return len - start >= f->length;
+}
+
+_shl_public_
+ssize_t wfd_rtsp_frame_scan(const void *buf,
+			    size_t len,
+			    struct wfd_rtsp_frame *frames,
+			    size_t max,
+			    size_t *consumed)
+{
+	const char *src = buf;
+	struct wfd_rtsp_frame f;
+	size_t pos = 0, done = 0, n = 0;
+	int r;
+
+	if (!buf && len)
+		return -EINVAL;
+
+	while (n < max) {
+		/* leading LWS is ignored, just like the decoder does */
+		pos += shl_scan_none(&rtsp_scan_lws, &src[pos], len - pos);
+		if (pos >= len)
+			break;
+
+		shl_zero(f);
+		f.offset = pos;
+
+		if (src[pos] == '$')
+			r = frame_scan_data(src, len, pos, &f);
+		else
+			r = frame_scan_msg(src, len, pos, &f);
+
+		if (r < 0 && !n)
+			return r;
+		else if (r <= 0)
+			break;
+
+		if (frames)
+			frames[n] = f;
+		++n;
+		pos = done = f.offset + f.length;
+	}
+
+	if (consumed)
+		*consumed = done;
+
+	return n;
+}
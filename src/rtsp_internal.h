@@ -0,0 +1,132 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Internal RTSP Helpers
+ * Helpers shared between the RTSP sources of libwfd. None of these are exported.
+ */
+
+#ifndef WFD_RTSP_INTERNAL_H
+#define WFD_RTSP_INTERNAL_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "shl_scan.h"
+
+/* character classes */
+
+enum rtsp_char_class {
+	RTSP_CHAR_ZERO		= (1U << 0),	/* binary 0 */
+	RTSP_CHAR_CTL		= (1U << 1),	/* CTLs except binary 0 */
+	RTSP_CHAR_LWS		= (1U << 2),	/* SP, HT, CR and LF */
+	RTSP_CHAR_SPECIAL	= (1U << 3),	/* tspecials except '"' */
+	RTSP_CHAR_QUOTE		= (1U << 4),	/* '"' */
+};
+
+/* class of each byte; bytes without class are plain token characters */
+extern const uint8_t rtsp_char_class[256];
+
+static inline unsigned int rtsp_char_get_class(char c)
+{
+	return rtsp_char_class[(uint8_t)c];
+}
+
+/*
+ * line handling
+ * The decoder state-machine and the framing scanner split input into lines
+ * the same way: leading LWS is skipped, any combination of \r and \n ends a
+ * line, lines starting with whitespace continue the previous one, quoted
+ * strings may span lines and an empty line ends the header. The scan-sets
+ * contain all bytes that may change the state while skipping leading LWS,
+ * while in a header line and while in a quoted string.
+ */
+
+extern const struct shl_scan rtsp_scan_lws;
+extern const struct shl_scan rtsp_scan_header;
+extern const struct shl_scan rtsp_scan_quote;
+
+static inline bool rtsp_is_line_break(char c)
+{
+	return c == '\r' || c == '\n';
+}
+
+/* @c following @last is an empty line, which ends the header */
+static inline bool rtsp_is_header_end(char last, char c)
+{
+	return (c == '\r' && rtsp_is_line_break(last)) ||
+	       (c == '\n' && last == '\n');
+}
+
+/* a line-break followed by anything but whitespace ends the line */
+static inline bool rtsp_is_line_end(char last, char c)
+{
+	return rtsp_is_line_break(last) && c != ' ' && c != '\t' &&
+	       !rtsp_is_line_break(c);
+}
+
+/* parse the first value token of a Content-Length header */
+int rtsp_parse_content_length(const char *value, size_t len, size_t *out);
+
+/* name hashing */
+
+#define RTSP_HEADER_HASH_SEED 0x183
+#define RTSP_HEADER_HASH_BITS 7
+#define RTSP_METHOD_HASH_SEED 0x39
+#define RTSP_METHOD_HASH_BITS 4
+
+/*
+ * Hash the length and the first two and last two characters of a name
+ * (case-insensitive) into @bits bits. The seeds above were chosen so that no
+ * two known header or method names share a slot; test_rtsp verifies that and
+ * searches for a new seed if it doesn't hold. @len must be at least 2.
+ */
+static inline unsigned int rtsp_name_hash(const char *name,
+					  size_t len,
+					  uint32_t seed,
+					  unsigned int bits)
+{
+	uint8_t c[5];
+	uint32_t x;
+	size_t i;
+
+	c[0] = len;
+	c[1] = name[0];
+	c[2] = name[1];
+	c[3] = name[len - 2];
+	c[4] = name[len - 1];
+
+	x = seed;
+	for (i = 0; i < sizeof(c); ++i)
+		x = (x ^ (c[i] | 0x20)) * 0x01000193;
+
+	x ^= x >> 15;
+	x *= 0x2c1b3c6d;
+	x ^= x >> 12;
+
+	return x >> (32 - bits);
+}
+
+#endif /* WFD_RTSP_INTERNAL_H */
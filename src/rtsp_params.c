@@ -0,0 +1,602 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "libwfd.h"
+#include "shl_macro.h"
+#include "shl_util.h"
+
+/*
+ * WFD Parameters
+ * The capability exchange (M3/M4) carries text/parameters entities, one
+ * parameter per line:
+ *   <name> [":" SP <value>] CRLF
+ * GET_PARAMETER requests list names only, everything else carries values.
+ * Values are sequences of fixed-width hex fields, decimal numbers and
+ * keywords, separated by single spaces; lists are separated by ", ". We
+ * accept any amount of whitespace and hex fields shorter than their width,
+ * as sinks aren't too strict about either.
+ * The entity is walked once. Each line is indexed in place and, if
+ * requested, its value is decoded right away into the wfd_ie_sub_* structs
+ * that describe the same capabilities in the P2P IEs.
+ */
+
+#define PARAM_NAME(_name) { _name, sizeof(_name) - 1 }
+
+static const struct {
+	const char *name;
+	size_t len;
+} param_names[] = {
+	[WFD_RTSP_PARAM_AUDIO_CODECS]	= PARAM_NAME("wfd_audio_codecs"),
+	[WFD_RTSP_PARAM_VIDEO_FORMATS]	= PARAM_NAME("wfd_video_formats"),
+	[WFD_RTSP_PARAM_3D_VIDEO_FORMATS] = PARAM_NAME("wfd_3d_video_formats"),
+	[WFD_RTSP_PARAM_CONTENT_PROTECTION] =
+				PARAM_NAME("wfd_content_protection"),
+	[WFD_RTSP_PARAM_DISPLAY_EDID]	= PARAM_NAME("wfd_display_edid"),
+	[WFD_RTSP_PARAM_COUPLED_SINK]	= PARAM_NAME("wfd_coupled_sink"),
+	[WFD_RTSP_PARAM_TRIGGER_METHOD]	= PARAM_NAME("wfd_trigger_method"),
+	[WFD_RTSP_PARAM_PRESENTATION_URL] = PARAM_NAME("wfd_presentation_URL"),
+	[WFD_RTSP_PARAM_CLIENT_RTP_PORTS] = PARAM_NAME("wfd_client_rtp_ports"),
+	[WFD_RTSP_PARAM_ROUTE]		= PARAM_NAME("wfd_route"),
+	[WFD_RTSP_PARAM_I2C]		= PARAM_NAME("wfd_I2C"),
+	[WFD_RTSP_PARAM_AV_FORMAT_CHANGE_TIMING] =
+				PARAM_NAME("wfd_av_format_change_timing"),
+	[WFD_RTSP_PARAM_PREFERRED_DISPLAY_MODE] =
+				PARAM_NAME("wfd_preferred_display_mode"),
+	[WFD_RTSP_PARAM_UIBC_CAPABILITY] = PARAM_NAME("wfd_uibc_capability"),
+	[WFD_RTSP_PARAM_UIBC_SETTING]	= PARAM_NAME("wfd_uibc_setting"),
+	[WFD_RTSP_PARAM_STANDBY_RESUME_CAPABILITY] =
+				PARAM_NAME("wfd_standby_resume_capability"),
+	[WFD_RTSP_PARAM_STANDBY]	= PARAM_NAME("wfd_standby"),
+	[WFD_RTSP_PARAM_CONNECTOR_TYPE]	= PARAM_NAME("wfd_connector_type"),
+	[WFD_RTSP_PARAM_IDR_REQUEST]	= PARAM_NAME("wfd_idr_request"),
+	[WFD_RTSP_PARAM_CNT]		= { NULL, 0 },
+};
+
+_shl_public_
+const char *wfd_rtsp_param_get_name(unsigned int param)
+{
+	if (param >= WFD_RTSP_PARAM_CNT)
+		return NULL;
+
+	return param_names[param].name;
+}
+
+_shl_public_
+unsigned int wfd_rtsp_param_from_name_n(const char *param, size_t len)
+{
+	unsigned int i;
+
+	if (!param)
+		return WFD_RTSP_PARAM_UNKNOWN;
+
+	/* The names differ in length enough that a linear search rarely
+	 * compares more than one of them. */
+	for (i = 1; i < WFD_RTSP_PARAM_CNT; ++i)
+		if (param_names[i].len == len &&
+		    !strncasecmp(param, param_names[i].name, len))
+			return i;
+
+	return WFD_RTSP_PARAM_UNKNOWN;
+}
+
+enum param_char_class {
+	PARAM_WS		= (1U << 0),	/* SP, HT and CR */
+	PARAM_END		= (1U << 1),	/* ends tokens: whitespace and ',' */
+	PARAM_HEX		= (1U << 2),	/* hex digits */
+};
+
+static const uint8_t param_class[256] = {
+	['\t']		= PARAM_WS | PARAM_END,
+	['\r']		= PARAM_WS | PARAM_END,
+	[' ']		= PARAM_WS | PARAM_END,
+	[',']		= PARAM_END,
+	['0' ... '9']	= PARAM_HEX,
+	['A' ... 'F']	= PARAM_HEX,
+	['a' ... 'f']	= PARAM_HEX,
+};
+
+static bool param_is_ws(char c)
+{
+	return param_class[(uint8_t)c] & PARAM_WS;
+}
+
+static const char *param_skip_ws(const char *p, const char *end)
+{
+	while (p < end && param_is_ws(*p))
+		++p;
+
+	return p;
+}
+
+/* return next token, which ends at whitespace or ','; advances @pp past it */
+static size_t param_token(const char **pp, const char *end, const char **tok)
+{
+	const char *p;
+
+	p = *tok = param_skip_ws(*pp, end);
+	while (p < end && !(param_class[(uint8_t)*p] & PARAM_END))
+		++p;
+
+	*pp = p;
+	return p - *tok;
+}
+
+static bool param_is(const char *tok, size_t len, const char *word)
+{
+	/* cheap checks first, most tokens are compared against a few words */
+	return len == strlen(word) && (*tok | 0x20) == (*word | 0x20) &&
+	       !strncasecmp(tok, word, len);
+}
+
+/* consume next token if it is @word */
+static bool param_word(const char **pp, const char *end, const char *word)
+{
+	const char *p = *pp, *tok;
+	size_t len;
+
+	len = param_token(&p, end, &tok);
+	if (!param_is(tok, len, word))
+		return false;
+
+	*pp = p;
+	return true;
+}
+
+/* parse hex field of up to @width digits; tokenizes and converts in one go */
+static int param_hex(const char **pp,
+		     const char *end,
+		     unsigned int width,
+		     uint64_t *out)
+{
+	const char *p, *tok;
+	uint64_t v = 0;
+
+	p = tok = param_skip_ws(*pp, end);
+	for ( ; p < end && (param_class[(uint8_t)*p] & PARAM_HEX); ++p)
+		v = v << 4 | ((*p & 0xf) + (*p >> 6) * 9);
+
+	if (p == tok || (size_t)(p - tok) > width ||
+	    (p < end && !(param_class[(uint8_t)*p] & PARAM_END)))
+		return -EINVAL;
+
+	*pp = p;
+	*out = v;
+	return 0;
+}
+
+static int param_dec(const char **pp,
+		     const char *end,
+		     unsigned long max,
+		     unsigned long *out)
+{
+	const char *tok, *next;
+	size_t len;
+	int r;
+
+	len = param_token(pp, end, &tok);
+	r = shl_atoi_uln(tok, len, 10, &next, out);
+	if (r < 0 || !len || next != tok + len || *out > max)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* consume list separator; returns false at the end of the list */
+static bool param_list_next(const char **pp, const char *end)
+{
+	const char *p;
+
+	p = param_skip_ws(*pp, end);
+	if (p == end || *p != ',')
+		return false;
+
+	*pp = p + 1;
+	return true;
+}
+
+static int param_end(const char *p, const char *end)
+{
+	return param_skip_ws(p, end) == end ? 0 : -EINVAL;
+}
+
+static int param_parse_audio(struct wfd_rtsp_params *params,
+			     const char *p,
+			     const char *end)
+{
+	struct wfd_ie_sub_audio_formats *a = &params->audio_codecs;
+	uint64_t modes, latency;
+	const char *tok;
+	size_t len;
+	int r;
+
+	shl_zero(*a);
+	if (param_word(&p, end, "none"))
+		return param_end(p, end);
+
+	/* <format> <modes:8> <latency:2> *(", " ...) */
+	do {
+		len = param_token(&p, end, &tok);
+		if ((r = param_hex(&p, end, 8, &modes)) < 0 ||
+		    (r = param_hex(&p, end, 2, &latency)) < 0)
+			return r;
+
+		if (param_is(tok, len, "LPCM")) {
+			a->lpcm_modes = modes;
+			a->lpcm_latency = latency;
+		} else if (param_is(tok, len, "AAC")) {
+			a->aac_modes = modes;
+			a->aac_latency = latency;
+		} else if (param_is(tok, len, "AC3")) {
+			a->ac3_modes = modes;
+			a->ac3_latency = latency;
+		}
+	} while (param_list_next(&p, end));
+
+	return param_end(p, end);
+}
+
+/* H.264 codec of wfd_video_formats and wfd_3d_video_formats */
+struct param_codec {
+	uint64_t profile;
+	uint64_t level;
+	uint64_t modes[3];	/* CEA, VESA, HH; 3D capabilities in [0] */
+	uint64_t latency;
+	uint64_t slice_min;
+	uint64_t slice_enc;
+	uint64_t frame_skip;
+};
+
+static int param_parse_codec(const char **pp,
+			     const char *end,
+			     bool is_3d,
+			     struct param_codec *c)
+{
+	uint64_t res;
+	unsigned int i;
+	int r;
+
+	/* <profile:2> <level:2> <cea:8> <vesa:8> <hh:8> or <3d-caps:16>
+	 * <latency:2> <min-slice:4> <slice-enc:4> <frame-skip:2>
+	 * [<max-hres:4|none> <max-vres:4|none>] */
+	if ((r = param_hex(pp, end, 2, &c->profile)) < 0 ||
+	    (r = param_hex(pp, end, 2, &c->level)) < 0)
+		return r;
+
+	if (is_3d) {
+		r = param_hex(pp, end, 16, &c->modes[0]);
+		if (r < 0)
+			return r;
+	} else {
+		for (i = 0; i < 3; ++i) {
+			r = param_hex(pp, end, 8, &c->modes[i]);
+			if (r < 0)
+				return r;
+		}
+	}
+
+	if ((r = param_hex(pp, end, 2, &c->latency)) < 0 ||
+	    (r = param_hex(pp, end, 4, &c->slice_min)) < 0 ||
+	    (r = param_hex(pp, end, 4, &c->slice_enc)) < 0 ||
+	    (r = param_hex(pp, end, 2, &c->frame_skip)) < 0)
+		return r;
+
+	/* max resolution was added late to the spec and has no IE field */
+	*pp = param_skip_ws(*pp, end);
+	if (*pp == end || **pp == ',')
+		return 0;
+
+	for (i = 0; i < 2; ++i) {
+		if (!param_word(pp, end, "none") &&
+		    (r = param_hex(pp, end, 4, &res)) < 0)
+			return r;
+	}
+
+	return 0;
+}
+
+static int param_parse_video(struct wfd_rtsp_params *params,
+			     const char *p,
+			     const char *end)
+{
+	struct wfd_ie_sub_video_formats *v;
+	struct param_codec c = { };
+	uint64_t native, preferred;
+	int r;
+
+	params->n_video_formats = 0;
+	params->video_preferred = 0;
+	if (param_word(&p, end, "none"))
+		return param_end(p, end);
+
+	/* <native:2> <preferred-display-mode-supported:2> <codec> *(", " ...) */
+	if ((r = param_hex(&p, end, 2, &native)) < 0 ||
+	    (r = param_hex(&p, end, 2, &preferred)) < 0)
+		return r;
+
+	do {
+		r = param_parse_codec(&p, end, false, &c);
+		if (r < 0)
+			return r;
+		if (params->n_video_formats >= WFD_RTSP_PARAMS_CODEC_MAX)
+			continue;
+
+		v = &params->video_formats[params->n_video_formats++];
+		v->cea_modes = c.modes[0];
+		v->vesa_modes = c.modes[1];
+		v->hh_modes = c.modes[2];
+		v->native_mode = native;
+		v->h264_profile = c.profile;
+		v->h264_max_level = c.level;
+		v->latency = c.latency;
+		v->slice_min = c.slice_min;
+		v->slice_enc = c.slice_enc;
+		v->frame_skip = c.frame_skip;
+	} while (param_list_next(&p, end));
+
+	params->video_preferred = preferred;
+	return param_end(p, end);
+}
+
+static int param_parse_3d(struct wfd_rtsp_params *params,
+			  const char *p,
+			  const char *end)
+{
+	struct wfd_ie_sub_3d_formats *v;
+	struct param_codec c = { };
+	uint64_t native, preferred;
+	int r;
+
+	params->n_3d_formats = 0;
+	if (param_word(&p, end, "none"))
+		return param_end(p, end);
+
+	/* same as wfd_video_formats, but with 3D capabilities */
+	if ((r = param_hex(&p, end, 2, &native)) < 0 ||
+	    (r = param_hex(&p, end, 2, &preferred)) < 0)
+		return r;
+
+	do {
+		r = param_parse_codec(&p, end, true, &c);
+		if (r < 0)
+			return r;
+		if (params->n_3d_formats >= WFD_RTSP_PARAMS_CODEC_MAX)
+			continue;
+
+		v = &params->formats_3d[params->n_3d_formats++];
+		v->capabilities = c.modes[0];
+		v->native_mode = native;
+		v->h264_profile = c.profile;
+		v->h264_max_level = c.level;
+		v->latency = c.latency;
+		v->slice_min = c.slice_min;
+		v->slice_enc = c.slice_enc;
+		v->frame_skip = c.frame_skip;
+	} while (param_list_next(&p, end));
+
+	return param_end(p, end);
+}
+
+static int param_parse_cp(struct wfd_rtsp_params *params,
+			  const char *p,
+			  const char *end)
+{
+	const char *tok, *next;
+	unsigned long port;
+	size_t len;
+	int r;
+
+	params->content_protection.flags = 0;
+	params->hdcp_port = 0;
+	if (param_word(&p, end, "none"))
+		return param_end(p, end);
+
+	/* HDCP2.0 or HDCP2.1, followed by "port=" <port> */
+	len = param_token(&p, end, &tok);
+	if (param_is(tok, len, "HDCP2.0"))
+		params->content_protection.flags =
+			WFD_IE_SUB_CONTENT_PROTECT_CAN_HDCP_2_0;
+	else if (param_is(tok, len, "HDCP2.1"))
+		params->content_protection.flags =
+			WFD_IE_SUB_CONTENT_PROTECT_CAN_HDCP_2_0 |
+			WFD_IE_SUB_CONTENT_PROTECT_CAN_HDCP_2_1;
+	else
+		return -EINVAL;
+
+	len = param_token(&p, end, &tok);
+	if (len <= 5 || strncasecmp(tok, "port=", 5))
+		return -EINVAL;
+
+	r = shl_atoi_uln(tok + 5, len - 5, 10, &next, &port);
+	if (r < 0 || next != tok + len || port > 65535)
+		return -EINVAL;
+
+	params->hdcp_port = port;
+	return param_end(p, end);
+}
+
+static int param_parse_coupled(struct wfd_rtsp_params *params,
+			       const char *p,
+			       const char *end)
+{
+	struct wfd_ie_sub_coupled_sink *c = &params->coupled_sink;
+	uint64_t status, mac;
+	unsigned int i;
+	int r;
+
+	shl_zero(*c);
+	if (param_word(&p, end, "none"))
+		return param_end(p, end);
+
+	/* <status:2> <mac:12|none> */
+	r = param_hex(&p, end, 2, &status);
+	if (r < 0)
+		return r;
+
+	if (!param_word(&p, end, "none")) {
+		r = param_hex(&p, end, 12, &mac);
+		if (r < 0)
+			return r;
+
+		for (i = 0; i < 6; ++i)
+			c->mac[i] = mac >> (8 * (5 - i));
+	}
+
+	c->status = status;
+	return param_end(p, end);
+}
+
+static int param_parse_rtp_ports(struct wfd_rtsp_params *params,
+				 const char *p,
+				 const char *end)
+{
+	unsigned long port[2];
+	const char *tok;
+	size_t len;
+	int r;
+
+	/* <profile> <port0> <port1> "mode=play" */
+	len = param_token(&p, end, &tok);
+	if (param_is(tok, len, "RTP/AVP/UDP;unicast"))
+		params->client_rtp_ports.lower = WFD_RTSP_TRANSPORT_UDP;
+	else if (param_is(tok, len, "RTP/AVP/TCP;unicast"))
+		params->client_rtp_ports.lower = WFD_RTSP_TRANSPORT_TCP;
+	else
+		return -EINVAL;
+
+	if ((r = param_dec(&p, end, 65535, &port[0])) < 0 ||
+	    (r = param_dec(&p, end, 65535, &port[1])) < 0)
+		return r;
+
+	if (!param_word(&p, end, "mode=play"))
+		return -EINVAL;
+
+	params->client_rtp_ports.port[0] = port[0];
+	params->client_rtp_ports.port[1] = port[1];
+	return param_end(p, end);
+}
+
+typedef int (*param_parser_t) (struct wfd_rtsp_params *params,
+			       const char *p,
+			       const char *end);
+
+static const param_parser_t param_parsers[WFD_RTSP_PARAM_CNT] = {
+	[WFD_RTSP_PARAM_AUDIO_CODECS]		= param_parse_audio,
+	[WFD_RTSP_PARAM_VIDEO_FORMATS]		= param_parse_video,
+	[WFD_RTSP_PARAM_3D_VIDEO_FORMATS]	= param_parse_3d,
+	[WFD_RTSP_PARAM_CONTENT_PROTECTION]	= param_parse_cp,
+	[WFD_RTSP_PARAM_COUPLED_SINK]		= param_parse_coupled,
+	[WFD_RTSP_PARAM_CLIENT_RTP_PORTS]	= param_parse_rtp_ports,
+};
+
+_shl_public_
+int wfd_rtsp_params_parse(struct wfd_rtsp_params *params,
+			  const void *body,
+			  size_t size,
+			  uint64_t mask)
+{
+	struct wfd_rtsp_param *param;
+	const char *p, *end, *eol, *line_end, *colon, *name_end;
+	uint64_t bit;
+
+	if (!params || (!body && size))
+		return -EINVAL;
+
+	params->present = 0;
+	params->parsed = 0;
+	params->n_params = 0;
+	if (!size)
+		return 0;
+
+	p = body;
+	end = p + size;
+
+	for ( ; p < end; p = eol < end ? eol + 1 : end) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+
+		/* trim line, skip empty ones */
+		p = param_skip_ws(p, eol);
+		line_end = eol;
+		while (line_end > p && param_is_ws(line_end[-1]))
+			--line_end;
+		if (p == line_end)
+			continue;
+
+		colon = memchr(p, ':', line_end - p);
+		name_end = colon ? colon : line_end;
+		while (name_end > p && param_is_ws(name_end[-1]))
+			--name_end;
+
+		if (params->n_params >= WFD_RTSP_PARAMS_MAX)
+			return -ENOBUFS;
+
+		param = &params->params[params->n_params++];
+		param->type = wfd_rtsp_param_from_name_n(p, name_end - p);
+		param->name = p;
+		param->name_len = name_end - p;
+		if (colon) {
+			param->value = param_skip_ws(colon + 1, line_end);
+			param->value_len = line_end - param->value;
+		} else {
+			param->value = NULL;
+			param->value_len = 0;
+		}
+
+		/* only the first line of each type is parsed */
+		bit = WFD_RTSP_PARAM_MASK(param->type);
+		if (param->value && (mask & bit) && !(params->present & bit) &&
+		    param_parsers[param->type] &&
+		    param_parsers[param->type](params, param->value,
+					       line_end) >= 0)
+			params->parsed |= bit;
+
+		params->present |= bit;
+	}
+
+	return 0;
+}
+
+_shl_public_
+const struct wfd_rtsp_param *
+wfd_rtsp_params_find(const struct wfd_rtsp_params *params, unsigned int type)
+{
+	size_t i;
+
+	if (!params || type >= WFD_RTSP_PARAM_CNT ||
+	    !(params->present & WFD_RTSP_PARAM_MASK(type)))
+		return NULL;
+
+	for (i = 0; i < params->n_params; ++i)
+		if (params->params[i].type == type)
+			return &params->params[i];
+
+	return NULL;
+}
@@ -0,0 +1,271 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libwfd.h"
+#include "shl_macro.h"
+
+/*
+ * RTSP Session Table
+ * Open-addressing hash table with linear probing, keyed by session-id. Entries
+ * store the full hash next to the id, so probes only touch the entry array
+ * and ids are compared just once, on a hit. The table is kept at most 3/4
+ * full and removals shift the following entries back instead of leaving
+ * tombstones, so probe sequences stay short no matter how many sessions come
+ * and go.
+ */
+
+#define SESSION_TABLE_MIN 16
+
+struct session_entry {
+	char *id;		/* NULL if unused */
+	size_t len;
+	uint32_t hash;
+	void *data;
+};
+
+struct wfd_rtsp_session_table {
+	struct session_entry *entries;
+	size_t size;		/* always a power of 2 */
+	size_t count;
+};
+
+_shl_public_
+uint32_t wfd_rtsp_session_hash(const char *id, size_t len)
+{
+	uint32_t x = 0x811c9dc5;
+	size_t i;
+
+	/* FNV-1a, finalized so the low bits can be used as index */
+	for (i = 0; i < len; ++i)
+		x = (x ^ (uint8_t)id[i]) * 0x01000193;
+
+	x ^= x >> 16;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35;
+	x ^= x >> 16;
+
+	return x;
+}
+
+static struct session_entry *table_find(struct wfd_rtsp_session_table *tbl,
+					const char *id,
+					size_t len,
+					uint32_t hash)
+{
+	struct session_entry *e;
+	size_t i, mask;
+
+	if (!tbl->size)
+		return NULL;
+
+	mask = tbl->size - 1;
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+		e = &tbl->entries[i];
+		if (!e->id)
+			return NULL;
+		if (e->hash == hash && e->len == len && !memcmp(e->id, id, len))
+			return e;
+	}
+}
+
+static void table_insert(struct session_entry *entries,
+			 size_t size,
+			 const struct session_entry *entry)
+{
+	size_t i, mask = size - 1;
+
+	for (i = entry->hash & mask; entries[i].id; i = (i + 1) & mask)
+		/* empty */ ;
+
+	entries[i] = *entry;
+}
+
+static int table_grow(struct wfd_rtsp_session_table *tbl)
+{
+	struct session_entry *entries;
+	size_t i, size;
+
+	size = tbl->size ? tbl->size * 2 : SESSION_TABLE_MIN;
+	if (size > SIZE_MAX / sizeof(*entries))
+		return -ENOMEM;
+
+	entries = calloc(size, sizeof(*entries));
+	if (!entries)
+		return -ENOMEM;
+
+	for (i = 0; i < tbl->size; ++i)
+		if (tbl->entries[i].id)
+			table_insert(entries, size, &tbl->entries[i]);
+
+	free(tbl->entries);
+	tbl->entries = entries;
+	tbl->size = size;
+
+	return 0;
+}
+
+_shl_public_
+int wfd_rtsp_session_table_new(struct wfd_rtsp_session_table **out)
+{
+	struct wfd_rtsp_session_table *tbl;
+
+	if (!out)
+		return -EINVAL;
+
+	tbl = calloc(1, sizeof(*tbl));
+	if (!tbl)
+		return -ENOMEM;
+
+	*out = tbl;
+	return 0;
+}
+
+_shl_public_
+void wfd_rtsp_session_table_free(struct wfd_rtsp_session_table *tbl)
+{
+	size_t i;
+
+	if (!tbl)
+		return;
+
+	for (i = 0; i < tbl->size; ++i)
+		free(tbl->entries[i].id);
+
+	free(tbl->entries);
+	free(tbl);
+}
+
+_shl_public_
+size_t wfd_rtsp_session_table_get_count(struct wfd_rtsp_session_table *tbl)
+{
+	return tbl ? tbl->count : 0;
+}
+
+_shl_public_
+int wfd_rtsp_session_table_add(struct wfd_rtsp_session_table *tbl,
+			       const char *id,
+			       size_t len,
+			       void *data)
+{
+	struct session_entry e;
+	int r;
+
+	if (!tbl || !id || !len || !data)
+		return -EINVAL;
+
+	e.hash = wfd_rtsp_session_hash(id, len);
+	if (table_find(tbl, id, len, e.hash))
+		return -EEXIST;
+
+	if ((tbl->count + 1) * 4 > tbl->size * 3) {
+		r = table_grow(tbl);
+		if (r < 0)
+			return r;
+	}
+
+	e.id = malloc(len);
+	if (!e.id)
+		return -ENOMEM;
+
+	memcpy(e.id, id, len);
+	e.len = len;
+	e.data = data;
+
+	table_insert(tbl->entries, tbl->size, &e);
+	++tbl->count;
+
+	return 0;
+}
+
+_shl_public_
+void *wfd_rtsp_session_table_remove(struct wfd_rtsp_session_table *tbl,
+				    const char *id,
+				    size_t len)
+{
+	struct session_entry *e;
+	size_t i, j, home, mask;
+	void *data;
+
+	if (!tbl || !id)
+		return NULL;
+
+	e = table_find(tbl, id, len, wfd_rtsp_session_hash(id, len));
+	if (!e)
+		return NULL;
+
+	data = e->data;
+	free(e->id);
+	--tbl->count;
+
+	/* Shift back all following entries of the cluster that would become
+	 * unreachable. An entry at @j may move to the hole at @i unless its
+	 * home slot lies cyclically in (@i, @j]. */
+	mask = tbl->size - 1;
+	i = e - tbl->entries;
+	for (j = (i + 1) & mask; tbl->entries[j].id; j = (j + 1) & mask) {
+		home = tbl->entries[j].hash & mask;
+		if (((j - home) & mask) < ((j - i) & mask))
+			continue;
+
+		tbl->entries[i] = tbl->entries[j];
+		i = j;
+	}
+
+	shl_zero(tbl->entries[i]);
+
+	return data;
+}
+
+_shl_public_
+void *wfd_rtsp_session_table_find(struct wfd_rtsp_session_table *tbl,
+				  const char *id,
+				  size_t len)
+{
+	struct session_entry *e;
+
+	if (!tbl || !id)
+		return NULL;
+
+	e = table_find(tbl, id, len, wfd_rtsp_session_hash(id, len));
+	return e ? e->data : NULL;
+}
+
+_shl_public_
+void *wfd_rtsp_session_table_lookup(struct wfd_rtsp_session_table *tbl,
+				    const struct wfd_rtsp_session *session)
+{
+	struct session_entry *e;
+
+	if (!tbl || !session || !session->id)
+		return NULL;
+
+	e = table_find(tbl, session->id, session->length, session->hash);
+	return e ? e->data : NULL;
+}
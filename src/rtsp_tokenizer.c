@@ -29,28 +29,303 @@
 #include <string.h>
 #include <strings.h>
 #include "libwfd.h"
+#include "rtsp_internal.h"
 #include "shl_macro.h"
+#include "shl_scan.h"
 
 /*
  * RTSP Tokenizer
  * The RTSP standard is word-based and allows linear-whitespace between any two
  * tokens or special-chars. This tokenizer splits a given line into a list of
- * tokens and returns how many tokens were generated. It also sanitizes the line
- * by removing whitespace, trimming leading/trailing whitespace, removing binary
- * zero characters and decoding escape-sequences.
+ * tokens. Whitespace and CTLs separate tokens and are dropped, special-chars are
+ * returned as single-char tokens and quoted-strings are returned as a single
+ * token without the surrounding quotes. Binary zero characters are removed and
+ * escape-sequences in quoted-strings are decoded.
  *
  * This tokenizer can be used before or after the basic RTSP sanitizer. But note
  * that some RTSP requests or responses contain URIs or other embedded
  * information which should not be tokenized as they don't follow basic RTSP
  * rules (yeah, who came up with that shit..).
+ *
+ * The iterator does the actual work. It only returns spans of the original
+ * line and marks tokens which need decoding, so callers which only look at a
+ * few tokens never have to copy anything. wfd_rtsp_token_copy() decodes a
+ * single token and the wfd_rtsp_tokenize*() helpers are built on top of both.
+ */
+
+/*
+ * Character Classes
+ * Shared by the tokenizer and the decoder's line sanitizer. Bytes >= 128 are
+ * plain token characters, like any other OCTET that isn't a CTL.
+ */
+
+#define CTL RTSP_CHAR_CTL
+#define LWS RTSP_CHAR_LWS
+#define SPECIAL RTSP_CHAR_SPECIAL
+
+const uint8_t rtsp_char_class[256] = {
+	[0]		= RTSP_CHAR_ZERO,
+	[1 ... 8]	= CTL,
+	['\t']		= CTL | LWS,
+	['\n']		= CTL | LWS,
+	[11 ... 12]	= CTL,
+	['\r']		= CTL | LWS,
+	[14 ... 31]	= CTL,
+	[' ']		= LWS,
+	['"']		= RTSP_CHAR_QUOTE,
+	['(']		= SPECIAL,
+	[')']		= SPECIAL,
+	[',']		= SPECIAL,
+	['/']		= SPECIAL,
+	[':']		= SPECIAL,
+	[';']		= SPECIAL,
+	['<']		= SPECIAL,
+	['=']		= SPECIAL,
+	['>']		= SPECIAL,
+	['?']		= SPECIAL,
+	['@']		= SPECIAL,
+	['[']		= SPECIAL,
+	['\\']		= SPECIAL,
+	[']']		= SPECIAL,
+	['{']		= SPECIAL,
+	['}']		= SPECIAL,
+	[127]		= CTL,
+};
+
+#undef SPECIAL
+#undef LWS
+#undef CTL
+
+/*
+ * Long plain tokens (URIs, EDIDs, parameter values, ..) are skipped via the
+ * SIMD table scanner. It has a fixed setup cost, so the first few bytes of each
+ * token are classified byte by byte; most tokens end before that. Below 32
+ * bytes, the scanner is no faster than the class table. The scalar table
+ * scanner tests bits instead of loading classes, so without SIMD we stay with
+ * the class table for the whole token.
  */
+
+#define TOKEN_SCAN_MIN 32
+
+static struct shl_scan_table token_stop;
+
+__attribute__((__constructor__))
+static void token_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 256; ++i)
+		if (rtsp_char_class[i])
+			shl_scan_table_add(&token_stop, i);
+}
+
+static size_t token_skip_plain(const char *line, size_t pos, size_t len)
+{
+	size_t end;
+
+	end = shl_min(len, pos + TOKEN_SCAN_MIN);
+	while (pos < end && !rtsp_char_get_class(line[pos]))
+		++pos;
+
+	if (pos < end || pos >= len)
+		return pos;
+
+	if (shl_scan_get_impl() != SHL_SCAN_SCALAR)
+		return pos + shl_scan_table_any(&token_stop, &line[pos],
+						len - pos);
+
+	while (pos < len && !rtsp_char_get_class(line[pos]))
+		++pos;
+
+	return pos;
+}
+
+_shl_public_
+void wfd_rtsp_token_iter_init(struct wfd_rtsp_token_iter *iter,
+			      const char *line,
+			      ssize_t len)
+{
+	if (len < 0)
+		len = strlen(line);
+
+	iter->line = line;
+	iter->len = len;
+	iter->pos = 0;
+}
+
+_shl_public_
+bool wfd_rtsp_token_iter_next(struct wfd_rtsp_token_iter *iter,
+			      struct wfd_rtsp_token *token)
+{
+	const char *line;
+	size_t pos, len, start;
+	unsigned int type, flags;
+
+	line = iter->line;
+	len = iter->len;
+	pos = iter->pos;
+
+	/* skip separators and binary 0s */
+	for ( ; pos < len; ++pos) {
+		type = rtsp_char_get_class(line[pos]);
+		if (!(type & (RTSP_CHAR_ZERO | RTSP_CHAR_CTL | RTSP_CHAR_LWS)))
+			break;
+	}
+
+	if (pos >= len) {
+		iter->pos = len;
+		return false;
+	}
+
+	start = pos;
+	flags = 0;
+
+	if (type & RTSP_CHAR_SPECIAL) {
+		flags |= WFD_RTSP_TOKEN_SPECIAL;
+		iter->pos = ++pos;
+	} else if (type & RTSP_CHAR_QUOTE) {
+		flags |= WFD_RTSP_TOKEN_QUOTED;
+		start = ++pos;
+
+		/* unterminated quoted-strings end at the end of the line */
+		for ( ; pos < len; ++pos) {
+			if (line[pos] == '"') {
+				break;
+			} else if (line[pos] == '\\') {
+				flags |= WFD_RTSP_TOKEN_ESCAPED;
+				if (++pos >= len)
+					break;
+			} else if (!line[pos]) {
+				flags |= WFD_RTSP_TOKEN_ESCAPED;
+			}
+		}
+
+		/* skip closing quote */
+		iter->pos = pos < len ? pos + 1 : len;
+	} else {
+		/* binary 0s are dropped but don't terminate the token */
+		pos = token_skip_plain(line, pos, len);
+		while (pos < len && !line[pos]) {
+			flags |= WFD_RTSP_TOKEN_ESCAPED;
+			pos = token_skip_plain(line, pos + 1, len);
+		}
+
+		iter->pos = pos;
+	}
+
+	token->offset = start;
+	token->length = pos - start;
+	token->flags = flags;
+	return true;
+}
+
+_shl_public_
+size_t wfd_rtsp_token_copy(const char *line,
+			   const struct wfd_rtsp_token *token,
+			   char *buf)
+{
+	const char *src, *end;
+	char *dst, c;
+
+	src = line + token->offset;
+	end = src + token->length;
+	dst = buf;
+
+	if (!(token->flags & WFD_RTSP_TOKEN_ESCAPED)) {
+		memcpy(dst, src, token->length);
+		dst[token->length] = 0;
+		return token->length;
+	}
+
+	/* only quoted tokens can contain escape-sequences */
+	while (src < end) {
+		c = *src++;
+		if (!c) {
+			/* discard */
+			continue;
+		} else if (c != '\\') {
+			*dst++ = c;
+			continue;
+		} else if (src >= end) {
+			/* keep trailing backslash */
+			*dst++ = '\\';
+			break;
+		}
+
+		c = *src++;
+		if (c == '\\') {
+			*dst++ = '\\';
+		} else if (c == '"') {
+			*dst++ = '"';
+		} else if (c == 'n') {
+			*dst++ = '\n';
+		} else if (c == 'r') {
+			*dst++ = '\r';
+		} else if (c == 't') {
+			*dst++ = '\t';
+		} else if (c == 'a') {
+			*dst++ = '\a';
+		} else if (c == 'f') {
+			*dst++ = '\f';
+		} else if (c == 'v') {
+			*dst++ = '\v';
+		} else if (c == 'b') {
+			*dst++ = '\b';
+		} else if (c == 'e') {
+			*dst++ = 0x1b;	/* ESC */
+		} else if (c == 0) {
+			/* turn escaped binary 0 into \0 */
+			*dst++ = '\\';
+			*dst++ = '0';
+		} else {
+			/* keep unknown escape sequences */
+			*dst++ = '\\';
+			*dst++ = c;
+		}
+	}
+
+	*dst = 0;
+	return dst - buf;
+}
+
+_shl_public_
+ssize_t wfd_rtsp_tokenize_buf(const char *line,
+			      ssize_t len,
+			      char *buf,
+			      size_t size)
+{
+	struct wfd_rtsp_token_iter iter;
+	struct wfd_rtsp_token token;
+	size_t num, pos;
+
+	if (!line || !buf)
+		return -EINVAL;
+
+	num = 0;
+	pos = 0;
+	wfd_rtsp_token_iter_init(&iter, line, len);
+
+	while (wfd_rtsp_token_iter_next(&iter, &token)) {
+		/* reserve space for the terminating 0 of the token list */
+		if (size - pos < token.length + 2)
+			return -ENOBUFS;
+
+		pos += wfd_rtsp_token_copy(line, &token, &buf[pos]) + 1;
+		++num;
+	}
+
+	if (pos >= size)
+		return -ENOBUFS;
+
+	buf[pos] = 0;
+	return num;
+}
+
 _shl_public_
 ssize_t wfd_rtsp_tokenize(const char *line, ssize_t len, char **out)
 {
-	char *t, *dst, c, prev, last_c;
-	const char *src;
-	size_t num;
-	bool quoted, escaped;
+	char *t;
+	ssize_t num;
 
 	if (!line || !out)
 		return -EINVAL;
@@ -62,128 +337,10 @@ ssize_t wfd_rtsp_tokenize(const char *line, ssize_t len, char **out)
 	if (!t)
 		return -ENOMEM;
 
-	num = 0;
-	src = line;
-	dst = t;
-	quoted = false;
-	escaped = false;
-	prev = 0;
-	last_c = 0;
-
-	for ( ; len > 0; --len) {
-		c = *src++;
-		prev = last_c;
-		last_c = 0;
-
-		if (quoted) {
-			if (escaped) {
-				last_c = c;
-				if (c == '\\') {
-					*dst++ = '\\';
-				} else if (c == '"') {
-					*dst++ = '"';
-				} else if (c == 'n') {
-					*dst++ = '\n';
-				} else if (c == 'r') {
-					*dst++ = '\r';
-				} else if (c == 't') {
-					*dst++ = '\t';
-				} else if (c == 'a') {
-					*dst++ = '\a';
-				} else if (c == 'f') {
-					*dst++ = '\f';
-				} else if (c == 'v') {
-					*dst++ = '\v';
-				} else if (c == 'b') {
-					*dst++ = '\b';
-				} else if (c == 'e') {
-					*dst++ = 0x1b;	/* ESC */
-				} else if (c == 0) {
-					/* turn escaped binary 0 into \0 */
-					*dst++ = '\\';
-					*dst++ = '0';
-					last_c = '0';
-				} else {
-					/* keep unknown escape sequences */
-					*dst++ = '\\';
-					*dst++ = c;
-				}
-				escaped = false;
-			} else {
-				if (c == '"') {
-					*dst++ = 0;
-					++num;
-					quoted = false;
-				} else if (c == '\\') {
-					escaped = true;
-					last_c = prev;
-				} else if (c == 0) {
-					/* discard */
-					last_c = prev;
-				} else {
-					*dst++ = c;
-					last_c = c;
-				}
-			}
-		} else {
-			if (c == '"') {
-				if (prev) {
-					*dst++ = 0;
-					++num;
-				}
-				quoted = true;
-			} else if (c == 0) {
-				/* discard */
-				last_c = prev;
-			} else if (c == ' ' ||
-				   c == '\t' ||
-				   c == '\n' ||
-				   c == '\r') {
-				if (prev) {
-					*dst++ = 0;
-					++num;
-				}
-			} else if (c == '(' ||
-				   c == ')' ||
-				   c == '[' ||
-				   c == ']' ||
-				   c == '{' ||
-				   c == '}' ||
-				   c == '<' ||
-				   c == '>' ||
-				   c == '@' ||
-				   c == ',' ||
-				   c == ';' ||
-				   c == ':' ||
-				   c == '\\' ||
-				   c == '/' ||
-				   c == '?' ||
-				   c == '=') {
-				if (prev) {
-					*dst++ = 0;
-					++num;
-				}
-				*dst++ = c;
-				*dst++ = 0;
-				++num;
-			} else if (c <= 31 || c == 127) {
-				/* ignore CTLs */
-				if (prev) {
-					*dst++ = 0;
-					++num;
-				}
-			} else {
-				*dst++ = c;
-				last_c = c;
-			}
-		}
-	}
-
-	if (last_c || quoted) {
-		if (escaped)
-			*dst++ = '\\';
-		*dst++ = 0;
-		++num;
+	num = wfd_rtsp_tokenize_buf(line, len, t, 2 * (len + 1));
+	if (num < 0) {
+		free(t);
+		return num;
 	}
 
 	*out = t;
@@ -0,0 +1,184 @@
+/*
+ * SHL - Arena Allocator
+ *
+ * Copyright (c) 2011-2014 David Herrmann <dh.herrmann@gmail.com>
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Arena Allocator
+ * The arena is a list of chunks, the newest chunk is the current one and
+ * allocations are carved from it linearly. If it is full, a new chunk of at
+ * least twice the size is allocated.
+ * A reset with just one chunk only rewinds its fill-level, which is O(1). If
+ * more than one chunk was needed, all of them are freed and the next chunk is
+ * allocated big enough to hold everything at once. Hence, after a few rounds
+ * the arena settles at a single chunk and stops calling into malloc().
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shl_arena.h"
+#include "shl_macro.h"
+
+#define ARENA_ALIGN (sizeof(void*) * 2)
+#define ARENA_MIN_CHUNK 4096
+#define ARENA_MAX_KEEP (256 * 1024)
+
+struct shl_arena_chunk {
+	struct shl_arena_chunk *prev;
+	size_t size;
+	size_t used;
+	uint8_t data[] __attribute__((__aligned__(ARENA_ALIGN)));
+};
+
+static size_t arena_align(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static struct shl_arena_chunk *arena_grow(struct shl_arena *a, size_t size)
+{
+	struct shl_arena_chunk *c;
+	size_t nsize;
+
+	nsize = shl_max_t(size_t, a->hint, ARENA_MIN_CHUNK);
+	if (a->chunk)
+		nsize = shl_max(nsize, a->chunk->size * 2);
+	if (nsize < size)
+		nsize = SHL_ALIGN_POWER2(size);
+	if (!nsize)
+		return NULL;
+
+	c = malloc(sizeof(*c) + nsize);
+	if (!c)
+		return NULL;
+
+	c->prev = a->chunk;
+	c->size = nsize;
+	c->used = 0;
+	a->chunk = c;
+	a->hint = 0;
+
+	return c;
+}
+
+void *shl_arena_alloc(struct shl_arena *a, size_t size)
+{
+	struct shl_arena_chunk *c;
+	void *p;
+
+	size = arena_align(size ? : 1);
+	if (!size)
+		return NULL;
+
+	c = a->chunk;
+	if (!c || c->size - c->used < size) {
+		c = arena_grow(a, size);
+		if (!c)
+			return NULL;
+	}
+
+	p = &c->data[c->used];
+	c->used += size;
+	a->last = p;
+
+	return p;
+}
+
+void *shl_arena_alloc0(struct shl_arena *a, size_t size)
+{
+	void *p;
+
+	p = shl_arena_alloc(a, size);
+	if (p)
+		memset(p, 0, size);
+
+	return p;
+}
+
+void *shl_arena_realloc(struct shl_arena *a, void *ptr, size_t old, size_t size)
+{
+	struct shl_arena_chunk *c = a->chunk;
+	size_t off, nsize;
+	void *p;
+
+	if (!ptr)
+		return shl_arena_alloc(a, size);
+
+	/* the last allocation can be resized in-place if there's room */
+	if (ptr == a->last) {
+		off = (uint8_t*)ptr - c->data;
+		nsize = arena_align(size ? : 1);
+		if (nsize && nsize <= c->size - off) {
+			c->used = off + nsize;
+			return ptr;
+		}
+	}
+
+	if (size <= old)
+		return ptr;
+
+	p = shl_arena_alloc(a, size);
+	if (!p)
+		return NULL;
+
+	memcpy(p, ptr, old);
+	return p;
+}
+
+char *shl_arena_strndup(struct shl_arena *a, const char *str, size_t len)
+{
+	char *p;
+
+	p = shl_arena_alloc(a, len + 1);
+	if (!p)
+		return NULL;
+
+	memcpy(p, str, len);
+	p[len] = 0;
+
+	return p;
+}
+
+void shl_arena_reset(struct shl_arena *a)
+{
+	struct shl_arena_chunk *c;
+	size_t total = 0;
+
+	a->last = NULL;
+	if (!a->chunk)
+		return;
+
+	/* fast-path: single chunk, just rewind it */
+	if (!a->chunk->prev && a->chunk->size <= ARENA_MAX_KEEP) {
+		a->chunk->used = 0;
+		return;
+	}
+
+	/* Multiple chunks were needed. Free them all and make sure the next
+	 * chunk can hold everything we had. A single huge round must not pin
+	 * its memory forever, though, so we never keep more than
+	 * ARENA_MAX_KEEP bytes around. */
+	while ((c = a->chunk)) {
+		a->chunk = c->prev;
+		total += c->size;
+		free(c);
+	}
+
+	a->hint = shl_min_t(size_t, total, ARENA_MAX_KEEP);
+}
+
+void shl_arena_clear(struct shl_arena *a)
+{
+	struct shl_arena_chunk *c;
+
+	while ((c = a->chunk)) {
+		a->chunk = c->prev;
+		free(c);
+	}
+
+	memset(a, 0, sizeof(*a));
+}
@@ -0,0 +1,48 @@
+/*
+ * SHL - Arena Allocator
+ *
+ * Copyright (c) 2011-2014 David Herrmann <dh.herrmann@gmail.com>
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Arena Allocator
+ * Bump-allocator for objects that share a common lifetime. Allocations are
+ * never freed individually; instead, the whole arena is reset at once. A reset
+ * keeps the backing memory around, so an arena that is reused for objects of
+ * similar size stops allocating from the heap after the first round.
+ */
+
+#ifndef SHL_ARENA_H
+#define SHL_ARENA_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+struct shl_arena_chunk;
+
+struct shl_arena {
+	struct shl_arena_chunk *chunk;	/* current chunk or NULL */
+	void *last;			/* last allocation, or NULL */
+	size_t hint;			/* minimum size of next chunk */
+};
+
+/* allocate @size bytes of uninitialized, aligned memory */
+void *shl_arena_alloc(struct shl_arena *a, size_t size);
+
+/* same as shl_arena_alloc() but zero the memory */
+void *shl_arena_alloc0(struct shl_arena *a, size_t size);
+
+/* resize @ptr from @old to @size bytes; extends in-place if possible */
+void *shl_arena_realloc(struct shl_arena *a, void *ptr, size_t old, size_t size);
+
+/* copy @len bytes of @str into the arena and zero-terminate it */
+char *shl_arena_strndup(struct shl_arena *a, const char *str, size_t len);
+
+/* drop all allocations but keep backing memory for reuse */
+void shl_arena_reset(struct shl_arena *a);
+
+/* drop all allocations and free backing memory */
+void shl_arena_clear(struct shl_arena *a);
+
+#endif  /* SHL_ARENA_H */
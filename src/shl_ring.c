@@ -120,26 +120,40 @@ static int ring_resize(struct shl_ring *r, size_t nsize)
 }
 
 /*
- * Resize ring-buffer to provide enough room for @add bytes of new data. This
- * resizes the buffer if it is too small. It returns -ENOMEM on OOM and 0 on
- * success.
+ * Return the size the ring-buffer will have after pushing @add bytes of new
+ * data. This is the current size if there's enough room, and 0 if the size
+ * overflows.
  */
-static int ring_grow(struct shl_ring *r, size_t add)
+size_t shl_ring_get_push_size(struct shl_ring *r, size_t add)
 {
 	size_t need;
 
 	if (r->size - r->used >= add)
-		return 0;
+		return r->size;
 
 	need = r->used + add;
 	if (need <= r->used)
-		return -ENOMEM;
+		return 0;
 	else if (need < 4096)
 		need = 4096;
 
-	need = SHL_ALIGN_POWER2(need);
+	return SHL_ALIGN_POWER2(need);
+}
+
+/*
+ * Resize ring-buffer to provide enough room for @add bytes of new data. This
+ * resizes the buffer if it is too small. It returns -ENOMEM on OOM and 0 on
+ * success.
+ */
+static int ring_grow(struct shl_ring *r, size_t add)
+{
+	size_t need;
+
+	need = shl_ring_get_push_size(r, add);
 	if (need == 0)
 		return -ENOMEM;
+	else if (need == r->size)
+		return 0;
 
 	return ring_resize(r, need);
 }
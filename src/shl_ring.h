@@ -40,6 +40,9 @@ size_t shl_ring_copy(struct shl_ring *r, void *buf, size_t size);
 /* push data to the end of the buffer */
 int shl_ring_push(struct shl_ring *r, const void *u8, size_t size);
 
+/* return buffer size after pushing @add bytes, or 0 on overflow */
+size_t shl_ring_get_push_size(struct shl_ring *r, size_t add);
+
 /* pull data from the front of the buffer */
 void shl_ring_pull(struct shl_ring *r, size_t size);
 
@@ -0,0 +1,382 @@
+/*
+ * SHL - Delimiter Scanner
+ *
+ * Copyright (c) 2011-2014 David Herrmann <dh.herrmann@gmail.com>
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Delimiter Scanner
+ * Each implementation classifies the input in blocks. For every block, it
+ * produces a bitmask with one bit per input byte which is set if the byte is
+ * part of the scan-set. The first set bit (or first cleared bit, if inverted)
+ * is the position we look for. Trailing bytes that don't fill a whole block are
+ * handled by the scalar scanner.
+ * Scan-tables use the same scheme, but classify blocks via byte-shuffles of the
+ * nibble tables. Shuffles need SSSE3, so the SSE2 level falls back to the
+ * scalar table scanner on CPUs without it.
+ * The implementation is selected at runtime during library initialization,
+ * based on the features of the running CPU.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "shl_macro.h"
+#include "shl_scan.h"
+
+#if defined(BUILD_ENABLE_SIMD) && (defined(__x86_64__) || defined(__i386__))
+#  define SHL_SCAN_X86 1
+#  include <immintrin.h>
+#endif
+
+typedef size_t (*scan_fn) (const struct shl_scan *set,
+			   const uint8_t *buf,
+			   size_t len,
+			   bool invert);
+
+typedef size_t (*scan_table_fn) (const struct shl_scan_table *table,
+				 const uint8_t *buf,
+				 size_t len,
+				 bool invert);
+
+/*
+ * Scalar Scanner
+ * We build a 256bit lookup-table of the scan-set on the stack and test each
+ * byte against it. Used as fallback and for block-tails.
+ */
+
+static size_t scan_scalar(const struct shl_scan *set,
+			  const uint8_t *buf,
+			  size_t len,
+			  bool invert)
+{
+	uint64_t table[4] = { };
+	unsigned int j;
+	size_t i;
+	bool hit;
+
+	for (j = 0; j < set->num; ++j)
+		table[set->bytes[j] >> 6] |= 1ULL << (set->bytes[j] & 63);
+
+	for (i = 0; i < len; ++i) {
+		hit = table[buf[i] >> 6] & (1ULL << (buf[i] & 63));
+		if (hit != invert)
+			break;
+	}
+
+	return i;
+}
+
+static size_t scan_table_scalar(const struct shl_scan_table *table,
+				const uint8_t *buf,
+				size_t len,
+				bool invert)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		if (shl_scan_table_has(table, buf[i]) != invert)
+			break;
+
+	return i;
+}
+
+#ifdef SHL_SCAN_X86
+
+/*
+ * SSE2 Scanner
+ * Classify 16 bytes at a time. One compare per scan-set byte, OR'ed together
+ * and reduced to a 16bit mask.
+ */
+
+__attribute__((__target__("sse2")))
+static inline uint32_t sse2_classify(const __m128i *needles,
+				     unsigned int num,
+				     const uint8_t *p)
+{
+	__m128i v, m;
+	unsigned int j;
+
+	v = _mm_loadu_si128((const __m128i*)p);
+	m = _mm_setzero_si128();
+	for (j = 0; j < num; ++j)
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, needles[j]));
+
+	return _mm_movemask_epi8(m);
+}
+
+__attribute__((__target__("sse2")))
+static size_t scan_sse2(const struct shl_scan *set,
+			const uint8_t *buf,
+			size_t len,
+			bool invert)
+{
+	__m128i needles[SHL_SCAN_MAX];
+	uint32_t mask, flip;
+	unsigned int j;
+	size_t i;
+
+	flip = invert ? 0xffff : 0;
+	for (j = 0; j < set->num; ++j)
+		needles[j] = _mm_set1_epi8(set->bytes[j]);
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		mask = sse2_classify(needles, set->num, &buf[i]) ^ flip;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + scan_scalar(set, &buf[i], len - i, invert);
+}
+
+/*
+ * SSSE3 Table Scanner
+ * The low nibble of each byte selects an entry of both nibble tables, the high
+ * nibble selects the table and the bit to test.
+ */
+
+__attribute__((__target__("ssse3")))
+static size_t scan_table_ssse3(const struct shl_scan_table *table,
+			       const uint8_t *buf,
+			       size_t len,
+			       bool invert)
+{
+	__m128i lo_tbl, hi_tbl, bits, nib, seven, zero, v, lo, hi, sel, r;
+	uint32_t mask, flip;
+	size_t i;
+
+	flip = invert ? 0 : 0xffff;
+	lo_tbl = _mm_loadu_si128((const __m128i*)table->nibbles[0]);
+	hi_tbl = _mm_loadu_si128((const __m128i*)table->nibbles[1]);
+	bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+			     1, 2, 4, 8, 16, 32, 64, -128);
+	nib = _mm_set1_epi8(0x0f);
+	seven = _mm_set1_epi8(7);
+	zero = _mm_setzero_si128();
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i*)&buf[i]);
+		lo = _mm_and_si128(v, nib);
+		hi = _mm_and_si128(_mm_srli_epi16(v, 4), nib);
+
+		sel = _mm_cmpgt_epi8(hi, seven);
+		r = _mm_or_si128(_mm_and_si128(sel, _mm_shuffle_epi8(hi_tbl, lo)),
+				 _mm_andnot_si128(sel, _mm_shuffle_epi8(lo_tbl, lo)));
+		r = _mm_and_si128(r, _mm_shuffle_epi8(bits, hi));
+
+		/* bytes not in the set compare equal to zero */
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(r, zero)) ^ flip;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + scan_table_scalar(table, &buf[i], len - i, invert);
+}
+
+/*
+ * AVX2 Scanner
+ * Same as SSE2, but classifies 32 bytes at a time.
+ */
+
+__attribute__((__target__("avx2")))
+static inline uint32_t avx2_classify(const __m256i *needles,
+				     unsigned int num,
+				     const uint8_t *p)
+{
+	__m256i v, m;
+	unsigned int j;
+
+	v = _mm256_loadu_si256((const __m256i*)p);
+	m = _mm256_setzero_si256();
+	for (j = 0; j < num; ++j)
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, needles[j]));
+
+	return _mm256_movemask_epi8(m);
+}
+
+__attribute__((__target__("avx2")))
+static size_t scan_avx2(const struct shl_scan *set,
+			const uint8_t *buf,
+			size_t len,
+			bool invert)
+{
+	__m256i needles[SHL_SCAN_MAX];
+	uint32_t mask, flip;
+	unsigned int j;
+	size_t i;
+
+	flip = invert ? 0xffffffff : 0;
+	for (j = 0; j < set->num; ++j)
+		needles[j] = _mm256_set1_epi8(set->bytes[j]);
+
+	for (i = 0, mask = 0; i + 32 <= len; i += 32) {
+		mask = avx2_classify(needles, set->num, &buf[i]) ^ flip;
+		if (mask)
+			break;
+	}
+
+	/* Leave with clean upper YMM state to avoid AVX-SSE transition
+	 * penalties in the caller and the scalar tail. GCC inserts vzeroupper
+	 * on returns, but not before calling the tail, so all exits share
+	 * this explicit one. */
+	_mm256_zeroupper();
+	if (mask)
+		return i + __builtin_ctz(mask);
+
+	return i + scan_scalar(set, &buf[i], len - i, invert);
+}
+
+__attribute__((__target__("avx2")))
+static size_t scan_table_avx2(const struct shl_scan_table *table,
+			      const uint8_t *buf,
+			      size_t len,
+			      bool invert)
+{
+	__m256i lo_tbl, hi_tbl, bits, nib, seven, zero, v, lo, hi, sel, r;
+	uint32_t mask, flip;
+	size_t i;
+
+	/* shuffles work per 128bit lane, so both lanes get the same tables */
+	flip = invert ? 0 : 0xffffffff;
+	lo_tbl = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)table->nibbles[0]));
+	hi_tbl = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)table->nibbles[1]));
+	bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+				1, 2, 4, 8, 16, 32, 64, -128,
+				1, 2, 4, 8, 16, 32, 64, -128,
+				1, 2, 4, 8, 16, 32, 64, -128);
+	nib = _mm256_set1_epi8(0x0f);
+	seven = _mm256_set1_epi8(7);
+	zero = _mm256_setzero_si256();
+
+	for (i = 0, mask = 0; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((const __m256i*)&buf[i]);
+		lo = _mm256_and_si256(v, nib);
+		hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nib);
+
+		sel = _mm256_cmpgt_epi8(hi, seven);
+		r = _mm256_blendv_epi8(_mm256_shuffle_epi8(lo_tbl, lo),
+				       _mm256_shuffle_epi8(hi_tbl, lo),
+				       sel);
+		r = _mm256_and_si256(r, _mm256_shuffle_epi8(bits, hi));
+
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(r, zero)) ^ flip;
+		if (mask)
+			break;
+	}
+
+	/* see scan_avx2() */
+	_mm256_zeroupper();
+	if (mask)
+		return i + __builtin_ctz(mask);
+
+	/* AVX2 implies SSSE3; the tail of short runs is still worth a block */
+	return i + scan_table_ssse3(table, &buf[i], len - i, invert);
+}
+
+#endif /* SHL_SCAN_X86 */
+
+/*
+ * Runtime Dispatch
+ */
+
+static const scan_fn scan_impls[] = {
+	[SHL_SCAN_SCALAR]	= scan_scalar,
+#ifdef SHL_SCAN_X86
+	[SHL_SCAN_SSE2]		= scan_sse2,
+	[SHL_SCAN_AVX2]		= scan_avx2,
+#endif
+	[SHL_SCAN_CNT]		= NULL,
+};
+
+static const scan_table_fn scan_table_impls[] = {
+	[SHL_SCAN_SCALAR]	= scan_table_scalar,
+#ifdef SHL_SCAN_X86
+	[SHL_SCAN_SSE2]		= scan_table_ssse3,
+	[SHL_SCAN_AVX2]		= scan_table_avx2,
+#endif
+	[SHL_SCAN_CNT]		= NULL,
+};
+
+static unsigned int scan_impl = SHL_SCAN_SCALAR;
+static scan_fn scan_cur = scan_scalar;
+static scan_table_fn scan_table_cur = scan_table_scalar;
+
+static bool scan_is_supported(unsigned int impl)
+{
+	switch (impl) {
+	case SHL_SCAN_SCALAR:
+		return true;
+#ifdef SHL_SCAN_X86
+	case SHL_SCAN_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case SHL_SCAN_AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return false;
+	}
+}
+
+int shl_scan_select(unsigned int impl)
+{
+	if (impl >= SHL_SCAN_CNT || !scan_impls[impl])
+		return -ENOTSUP;
+	if (!scan_is_supported(impl))
+		return -ENOTSUP;
+
+	scan_impl = impl;
+	scan_cur = scan_impls[impl];
+	scan_table_cur = scan_table_impls[impl];
+
+#ifdef SHL_SCAN_X86
+	if (impl == SHL_SCAN_SSE2 && !__builtin_cpu_supports("ssse3"))
+		scan_table_cur = scan_table_scalar;
+#endif
+
+	return 0;
+}
+
+unsigned int shl_scan_get_impl(void)
+{
+	return scan_impl;
+}
+
+__attribute__((__constructor__))
+static void scan_init(void)
+{
+#ifdef SHL_SCAN_X86
+	__builtin_cpu_init();
+#endif
+
+	if (shl_scan_select(SHL_SCAN_AVX2) < 0 &&
+	    shl_scan_select(SHL_SCAN_SSE2) < 0)
+		shl_scan_select(SHL_SCAN_SCALAR);
+}
+
+size_t shl_scan_any(const struct shl_scan *set, const void *buf, size_t len)
+{
+	return scan_cur(set, buf, len, false);
+}
+
+size_t shl_scan_none(const struct shl_scan *set, const void *buf, size_t len)
+{
+	return scan_cur(set, buf, len, true);
+}
+
+size_t shl_scan_table_any(const struct shl_scan_table *table,
+			  const void *buf,
+			  size_t len)
+{
+	return scan_table_cur(table, buf, len, false);
+}
+
+size_t shl_scan_table_none(const struct shl_scan_table *table,
+			   const void *buf,
+			   size_t len)
+{
+	return scan_table_cur(table, buf, len, true);
+}
@@ -0,0 +1,85 @@
+/*
+ * SHL - Delimiter Scanner
+ *
+ * Copyright (c) 2011-2014 David Herrmann <dh.herrmann@gmail.com>
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Delimiter Scanner
+ * Text-based protocols usually only care about a handful of delimiter bytes.
+ * A scan-set describes up to SHL_SCAN_MAX such bytes and the scanners search a
+ * buffer for the first byte that is (or is not) part of the set. Depending on
+ * the CPU, the buffer is classified in 16 or 32 byte blocks via SIMD
+ * instructions, with a scalar fallback for everything else.
+ *
+ * Scan-tables describe arbitrary byte-sets. They're stored as two nibble
+ * tables so the SIMD scanners can classify a block with byte-shuffles,
+ * regardless of how many bytes are in the set.
+ */
+
+#ifndef SHL_SCAN_H
+#define SHL_SCAN_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define SHL_SCAN_MAX 8
+
+struct shl_scan {
+	unsigned int num;		/* number of valid bytes in @bytes */
+	uint8_t bytes[SHL_SCAN_MAX];	/* delimiter bytes */
+};
+
+/* initialize scan-set statically from a string literal */
+#define SHL_SCAN_INIT(_str) \
+	{ .num = sizeof(_str) - 1, .bytes = _str }
+
+struct shl_scan_table {
+	/* bit (b >> 4) & 7 of nibbles[b >> 7][b & 0xf] is set if b is in set */
+	uint8_t nibbles[2][16];
+};
+
+static inline void shl_scan_table_add(struct shl_scan_table *table,
+				      uint8_t byte)
+{
+	table->nibbles[byte >> 7][byte & 0xf] |= 1U << ((byte >> 4) & 7);
+}
+
+static inline bool shl_scan_table_has(const struct shl_scan_table *table,
+				      uint8_t byte)
+{
+	return table->nibbles[byte >> 7][byte & 0xf] & (1U << ((byte >> 4) & 7));
+}
+
+enum shl_scan_impl {
+	SHL_SCAN_SCALAR,
+	SHL_SCAN_SSE2,
+	SHL_SCAN_AVX2,
+	SHL_SCAN_CNT
+};
+
+/* select scanner implementation; fails with -ENOTSUP if not available */
+int shl_scan_select(unsigned int impl);
+
+/* return currently selected scanner implementation */
+unsigned int shl_scan_get_impl(void);
+
+/* return offset of first byte in @buf which is in @set, or @len */
+size_t shl_scan_any(const struct shl_scan *set, const void *buf, size_t len);
+
+/* return offset of first byte in @buf which is not in @set, or @len */
+size_t shl_scan_none(const struct shl_scan *set, const void *buf, size_t len);
+
+/* same as shl_scan_any() but for scan-tables */
+size_t shl_scan_table_any(const struct shl_scan_table *table,
+			  const void *buf,
+			  size_t len);
+
+/* same as shl_scan_none() but for scan-tables */
+size_t shl_scan_table_none(const struct shl_scan_table *table,
+			   const void *buf,
+			   size_t len);
+
+#endif  /* SHL_SCAN_H */
@@ -0,0 +1,118 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Benchmark Helper
+ * Small helpers shared by all benchmarks. Benchmarks are plain programs that
+ * print their results to stdout. They don't depend on "check" and are never
+ * run as part of the test-suite.
+ * On x86 we measure CPU cycles via the time-stamp counter, everywhere else we
+ * fall back to nanoseconds.
+ */
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "libwfd.h"
+#include "shl_macro.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#  define BENCH_UNIT "cycle"
+#else
+#  define BENCH_UNIT "ns"
+#endif
+
+/* store results here so the compiler cannot drop benchmarked code */
+static volatile size_t bench_sink;
+
+static inline uint64_t bench_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t bench_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return bench_nsec();
+#endif
+}
+
+struct bench {
+	const char *name;
+	uint64_t ticks;
+	uint64_t nsec;
+};
+
+static inline void bench_start(struct bench *b, const char *name)
+{
+	b->name = name;
+	b->nsec = bench_nsec();
+	b->ticks = bench_ticks();
+}
+
+static inline void bench_stop(struct bench *b, size_t bytes, size_t ops)
+{
+	double t, ns;
+
+	b->ticks = bench_ticks() - b->ticks;
+	b->nsec = bench_nsec() - b->nsec;
+
+	t = b->ticks ? b->ticks : 1;
+	ns = b->nsec ? b->nsec : 1;
+
+	/* benchmarks without a byte count (lookups, ..) report op rates */
+	if (!bytes) {
+		printf("%-32s %10.1f %s/op    %10.3f Mops/s %10.1f ns/op\n",
+		       b->name,
+		       ops ? t / ops : 0.0,
+		       BENCH_UNIT,
+		       ops / ns * 1000.0,
+		       ops ? ns / ops : 0.0);
+		return;
+	}
+
+	printf("%-32s %10.3f bytes/%s %10.1f MiB/s %10.1f ns/op\n",
+	       b->name,
+	       bytes / t,
+	       BENCH_UNIT,
+	       bytes / ns * 1000000000.0 / (1024.0 * 1024.0),
+	       ops ? ns / ops : 0.0);
+}
+
+#endif /* BENCH_COMMON_H */
@@ -0,0 +1,746 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * RTSP Benchmark
+ * Micro-benchmarks for the RTSP helpers. Each benchmark compares the library
+ * implementation against a straightforward reference implementation on inputs
+ * that resemble real WFD traffic.
+ */
+
+#include "bench_common.h"
+#include "shl_scan.h"
+
+#define BENCH_ROUNDS 1000000
+
+/*
+ * Name Lookup
+ * Header names as they show up in a typical WFD session (M1-M16), including
+ * lower-case variants and extension headers we don't know about.
+ */
+
+static const char *lookup_names[] = {
+	"CSeq",
+	"Content-Type",
+	"Content-Length",
+	"Session",
+	"CSeq",
+	"Public",
+	"Require",
+	"Transport",
+	"cseq",
+	"Date",
+	"Server",
+	"User-Agent",
+	"CSeq",
+	"Session",
+	"WFD-Capability",
+	"content-length",
+};
+
+static unsigned int ref_header_from_name(const char *header)
+{
+	const char *name;
+	unsigned int i;
+
+	for (i = 0; i < WFD_RTSP_HEADER_CNT; ++i) {
+		name = wfd_rtsp_header_get_name(i);
+		if (name && !strcasecmp(header, name))
+			return i;
+	}
+
+	return WFD_RTSP_HEADER_UNKNOWN;
+}
+
+static void bench_lookup(void)
+{
+	struct bench b;
+	size_t i, n, bytes;
+	unsigned int sum;
+
+	bytes = 0;
+	for (i = 0; i < SHL_ARRAY_LENGTH(lookup_names); ++i)
+		bytes += strlen(lookup_names[i]);
+
+	n = BENCH_ROUNDS * SHL_ARRAY_LENGTH(lookup_names);
+
+	sum = 0;
+	bench_start(&b, "header lookup: linear");
+	for (i = 0; i < n; ++i)
+		sum += ref_header_from_name(lookup_names[i % SHL_ARRAY_LENGTH(lookup_names)]);
+	bench_stop(&b, bytes * BENCH_ROUNDS, n);
+	bench_sink += sum;
+
+	sum = 0;
+	bench_start(&b, "header lookup: perfect-hash");
+	for (i = 0; i < n; ++i)
+		sum += wfd_rtsp_header_from_name(lookup_names[i % SHL_ARRAY_LENGTH(lookup_names)]);
+	bench_stop(&b, bytes * BENCH_ROUNDS, n);
+	bench_sink += sum;
+}
+
+/*
+ * Tokenizer
+ * Lines of a SET_PARAMETER body as sent by a WFD source during capability
+ * negotiation. Most parameter values are short, but EDIDs and URIs result in
+ * long runs of plain token characters. Each line is tokenized with every
+ * scanner implementation. The reference is the tokenizer as it was before the
+ * class table: a comparison chain per byte.
+ */
+
+#define TOKENIZE_ROUNDS 100000
+
+static const char *tokenize_lines[] = {
+	"wfd_video_formats: 00 00 02 10 0001FFFF 1FFFFFFF 00000FFF 00 0000 0000 00 none none",
+	"wfd_audio_codecs: LPCM 00000003 00, AAC 00000001 00",
+	"wfd_presentation_URL: rtsp://192.168.173.80/wfd1.0/streamid=0 none",
+	"wfd_client_rtp_ports: RTP/AVP/UDP;unicast 19000 0 mode=play",
+	"wfd_display_edid: 0001 "
+	"00ffffffffffff007942bdf22106f0847762f0f3cb4d764dc7072051159a0f89"
+	"f2c6dacae344bb311245fd6f84df9ad7c5b3d076ac0e8f53a7356c88913f20f6"
+	"f72db022d24d0a96dad43c1617c1a98e78129e0327371065d095864f15ada0b8"
+	"46c1c0ebc5348adc799adf849bad05d4a10ac0441eaaeeb4b48efa0b1f0abd80",
+	"wfd_content_protection: HDCP2.1 port=1189",
+	"wfd_coupled_sink: 00 none",
+	"wfd_uibc_capability: input_category_list=GENERIC;generic_cap_list=Keyboard, Mouse;hidc_cap_list=none;port=none",
+	"wfd_standby_resume_capability: supported",
+};
+
+static bool ref_token_special(char c)
+{
+	switch (c) {
+	case '(':
+	case ')':
+	case '[':
+	case ']':
+	case '{':
+	case '}':
+	case '<':
+	case '>':
+	case '@':
+	case ',':
+	case ';':
+	case ':':
+	case '\\':
+	case '/':
+	case '?':
+	case '=':
+		return true;
+	}
+
+	return false;
+}
+
+static bool ref_token_space(char c)
+{
+	return c == ' ' || (c > 0 && c <= 31) || c == 127;
+}
+
+static ssize_t ref_tokenize_buf(const char *line,
+				size_t len,
+				char *buf,
+				size_t size)
+{
+	struct wfd_rtsp_token t;
+	size_t pos, out, num;
+
+	num = 0;
+	out = 0;
+	pos = 0;
+
+	for (;;) {
+		while (pos < len && (!line[pos] || ref_token_space(line[pos])))
+			++pos;
+		if (pos >= len)
+			break;
+
+		t.offset = pos;
+		t.flags = 0;
+
+		if (ref_token_special(line[pos])) {
+			t.flags |= WFD_RTSP_TOKEN_SPECIAL;
+			++pos;
+		} else if (line[pos] == '"') {
+			t.flags |= WFD_RTSP_TOKEN_QUOTED;
+			t.offset = ++pos;
+			for ( ; pos < len && line[pos] != '"'; ++pos) {
+				if (line[pos] == '\\') {
+					t.flags |= WFD_RTSP_TOKEN_ESCAPED;
+					if (++pos >= len)
+						break;
+				} else if (!line[pos]) {
+					t.flags |= WFD_RTSP_TOKEN_ESCAPED;
+				}
+			}
+		} else {
+			for ( ; pos < len; ++pos) {
+				if (!line[pos])
+					t.flags |= WFD_RTSP_TOKEN_ESCAPED;
+				else if (ref_token_space(line[pos]) ||
+					 ref_token_special(line[pos]) ||
+					 line[pos] == '"')
+					break;
+			}
+		}
+
+		t.length = pos - t.offset;
+		if ((t.flags & WFD_RTSP_TOKEN_QUOTED) && pos < len)
+			++pos;
+
+		if (size - out < t.length + 2)
+			return -ENOBUFS;
+
+		out += wfd_rtsp_token_copy(line, &t, &buf[out]) + 1;
+		++num;
+	}
+
+	buf[out] = 0;
+	return num;
+}
+
+static const char *tokenize_impls[] = {
+	[SHL_SCAN_SCALAR]	= "tokenize: scalar",
+	[SHL_SCAN_SSE2]		= "tokenize: sse2",
+	[SHL_SCAN_AVX2]		= "tokenize: avx2",
+};
+
+static void bench_tokenize(void)
+{
+	static char buf[4096];
+	struct bench b;
+	size_t i, j, n, bytes, lens[SHL_ARRAY_LENGTH(tokenize_lines)];
+	unsigned int impl;
+	ssize_t sum;
+
+	bytes = 0;
+	for (i = 0; i < SHL_ARRAY_LENGTH(tokenize_lines); ++i) {
+		lens[i] = strlen(tokenize_lines[i]);
+		bytes += lens[i];
+	}
+
+	n = TOKENIZE_ROUNDS * SHL_ARRAY_LENGTH(tokenize_lines);
+
+	sum = 0;
+	bench_start(&b, "tokenize: comparison chain");
+	for (i = 0; i < TOKENIZE_ROUNDS; ++i)
+		for (j = 0; j < SHL_ARRAY_LENGTH(tokenize_lines); ++j)
+			sum += ref_tokenize_buf(tokenize_lines[j], lens[j],
+						buf, sizeof(buf));
+	bench_stop(&b, bytes * TOKENIZE_ROUNDS, n);
+	bench_sink += sum;
+
+	for (impl = 0; impl < SHL_SCAN_CNT; ++impl) {
+		if (shl_scan_select(impl) < 0) {
+			printf("%-32s not supported\n", tokenize_impls[impl]);
+			continue;
+		}
+
+		sum = 0;
+		bench_start(&b, tokenize_impls[impl]);
+		for (i = 0; i < TOKENIZE_ROUNDS; ++i)
+			for (j = 0; j < SHL_ARRAY_LENGTH(tokenize_lines); ++j)
+				sum += wfd_rtsp_tokenize_buf(tokenize_lines[j],
+							     lens[j],
+							     buf,
+							     sizeof(buf));
+		bench_stop(&b, bytes * TOKENIZE_ROUNDS, n);
+		bench_sink += sum;
+	}
+}
+
+/*
+ * Header Lines
+ * A peer may send thousands of header lines of the same type. Decode messages
+ * with a growing number of unknown header lines; with linear header storage,
+ * the cost per line must not depend on the number of lines per message.
+ */
+
+#define HEADERS_LINES 200000
+
+static int headers_event(struct wfd_rtsp_decoder *dec,
+			 void *data,
+			 struct wfd_rtsp_decoder_event *ev)
+{
+	size_t *lines = data;
+	const struct wfd_rtsp_msg_header *h;
+
+	if (ev->type == WFD_RTSP_DECODER_MSG) {
+		h = wfd_rtsp_msg_get_header(ev->msg, WFD_RTSP_HEADER_UNKNOWN);
+		*lines += h->count;
+	}
+
+	return 0;
+}
+
+static void bench_headers(void)
+{
+	static const size_t counts[] = { 10, 100, 1000, 10000 };
+	struct wfd_rtsp_decoder *dec;
+	struct bench b;
+	char name[64], *msg;
+	size_t i, j, len, rounds, lines;
+	int r;
+
+	for (i = 0; i < SHL_ARRAY_LENGTH(counts); ++i) {
+		msg = malloc(64 * (counts[i] + 2));
+		if (!msg)
+			abort();
+
+		len = sprintf(msg, "OPTIONS * RTSP/1.0\r\n");
+		for (j = 0; j < counts[i]; ++j)
+			len += sprintf(&msg[len], "X-Header-%zu: value\r\n", j);
+		len += sprintf(&msg[len], "\r\n");
+
+		r = wfd_rtsp_decoder_new(headers_event, &lines, NULL, NULL, &dec);
+		if (r < 0)
+			abort();
+
+		lines = 0;
+		rounds = HEADERS_LINES / counts[i];
+		sprintf(name, "header lines: %zu/msg", counts[i]);
+		bench_start(&b, name);
+		for (j = 0; j < rounds; ++j)
+			wfd_rtsp_decoder_feed(dec, msg, len);
+		bench_stop(&b, len * rounds, lines);
+		bench_sink += lines;
+
+		wfd_rtsp_decoder_free(dec);
+		free(msg);
+	}
+}
+
+/*
+ * Framing
+ * Compare counting buffered frames via the framing scanner with decoding them.
+ * The buffer is a typical mix of keep-alive requests, responses, a parameter
+ * body and interleaved data.
+ */
+
+#define FRAMING_ROUNDS 20000
+
+static const char framing_msgs[] =
+	"GET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+	"CSeq: 5\r\n"
+	"Session: 6B8B4567;timeout=30\r\n"
+	"\r\n"
+	"RTSP/1.0 200 OK\r\n"
+	"CSeq: 5\r\n"
+	"Date: Thu, 16 Oct 2026 12:00:00 GMT\r\n"
+	"\r\n"
+	"SET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+	"CSeq: 6\r\n"
+	"Content-Type: text/parameters\r\n"
+	"Content-Length: 26\r\n"
+	"\r\n"
+	"wfd_trigger_method: PLAY\r\n"
+	"$\000\000\010datadata";
+
+static int framing_event(struct wfd_rtsp_decoder *dec,
+			 void *data,
+			 struct wfd_rtsp_decoder_event *ev)
+{
+	++*(size_t*)data;
+	return 0;
+}
+
+static void bench_framing(void)
+{
+	struct wfd_rtsp_decoder *dec;
+	struct bench b;
+	char *buf;
+	size_t i, len, n;
+	ssize_t r;
+
+	len = sizeof(framing_msgs) - 1;
+	buf = malloc(len * 64);
+	if (!buf)
+		abort();
+	for (i = 0; i < 64; ++i)
+		memcpy(&buf[i * len], framing_msgs, len);
+	len *= 64;
+
+	n = 0;
+	bench_start(&b, "framing: scan");
+	for (i = 0; i < FRAMING_ROUNDS; ++i) {
+		r = wfd_rtsp_frame_scan(buf, len, NULL, SIZE_MAX, NULL);
+		if (r < 0)
+			abort();
+		n += r;
+	}
+	bench_stop(&b, len * FRAMING_ROUNDS, n);
+	bench_sink += n;
+
+	r = wfd_rtsp_decoder_new(framing_event, &n, NULL, NULL, &dec);
+	if (r < 0)
+		abort();
+
+	n = 0;
+	bench_start(&b, "framing: decode");
+	for (i = 0; i < FRAMING_ROUNDS; ++i)
+		wfd_rtsp_decoder_feed(dec, buf, len);
+	bench_stop(&b, len * FRAMING_ROUNDS, n);
+	bench_sink += n;
+
+	wfd_rtsp_decoder_free(dec);
+	free(buf);
+}
+
+/*
+ * Header Interest
+ * Decode responses of a chatty peer with all headers parsed, with only the
+ * headers a session typically looks at, and with all headers indexed lazily.
+ */
+
+#define INTEREST_ROUNDS 20000
+
+static const char interest_msg[] =
+	"RTSP/1.0 200 OK\r\n"
+	"CSeq: 7\r\n"
+	"Date: Thu, 16 Oct 2026 12:00:00 GMT\r\n"
+	"Server: ExampleSink/1.0 (Linux; arm)\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Connection: keep-alive\r\n"
+	"Accept-Language: en-US, en;q=0.5\r\n"
+	"Session: 6B8B4567;timeout=30\r\n"
+	"Transport: RTP/AVP/UDP;unicast;client_port=19000;server_port=5000-5001\r\n"
+	"Via: 1.0 proxy.example.org\r\n"
+	"X-Vendor-Info: build=1234; caps=\"a,b,c\"\r\n"
+	"\r\n";
+
+static void bench_interest(void)
+{
+	static const uint64_t masks[] = {
+		WFD_RTSP_HEADER_MASK_ALL,
+		WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_CSEQ) |
+		WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_SESSION) |
+		WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_CONTENT_TYPE) |
+		WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_TRANSPORT) |
+		WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_PUBLIC),
+		WFD_RTSP_HEADER_MASK_ALL,
+	};
+	static const unsigned int flags[] = {
+		0,
+		0,
+		WFD_RTSP_DECODER_F_LAZY_HEADERS,
+	};
+	static const char *names[] = {
+		"interest: all headers",
+		"interest: session headers",
+		"interest: lazy headers",
+	};
+	struct wfd_rtsp_decoder *dec;
+	struct bench b;
+	size_t i, j, n, len;
+	int r;
+
+	len = sizeof(interest_msg) - 1;
+
+	for (j = 0; j < SHL_ARRAY_LENGTH(masks); ++j) {
+		r = wfd_rtsp_decoder_new(framing_event, &n, NULL, NULL, &dec);
+		if (r < 0)
+			abort();
+		wfd_rtsp_decoder_set_interest(dec, masks[j]);
+		wfd_rtsp_decoder_set_flags(dec, flags[j]);
+
+		n = 0;
+		bench_start(&b, names[j]);
+		for (i = 0; i < INTEREST_ROUNDS; ++i)
+			wfd_rtsp_decoder_feed(dec, interest_msg, len);
+		bench_stop(&b, len * INTEREST_ROUNDS, n);
+		bench_sink += n;
+
+		wfd_rtsp_decoder_free(dec);
+	}
+}
+
+/*
+ * Encoder
+ * Encode a SET_PARAMETER request with a parameter body, as a session does for
+ * each trigger, and hand it out as iovec array. The snprintf() variant is what
+ * users hand-rolled before.
+ */
+
+#define ENCODER_ROUNDS 1000000
+
+static const char encoder_uri[] = "rtsp://localhost/wfd1.0";
+static const char encoder_body[] =
+	"wfd_trigger_method: SETUP\r\n"
+	"wfd_presentation_URL: rtsp://192.168.16.1/wfd1.0/streamid=0 none\r\n";
+
+static void bench_encoder(void)
+{
+	struct wfd_rtsp_encoder *enc;
+	const struct iovec *iov;
+	struct bench b;
+	char buf[512];
+	size_t i, n, len;
+	int r;
+
+	r = wfd_rtsp_encoder_new(NULL, NULL, &enc);
+	if (r < 0)
+		abort();
+
+	len = 0;
+	bench_start(&b, "encoder: iovec");
+	for (i = 0; i < ENCODER_ROUNDS; ++i) {
+		wfd_rtsp_encoder_request(enc, WFD_RTSP_METHOD_SET_PARAMETER,
+					 encoder_uri);
+		wfd_rtsp_encoder_header_u(enc, WFD_RTSP_HEADER_CSEQ, i);
+		wfd_rtsp_encoder_header(enc, WFD_RTSP_HEADER_SESSION,
+					"6B8B4567;timeout=30");
+		wfd_rtsp_encoder_header(enc, WFD_RTSP_HEADER_CONTENT_TYPE,
+					"text/parameters");
+		wfd_rtsp_encoder_end(enc, encoder_body,
+				     sizeof(encoder_body) - 1);
+
+		iov = wfd_rtsp_encoder_get_iov(enc, &n);
+		if (!iov)
+			abort();
+		n = wfd_rtsp_encoder_get_size(enc);
+		len += n;
+		wfd_rtsp_encoder_consume(enc, n);
+	}
+	bench_stop(&b, len, ENCODER_ROUNDS);
+	bench_sink += len;
+
+	wfd_rtsp_encoder_free(enc);
+
+	len = 0;
+	bench_start(&b, "encoder: snprintf");
+	for (i = 0; i < ENCODER_ROUNDS; ++i) {
+		r = snprintf(buf, sizeof(buf),
+			     "SET_PARAMETER %s RTSP/1.0\r\n"
+			     "CSeq: %zu\r\n"
+			     "Session: %s\r\n"
+			     "Content-Type: %s\r\n"
+			     "Content-Length: %zu\r\n"
+			     "\r\n"
+			     "%s",
+			     encoder_uri, i, "6B8B4567;timeout=30",
+			     "text/parameters", sizeof(encoder_body) - 1,
+			     encoder_body);
+		if (r < 0)
+			abort();
+		len += r;
+	}
+	bench_stop(&b, len, ENCODER_ROUNDS);
+	bench_sink += len;
+}
+
+/*
+ * Response Templates
+ * Encode M16 keepalive replies, once via the builders and once from a
+ * template, and send them in one writev() worth of vectors each.
+ */
+
+static void bench_template_send(struct wfd_rtsp_encoder *enc, size_t *len)
+{
+	const struct iovec *iov;
+	size_t n;
+
+	iov = wfd_rtsp_encoder_get_iov(enc, &n);
+	if (!iov)
+		abort();
+	n = wfd_rtsp_encoder_get_size(enc);
+	*len += n;
+	wfd_rtsp_encoder_consume(enc, n);
+}
+
+static void bench_template(void)
+{
+	static const char session[] = "6B8B4567;timeout=30";
+	struct wfd_rtsp_template_value values[2];
+	struct wfd_rtsp_template *tpl;
+	struct wfd_rtsp_encoder *enc;
+	struct bench b;
+	size_t i, len;
+	int r;
+
+	r = wfd_rtsp_encoder_new(NULL, NULL, &enc);
+	if (r < 0)
+		abort();
+
+	len = 0;
+	bench_start(&b, "keepalive reply: builders");
+	for (i = 0; i < ENCODER_ROUNDS; ++i) {
+		wfd_rtsp_encoder_response(enc, WFD_RTSP_STATUS_OK, NULL);
+		wfd_rtsp_encoder_header_u(enc, WFD_RTSP_HEADER_CSEQ, i);
+		wfd_rtsp_encoder_header(enc, WFD_RTSP_HEADER_SESSION, session);
+		wfd_rtsp_encoder_end(enc, NULL, 0);
+		bench_template_send(enc, &len);
+	}
+	bench_stop(&b, len, ENCODER_ROUNDS);
+	bench_sink += len;
+
+	r = wfd_rtsp_template_new(WFD_RTSP_STATUS_OK, NULL, &tpl);
+	if (r < 0 ||
+	    wfd_rtsp_template_add_field(tpl, WFD_RTSP_HEADER_CSEQ) < 0 ||
+	    wfd_rtsp_template_add_field(tpl, WFD_RTSP_HEADER_SESSION) < 0)
+		abort();
+
+	values[1].str = session;
+	values[0].str = NULL;
+
+	len = 0;
+	bench_start(&b, "keepalive reply: template");
+	for (i = 0; i < ENCODER_ROUNDS; ++i) {
+		values[0].num = i;
+		wfd_rtsp_encoder_template(enc, tpl, values, 2, NULL, 0);
+		bench_template_send(enc, &len);
+	}
+	bench_stop(&b, len, ENCODER_ROUNDS);
+	bench_sink += len;
+
+	wfd_rtsp_template_free(tpl);
+	wfd_rtsp_encoder_free(enc);
+}
+
+/*
+ * Session Routing
+ * A server with many active sessions routes each request by its Session
+ * header. The reference compares the id against every session, the table
+ * uses the hash computed by the decoder.
+ */
+
+#define SESSION_COUNT 4096
+#define SESSION_ROUNDS 100000
+
+static void bench_session(void)
+{
+	static char ids[SESSION_COUNT][9];
+	struct wfd_rtsp_session_table *tbl;
+	struct wfd_rtsp_session s[16];
+	struct bench b;
+	size_t i, j, n;
+	uintptr_t sum;
+	int r;
+
+	r = wfd_rtsp_session_table_new(&tbl);
+	if (r < 0)
+		abort();
+
+	for (i = 0; i < SESSION_COUNT; ++i) {
+		sprintf(ids[i], "%08X", (unsigned int)(i * 0x9e3779b1U));
+		if (wfd_rtsp_session_table_add(tbl, ids[i], 8, ids[i]) < 0)
+			abort();
+	}
+
+	/* requests spread over all sessions */
+	for (i = 0; i < SHL_ARRAY_LENGTH(s); ++i)
+		if (wfd_rtsp_session_parse(ids[i * 251 % SESSION_COUNT], 8,
+					   &s[i]) < 0)
+			abort();
+
+	n = SESSION_ROUNDS * SHL_ARRAY_LENGTH(s);
+
+	sum = 0;
+	bench_start(&b, "session routing: linear");
+	for (i = 0; i < n / 100; ++i) {
+		const struct wfd_rtsp_session *v = &s[i % SHL_ARRAY_LENGTH(s)];
+
+		for (j = 0; j < SESSION_COUNT; ++j) {
+			if (!strncmp(ids[j], v->id, v->length) &&
+			    !ids[j][v->length]) {
+				sum += (uintptr_t)ids[j];
+				break;
+			}
+		}
+	}
+	bench_stop(&b, 0, n / 100);
+	bench_sink += sum;
+
+	sum = 0;
+	bench_start(&b, "session routing: table");
+	for (i = 0; i < n; ++i)
+		sum += (uintptr_t)wfd_rtsp_session_table_lookup(tbl,
+					&s[i % SHL_ARRAY_LENGTH(s)]);
+	bench_stop(&b, 0, n);
+	bench_sink += sum;
+
+	wfd_rtsp_session_table_free(tbl);
+}
+
+/*
+ * WFD Parameters
+ * M3 reply of a typical sink. Parsing everything is compared to indexing only
+ * and to parsing just the parameters a source needs for M4.
+ */
+
+#define PARAMS_ROUNDS 1000000
+
+static const char params_body[] =
+	"wfd_audio_codecs: LPCM 00000003 00, AAC 0000000F 00\r\n"
+	"wfd_video_formats: 40 00 02 04 0001FFFF 3FFFFFFF 00000FFF 00 0000 0000 11 none none\r\n"
+	"wfd_3d_video_formats: none\r\n"
+	"wfd_content_protection: HDCP2.1 port=1189\r\n"
+	"wfd_display_edid: none\r\n"
+	"wfd_coupled_sink: none\r\n"
+	"wfd_client_rtp_ports: RTP/AVP/UDP;unicast 19000 0 mode=play\r\n"
+	"wfd_uibc_capability: none\r\n"
+	"wfd_standby_resume_capability: none\r\n"
+	"wfd_connector_type: 05\r\n";
+
+static void bench_params_run(const char *name, uint64_t mask)
+{
+	struct wfd_rtsp_params p;
+	struct bench b;
+	size_t i, sum;
+
+	sum = 0;
+	bench_start(&b, name);
+	for (i = 0; i < PARAMS_ROUNDS; ++i) {
+		wfd_rtsp_params_parse(&p, params_body, sizeof(params_body) - 1,
+				      mask);
+		sum += p.n_params + p.parsed;
+	}
+	bench_stop(&b, (sizeof(params_body) - 1) * PARAMS_ROUNDS,
+		   PARAMS_ROUNDS);
+	bench_sink += sum;
+}
+
+static void bench_params(void)
+{
+	bench_params_run("wfd params: index", 0);
+	bench_params_run("wfd params: M4 subset",
+			 WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_AUDIO_CODECS) |
+			 WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_VIDEO_FORMATS) |
+			 WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_CLIENT_RTP_PORTS));
+	bench_params_run("wfd params: all", WFD_RTSP_PARAM_MASK_ALL);
+}
+
+int main(int argc, char **argv)
+{
+	bench_lookup();
+	bench_tokenize();
+	bench_headers();
+	bench_framing();
+	bench_interest();
+	bench_encoder();
+	bench_template();
+	bench_session();
+	bench_params();
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Scanner Benchmark
+ * Locate all delimiters of the RTSP header states in a buffer of typical WFD
+ * header lines and compare the scalar scanner with the SIMD variants. Each
+ * implementation is run on the same input, the result is printed as bytes per
+ * cycle.
+ */
+
+#include "bench_common.h"
+#include "shl_scan.h"
+
+#define BENCH_ROUNDS 2000
+
+static const char *impl_names[] = {
+	[SHL_SCAN_SCALAR]	= "scan: scalar",
+	[SHL_SCAN_SSE2]		= "scan: sse2",
+	[SHL_SCAN_AVX2]		= "scan: avx2",
+};
+
+static const char *lines[] = {
+	"RTSP/1.0 200 OK\r\n",
+	"CSeq: 12\r\n",
+	"Session: 6B8B4567;timeout=30\r\n",
+	"Transport: RTP/AVP/UDP;unicast;client_port=19000;server_port=5000-5001\r\n",
+	"Content-Type: text/parameters\r\n",
+	"Public: org.wfa.wfd1.0, SET_PARAMETER, GET_PARAMETER, SETUP, PLAY, PAUSE, TEARDOWN\r\n",
+	"User-Agent: \"libwfd benchmark (\\\"quoted\\\" agent)\"\r\n",
+	"\r\n",
+};
+
+static const struct shl_scan scan_header = SHL_SCAN_INIT("\r\n\"");
+
+static char *fill(size_t *out_len)
+{
+	size_t len = 0, max = 64 * 1024, l, i;
+	char *buf;
+
+	buf = malloc(max);
+	if (!buf)
+		abort();
+
+	for (i = 0; ; ++i) {
+		l = strlen(lines[i % SHL_ARRAY_LENGTH(lines)]);
+		if (len + l > max)
+			break;
+
+		memcpy(&buf[len], lines[i % SHL_ARRAY_LENGTH(lines)], l);
+		len += l;
+	}
+
+	*out_len = len;
+	return buf;
+}
+
+static size_t run(const char *buf, size_t len)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < len; ++i) {
+		i += shl_scan_any(&scan_header, &buf[i], len - i);
+		++n;
+	}
+
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench b;
+	unsigned int impl;
+	size_t len, i, n;
+	char *buf;
+
+	buf = fill(&len);
+
+	for (impl = 0; impl < SHL_SCAN_CNT; ++impl) {
+		if (shl_scan_select(impl) < 0) {
+			printf("%-32s not supported\n", impl_names[impl]);
+			continue;
+		}
+
+		n = 0;
+		bench_start(&b, impl_names[impl]);
+		for (i = 0; i < BENCH_ROUNDS; ++i)
+			n += run(buf, len);
+		bench_stop(&b, len * BENCH_ROUNDS, n);
+		bench_sink += n;
+	}
+
+	free(buf);
+	return 0;
+}
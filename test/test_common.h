@@ -37,6 +37,7 @@
 #ifndef TEST_COMMON_H
 #define TEST_COMMON_H
 
+#include <ctype.h>
 #include <errno.h>
 #include <check.h>
 #include <inttypes.h>
@@ -24,17 +24,27 @@
  */
 
 #include "test_common.h"
+#include "rtsp_internal.h"
 
 static int received;
+static int pos, num;
 
 struct orig {
 	ssize_t len;
 	const char *str;
 };
 
+/* same as struct wfd_rtsp_msg but with a header-array indexed by type */
+struct expect_msg {
+	unsigned int type;
+	struct wfd_rtsp_msg_id id;
+	struct wfd_rtsp_msg_header headers[WFD_RTSP_HEADER_CNT];
+	struct wfd_rtsp_msg_entity entity;
+};
+
 struct expect {
 	size_t times;
-	struct wfd_rtsp_msg msg;
+	struct expect_msg msg;
 };
 
 static const struct orig orig[] = {
@@ -324,10 +334,10 @@ static int test_wfd_rtsp_decoder_event(struct wfd_rtsp_decoder *dec,
 				   struct wfd_rtsp_decoder_event *ev)
 {
 	bool debug = true;
-	static int pos, num;
 	size_t i, j;
 	const struct expect *e;
-	const struct wfd_rtsp_msg *m, *msg;
+	const struct expect_msg *m;
+	const struct wfd_rtsp_msg *msg;
 	const struct wfd_rtsp_msg_header *h, *hm;
 
 	if (ev->type == WFD_RTSP_DECODER_DATA) {
@@ -378,13 +388,12 @@ static int test_wfd_rtsp_decoder_event(struct wfd_rtsp_decoder *dec,
 		}
 
 		fprintf(stderr, "  headers:\n");
-		for (i = 0; i < SHL_ARRAY_LENGTH(msg->headers); ++i) {
-			h = &msg->headers[i];
-			if (!h->count)
-				continue;
+		for (i = 0; i < msg->n_headers; ++i) {
+			h = &msg->present_headers[i];
 
-			fprintf(stderr, "    id: %zu %s (count: %zu)\n",
-				i, wfd_rtsp_header_get_name(i) ? : "<unknown>",
+			fprintf(stderr, "    id: %u %s (count: %zu)\n",
+				h->type,
+				wfd_rtsp_header_get_name(h->type) ? : "<unknown>",
 				h->count);
 
 			for (j = 0; j < h->count; ++j) {
@@ -426,10 +435,13 @@ static int test_wfd_rtsp_decoder_event(struct wfd_rtsp_decoder *dec,
 				  msg->id.response.phrase));
 	}
 
-	for (i = 0; i < SHL_ARRAY_LENGTH(msg->headers); ++i) {
+	for (i = 0; i < SHL_ARRAY_LENGTH(m->headers); ++i) {
 		h = &m->headers[i];
-		hm = &msg->headers[i];
+		hm = wfd_rtsp_msg_get_header(msg, i);
 		ck_assert_int_eq(h->count, hm->count);
+		ck_assert(wfd_rtsp_msg_has_header(msg, i) == !!h->count);
+		if (h->count)
+			ck_assert_int_eq(hm->type, i);
 
 		for (j = 0; j < h->count; ++j) {
 			ck_assert_int_eq(LEN(h->lengths[j], h->lines[j]),
@@ -454,7 +466,7 @@ START_TEST(test_wfd_rtsp_decoder)
 	int r, sent = 0;
 	size_t len, num, i;
 
-	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	r = wfd_rtsp_decoder_new(test_wfd_rtsp_decoder_event, NULL, NULL, NULL, NULL);
 	ck_assert(r == -EINVAL);
 
 	r = wfd_rtsp_decoder_new(test_wfd_rtsp_decoder_event, NULL, NULL, NULL, &d);
@@ -484,70 +496,2075 @@ START_TEST(test_wfd_rtsp_decoder)
 }
 END_TEST
 
-static void tokenize(const char *line,
-		     size_t linelen,
-		     const char *expect,
-		     size_t len,
-		     size_t num)
+START_TEST(test_wfd_rtsp_decoder_bytewise)
 {
-	const char *s;
-	char *t;
-	ssize_t l, i;
+	struct wfd_rtsp_decoder *d;
+	int r;
+	size_t len, n, i, j;
 
-	ck_assert(len > 0);
+	/* Same as above, but feed everything byte by byte. The span-scanner
+	 * still runs on each byte, so this puts a chunk boundary at every
+	 * position and must produce the very same messages. */
 
-	l = wfd_rtsp_tokenize(line, linelen, &t);
-	ck_assert(l >= 0);
+	received = 0;
+	pos = 0;
+	num = 0;
 
-	if (0) {
-		fprintf(stderr, "TOKENIZER (%lu):\n", (unsigned long)l);
-		s = t;
-		for (i = 0; i < l; ++i) {
-			fprintf(stderr, "  TOKEN: %s\n", s);
-			s += strlen(s) + 1;
-		}
+	r = wfd_rtsp_decoder_new(test_wfd_rtsp_decoder_event, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	wfd_rtsp_decoder_set_data(d, TEST_INVALID_PTR);
 
-		fprintf(stderr, "EXPECT (%lu):\n", (unsigned long)num);
-		s = expect;
-		for (i = 0; i < l; ++i) {
-			fprintf(stderr, "  TOKEN: %s\n", s);
-			s += strlen(s) + 1;
+	for (i = 0; i < SHL_ARRAY_LENGTH(orig); ++i) {
+		len = LEN(orig[i].len, orig[i].str);
+		for (j = 0; j < len; ++j) {
+			r = wfd_rtsp_decoder_feed(d, &orig[i].str[j], 1);
+			ck_assert(r >= 0);
 		}
 	}
 
-	ck_assert(l == (ssize_t)num);
-	ck_assert(!memcmp(t, expect, len));
-	free(t);
+	n = 0;
+	for (i = 0; i < SHL_ARRAY_LENGTH(expect); ++i)
+		n += expect[i].times;
+
+	ck_assert_int_eq(received, n);
+
+	wfd_rtsp_decoder_free(d);
 }
+END_TEST
 
-#define TOKENIZE(_line, _exp, _num) \
-	tokenize((_line), strlen(_line), (_exp), sizeof(_exp), _num)
-#define TOKENIZE_N(_line, _len, _exp, _num) \
-	tokenize((_line), _len, (_exp), sizeof(_exp), _num)
+struct zero_copy {
+	const uint8_t *in;
+	size_t in_len;
+	size_t frames;
+	size_t direct;
+	uint8_t data[4096];
+	size_t size;
+};
 
-START_TEST(test_wfd_rtsp_tokenizer)
+static int zero_copy_event(struct wfd_rtsp_decoder *dec,
+			   void *data,
+			   struct wfd_rtsp_decoder_event *ev)
 {
-	TOKENIZE("", "", 0);
-	TOKENIZE("asdf", "asdf", 1);
-	TOKENIZE("asdf\"\"asdf", "asdf\0\0asdf", 3);
-	TOKENIZE("asdf\"asdf\"asdf", "asdf\0asdf\0asdf", 3);
-	TOKENIZE("\"asdf\"", "asdf", 1);
-	TOKENIZE("\"\\n\\\\\\r\"", "\n\\\r", 1);
-	TOKENIZE("\"\\\"\"", "\"", 1);
-	TOKENIZE("\"\\0\"", "\\0", 1);
-	TOKENIZE("\"\\\0\"", "\\", 1);
-	TOKENIZE_N("\"\\\0\"", 4, "\\0", 1);
-	TOKENIZE("\"\\0\\\0\"", "\\0\\", 1);
-	TOKENIZE_N("\"\\0\\\0\"", 6, "\\0\\0", 1);
-	TOKENIZE("content-length:   100", "content-length\0:\0""100", 3);
-	TOKENIZE("content-args: (50+10)", "content-args\0:\0(\0""50+10\0)", 5);
-	TOKENIZE("content-args: (50 + 10)", "content-args\0:\0(\0""50\0+\0""10\0)", 7);
+	struct zero_copy *zc = data;
+	size_t i, l;
+
+	ck_assert(ev->type == WFD_RTSP_DECODER_DATA);
+	ck_assert(ev->data.n_vec >= 1 && ev->data.n_vec <= 2);
+
+	zc->size = 0;
+	for (i = 0; i < ev->data.n_vec; ++i) {
+		l = ev->data.vec[i].iov_len;
+		ck_assert(zc->size + l <= sizeof(zc->data));
+		memcpy(&zc->data[zc->size], ev->data.vec[i].iov_base, l);
+		zc->size += l;
+	}
+
+	ck_assert_int_eq(zc->size, ev->data.size);
+	if (ev->data.n_vec == 1)
+		ck_assert(ev->data.value == ev->data.vec[0].iov_base);
+	else
+		ck_assert(!ev->data.value);
+
+	if (ev->data.value &&
+	    ev->data.value >= zc->in &&
+	    ev->data.value + ev->data.size <= zc->in + zc->in_len)
+		++zc->direct;
+
+	++zc->frames;
+	return 0;
+}
+
+static void zero_copy_feed(struct wfd_rtsp_decoder *d,
+			   struct zero_copy *zc,
+			   const void *buf,
+			   size_t len)
+{
+	int r;
+
+	zc->in = buf;
+	zc->in_len = len;
+	r = wfd_rtsp_decoder_feed(d, buf, len);
+	ck_assert(r >= 0);
+}
+
+START_TEST(test_wfd_rtsp_decoder_zero_copy)
+{
+	static uint8_t big[4086] = { '$', 0x01, 0x0f, 0xf2 };
+	struct wfd_rtsp_decoder *d;
+	struct zero_copy zc = { };
+	int r;
+
+	r = wfd_rtsp_decoder_new(zero_copy_event, &zc, NULL, NULL, &d);
+	ck_assert(r >= 0);
+
+	wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_ZERO_COPY);
+	ck_assert_int_eq(wfd_rtsp_decoder_get_flags(d),
+			 WFD_RTSP_DECODER_F_ZERO_COPY);
+
+	/* complete frame in a single input-buffer is delivered directly */
+	zero_copy_feed(d, &zc, "$\001\000\006RAWSTH", 10);
+	ck_assert_int_eq(zc.frames, 1);
+	ck_assert_int_eq(zc.direct, 1);
+	ck_assert(!memcmp(zc.data, "RAWSTH", 6));
+
+	/* Partial frames are spilled into the ring-buffer. Feed a big frame in
+	 * two pieces to move the ring-buffer (4096 bytes initially) so the
+	 * next split frame wraps around. Its payload can then only be
+	 * described by an iovec. */
+	memset(&big[4], 'x', sizeof(big) - 4);
+	zero_copy_feed(d, &zc, big, 5);
+	zero_copy_feed(d, &zc, &big[5], sizeof(big) - 5);
+	ck_assert_int_eq(zc.frames, 2);
+	ck_assert_int_eq(zc.direct, 1);
+	ck_assert_int_eq(zc.size, sizeof(big) - 4);
+
+	zero_copy_feed(d, &zc, "$\001\000\006RA", 6);
+	zero_copy_feed(d, &zc, "WSTH", 4);
+	ck_assert_int_eq(zc.frames, 3);
+	ck_assert_int_eq(zc.size, 6);
+	ck_assert(!memcmp(zc.data, "RAWSTH", 6));
+
+	/* empty frames don't swallow the following byte */
+	zero_copy_feed(d, &zc, "$\002\000\000$\001\000\001X", 9);
+	ck_assert_int_eq(zc.frames, 5);
+	ck_assert_int_eq(zc.size, 1);
+	ck_assert(!memcmp(zc.data, "X", 1));
+
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+static void lookup_case(const char *name, char *buf, bool upper)
+{
+	size_t i;
+
+	for (i = 0; name[i]; ++i)
+		buf[i] = upper ? toupper(name[i]) : tolower(name[i]);
+	buf[i] = 0;
+}
+
+/*
+ * Perfect Hashing
+ * The name lookup tables in rtsp_decoder.c are only valid as long as no two
+ * names share a slot. names_check() verifies the seed and the slot tables. If
+ * either is stale, it searches for a collision-free seed and prints it together
+ * with the slot tables to paste into rtsp_decoder.c.
+ */
+
+static bool names_collide(const char *(*get_name) (unsigned int),
+			  unsigned int cnt,
+			  uint32_t seed,
+			  unsigned int bits,
+			  unsigned int *slots)
+{
+	const char *name;
+	unsigned int i, h;
+
+	memset(slots, 0, sizeof(*slots) << bits);
+
+	for (i = 1; i < cnt; ++i) {
+		name = get_name(i);
+		h = rtsp_name_hash(name, strlen(name), seed, bits);
+		if (slots[h])
+			return true;
+		slots[h] = i;
+	}
+
+	return false;
+}
+
+static bool names_check(const char *(*get_name) (unsigned int),
+			unsigned int (*from_name) (const char *),
+			unsigned int cnt,
+			uint32_t seed,
+			unsigned int bits,
+			const char *prefix)
+{
+	unsigned int slots[256], i;
+	const char *name;
+	size_t j;
+	bool stale;
+
+	stale = names_collide(get_name, cnt, seed, bits, slots);
+	for (i = 1; !stale && i < cnt; ++i)
+		stale = from_name(get_name(i)) != i;
+	if (!stale)
+		return true;
+
+	for (seed = 0; names_collide(get_name, cnt, seed, bits, slots); ++seed)
+		/* empty */ ;
+
+	fprintf(stderr, "stale %s name hash, use seed 0x%x:\n", prefix, seed);
+	for (i = 0; i < (1U << bits); ++i) {
+		if (!slots[i])
+			continue;
+
+		fprintf(stderr, "\t[%u]\t= WFD_RTSP_%s_", i, prefix);
+		for (name = get_name(slots[i]), j = 0; name[j]; ++j)
+			fputc(name[j] == '-' ? '_' : toupper(name[j]), stderr);
+		fprintf(stderr, ",\n");
+	}
+
+	return false;
+}
+
+START_TEST(test_wfd_rtsp_name_hash)
+{
+	ck_assert(names_check(wfd_rtsp_header_get_name,
+			      wfd_rtsp_header_from_name,
+			      WFD_RTSP_HEADER_CNT,
+			      RTSP_HEADER_HASH_SEED,
+			      RTSP_HEADER_HASH_BITS,
+			      "HEADER"));
+	ck_assert(names_check(wfd_rtsp_method_get_name,
+			      wfd_rtsp_method_from_name,
+			      WFD_RTSP_METHOD_CNT,
+			      RTSP_METHOD_HASH_SEED,
+			      RTSP_METHOD_HASH_BITS,
+			      "METHOD"));
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_names)
+{
+	const char *name;
+	char buf[128];
+	unsigned int i;
+
+	for (i = 1; i < WFD_RTSP_HEADER_CNT; ++i) {
+		name = wfd_rtsp_header_get_name(i);
+		ck_assert(name != NULL);
+		ck_assert_int_eq(wfd_rtsp_header_from_name(name), i);
+
+		lookup_case(name, buf, true);
+		ck_assert_int_eq(wfd_rtsp_header_from_name(buf), i);
+		lookup_case(name, buf, false);
+		ck_assert_int_eq(wfd_rtsp_header_from_name(buf), i);
+
+		/* length-aware lookup must ignore trailing data */
+		strcat(buf, ": value");
+		ck_assert_int_eq(wfd_rtsp_header_from_name_n(buf, strlen(name)), i);
+		ck_assert_int_eq(wfd_rtsp_header_from_name_n(buf, strlen(name) - 1),
+				 WFD_RTSP_HEADER_UNKNOWN);
+	}
+
+	for (i = 1; i < WFD_RTSP_METHOD_CNT; ++i) {
+		name = wfd_rtsp_method_get_name(i);
+		ck_assert(name != NULL);
+		ck_assert_int_eq(wfd_rtsp_method_from_name(name), i);
+
+		lookup_case(name, buf, false);
+		ck_assert_int_eq(wfd_rtsp_method_from_name(buf), i);
+	}
+
+	ck_assert_int_eq(wfd_rtsp_header_from_name(""), WFD_RTSP_HEADER_UNKNOWN);
+	ck_assert_int_eq(wfd_rtsp_header_from_name("X"), WFD_RTSP_HEADER_UNKNOWN);
+	ck_assert_int_eq(wfd_rtsp_header_from_name("CSeqq"), WFD_RTSP_HEADER_UNKNOWN);
+	ck_assert_int_eq(wfd_rtsp_header_from_name("Content-Lengt"), WFD_RTSP_HEADER_UNKNOWN);
+	ck_assert_int_eq(wfd_rtsp_header_from_name("wfd_video_formats"), WFD_RTSP_HEADER_UNKNOWN);
+	ck_assert_int_eq(wfd_rtsp_method_from_name("SET_PARAMETERS"), WFD_RTSP_METHOD_UNKNOWN);
+	ck_assert_int_eq(wfd_rtsp_method_from_name("GET"), WFD_RTSP_METHOD_UNKNOWN);
+
+	/* embedded binary 0s never match, even if a prefix does */
+	ck_assert_int_eq(wfd_rtsp_header_from_name_n("CSeq\0abcdefgh", 13),
+			 WFD_RTSP_HEADER_UNKNOWN);
+	ck_assert_int_eq(wfd_rtsp_header_from_name_n("Via\0", 4),
+			 WFD_RTSP_HEADER_UNKNOWN);
+	ck_assert_int_eq(wfd_rtsp_header_from_name_n("C\0eq", 4),
+			 WFD_RTSP_HEADER_UNKNOWN);
+}
+END_TEST
+
+struct stream {
+	int msgs;
+	int chunks;
+	size_t total;
+	size_t size;
+	char body[64];
+};
+
+static int stream_event(struct wfd_rtsp_decoder *dec,
+			void *data,
+			struct wfd_rtsp_decoder_event *ev)
+{
+	struct stream *st = data;
+
+	switch (ev->type) {
+	case WFD_RTSP_DECODER_MSG:
+		/* entity of previous message must be complete */
+		ck_assert_int_eq(st->size, st->total);
+		ck_assert_int_eq(ev->msg->entity.size, 0);
+		++st->msgs;
+		st->total = wfd_rtsp_msg_get_header(ev->msg,
+				WFD_RTSP_HEADER_CONTENT_LENGTH)->content_length;
+		st->size = 0;
+		break;
+	case WFD_RTSP_DECODER_BODY_CHUNK:
+		ck_assert_int_eq(ev->chunk.total, st->total);
+		ck_assert_int_eq(ev->chunk.offset, st->size);
+		ck_assert(ev->chunk.size > 0);
+		ck_assert(st->size + ev->chunk.size <= sizeof(st->body));
+		memcpy(&st->body[st->size], ev->chunk.value, ev->chunk.size);
+		st->size += ev->chunk.size;
+		++st->chunks;
+		break;
+	}
+
+	return 0;
+}
+
+START_TEST(test_wfd_rtsp_decoder_stream)
+{
+	static const char msg1[] =
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"Content-Length: 10\r\n"
+		"\r\n"
+		"0123456789";
+	static const char msg2[] =
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"Content-Length: 4\r\n"
+		"\r"
+		"abcd"
+		"OPTIONS * RTSP/1.0\r\n\r\n";
+	struct wfd_rtsp_decoder *d;
+	struct stream st = { };
+	size_t i;
+	int r;
+
+	r = wfd_rtsp_decoder_new(stream_event, &st, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_STREAM_BODY);
+
+	/* whole message at once is a single chunk */
+	r = wfd_rtsp_decoder_feed(d, msg1, sizeof(msg1) - 1);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(st.msgs, 1);
+	ck_assert_int_eq(st.chunks, 1);
+	ck_assert(!memcmp(st.body, "0123456789", 10));
+
+	/* split input results in one chunk per piece */
+	r = wfd_rtsp_decoder_feed(d, msg1, sizeof(msg1) - 4);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(st.msgs, 2);
+	r = wfd_rtsp_decoder_feed(d, &msg1[sizeof(msg1) - 4], 3);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(st.chunks, 3);
+	ck_assert_int_eq(st.size, 10);
+	ck_assert(!memcmp(st.body, "0123456789", 10));
+
+	/* bytewise, including a body right after a bare \r */
+	for (i = 0; i < sizeof(msg2) - 1; ++i) {
+		r = wfd_rtsp_decoder_feed(d, &msg2[i], 1);
+		ck_assert(r >= 0);
+	}
+	ck_assert_int_eq(st.msgs, 4);
+	ck_assert_int_eq(st.chunks, 7);
+	ck_assert_int_eq(st.total, 0);
+	ck_assert(!memcmp(st.body, "abcd", 4));
+
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+static int dispatch_event(struct wfd_rtsp_decoder *dec,
+			  void *data,
+			  struct wfd_rtsp_decoder_event *ev)
+{
+	char *log = data;
+	struct wfd_rtsp_msg *msg;
+
+	/* log events as single chars: H(eaders), M(sg), C(hunk) */
+
+	switch (ev->type) {
+	case WFD_RTSP_DECODER_HEADERS:
+		msg = ev->headers.msg;
+		ck_assert(msg->id.line != NULL);
+		ck_assert_int_eq(ev->headers.body, WFD_RTSP_DECODER_BODY_BUFFER);
+
+		if (msg->id.request.type == WFD_RTSP_METHOD_SETUP)
+			ev->headers.body = WFD_RTSP_DECODER_BODY_DISCARD;
+		else if (msg->id.request.type == WFD_RTSP_METHOD_SET_PARAMETER)
+			ev->headers.body = WFD_RTSP_DECODER_BODY_STREAM;
+
+		strcat(log, "H");
+		break;
+	case WFD_RTSP_DECODER_MSG:
+		strcat(log, "M");
+		if (ev->msg->entity.size)
+			strncat(log, ev->msg->entity.value, ev->msg->entity.size);
+		break;
+	case WFD_RTSP_DECODER_BODY_CHUNK:
+		strcat(log, "C");
+		strncat(log, (const char*)ev->chunk.value, ev->chunk.size);
+		break;
+	}
+
+	return 0;
+}
+
+START_TEST(test_wfd_rtsp_decoder_dispatch)
+{
+	static const char msg[] =
+		"SETUP * RTSP/1.0\r\n"
+		"Content-Length: 3\r\n"
+		"\r\n"
+		"abc"
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"Content-Length: 3\r\n"
+		"\r\n"
+		"def"
+		"GET_PARAMETER * RTSP/1.0\r\n"
+		"Content-Length: 3\r\n"
+		"\r\n"
+		"ghi"
+		"PLAY * RTSP/1.0\r\n"
+		"\r\n";
+	struct wfd_rtsp_decoder *d;
+	char log[128] = "";
+	int r;
+
+	r = wfd_rtsp_decoder_new(dispatch_event, log, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_HEADERS);
+
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	ck_assert_str_eq(log, "HM" "HMCdef" "HMghi" "HM");
+
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_decoder_pull)
+{
+	static const char msg[] =
+		"OPTIONS * RTSP/1.0\r\n"
+		"CSeq: 1\r\n"
+		"\r\n"
+		"$\001\000\003RAW"
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"CSeq: 2\r\n"
+		"Content-Length: 4\r\n"
+		"\r\n"
+		"body";
+	struct wfd_rtsp_decoder_event ev, evs[8];
+	struct wfd_rtsp_decoder_limits lim;
+	struct wfd_rtsp_decoder *d;
+	const struct wfd_rtsp_msg *m1;
+	ssize_t n;
+	int r;
+
+	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r == -EAGAIN);
+
+	/* events are queued until pulled, and stay valid across feeds */
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(ev.type, WFD_RTSP_DECODER_MSG);
+	m1 = ev.msg;
+	ck_assert_int_eq(m1->id.request.type, WFD_RTSP_METHOD_OPTIONS);
+
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(m1, WFD_RTSP_HEADER_CSEQ)->cseq, 1);
+
+	/* pipelined events are returned in order */
+	n = wfd_rtsp_decoder_next_batch(d, evs, SHL_ARRAY_LENGTH(evs));
+	ck_assert_int_eq(n, 5);
+
+	ck_assert_int_eq(evs[0].type, WFD_RTSP_DECODER_DATA);
+	ck_assert_int_eq(evs[0].data.size, 3);
+	ck_assert(!strcmp((char*)evs[0].data.value, "RAW"));
+
+	ck_assert_int_eq(evs[1].type, WFD_RTSP_DECODER_MSG);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(evs[1].msg, WFD_RTSP_HEADER_CSEQ)->cseq, 2);
+	ck_assert(!strcmp(evs[1].msg->entity.value, "body"));
+
+	ck_assert_int_eq(evs[2].type, WFD_RTSP_DECODER_MSG);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(evs[2].msg, WFD_RTSP_HEADER_CSEQ)->cseq, 1);
+	ck_assert_int_eq(evs[3].type, WFD_RTSP_DECODER_DATA);
+	ck_assert_int_eq(evs[4].type, WFD_RTSP_DECODER_MSG);
+	ck_assert(evs[4].msg != evs[2].msg);
+
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r == -EAGAIN);
+
+	/* streamed bodies are queued as copied chunks */
+	wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_STREAM_BODY);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 3);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_feed(d, &msg[sizeof(msg) - 3], 2);
+	ck_assert(r >= 0);
+
+	n = wfd_rtsp_decoder_next_batch(d, evs, 3);
+	ck_assert_int_eq(n, 3);
+	n = wfd_rtsp_decoder_next_batch(d, evs, SHL_ARRAY_LENGTH(evs));
+	ck_assert_int_eq(n, 2);
+	ck_assert_int_eq(evs[0].type, WFD_RTSP_DECODER_BODY_CHUNK);
+	ck_assert(!strcmp((char*)evs[0].chunk.value, "bo"));
+	ck_assert_int_eq(evs[1].type, WFD_RTSP_DECODER_BODY_CHUNK);
+	ck_assert(!strcmp((char*)evs[1].chunk.value, "dy"));
+
+	/* feeding stops while too many events are pending */
+	wfd_rtsp_decoder_reset(d);
+	wfd_rtsp_decoder_set_flags(d, 0);
+	shl_zero(lim);
+	lim.max_events = 2;
+	wfd_rtsp_decoder_set_limits(d, &lim);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_space(d) == 0);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert_int_eq(r, -EAGAIN);
+
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(ev.type, WFD_RTSP_DECODER_MSG);
+	ck_assert(wfd_rtsp_decoder_get_space(d) == 0);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert_int_eq(r, -EAGAIN);
+
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(ev.type, WFD_RTSP_DECODER_DATA);
+	ck_assert(wfd_rtsp_decoder_get_space(d) == SIZE_MAX);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	n = wfd_rtsp_decoder_next_batch(d, evs, SHL_ARRAY_LENGTH(evs));
+	ck_assert_int_eq(n, 4);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(evs[0].msg, WFD_RTSP_HEADER_CSEQ)->cseq, 2);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(evs[1].msg, WFD_RTSP_HEADER_CSEQ)->cseq, 1);
+
+	/* push-mode decoders cannot be pulled */
+	wfd_rtsp_decoder_free(d);
+	r = wfd_rtsp_decoder_new(test_wfd_rtsp_decoder_event, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r == -EINVAL);
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+static int retain_event(struct wfd_rtsp_decoder *dec,
+			void *data,
+			struct wfd_rtsp_decoder_event *ev)
+{
+	struct wfd_rtsp_msg **msgs = data;
+
+	if (ev->type == WFD_RTSP_DECODER_MSG) {
+		wfd_rtsp_msg_ref(ev->msg);
+		while (*msgs)
+			++msgs;
+		*msgs = ev->msg;
+	}
+
+	return 0;
+}
+
+START_TEST(test_wfd_rtsp_decoder_retain)
+{
+	static const char msg[] =
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"CSeq: 1\r\n"
+		"Content-Length: 4\r\n"
+		"\r\n"
+		"body"
+		"OPTIONS * RTSP/1.0\r\n"
+		"CSeq: 2\r\n"
+		"\r\n";
+	struct wfd_rtsp_msg *msgs[8] = { }, *old[4];
+	struct wfd_rtsp_decoder *d;
+	int r;
+
+	r = wfd_rtsp_decoder_new(retain_event, msgs, NULL, NULL, &d);
+	ck_assert(r >= 0);
+
+	/* retained messages survive the callback and later messages */
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	ck_assert(msgs[0] && msgs[1] && msgs[0] != msgs[1]);
+
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	ck_assert(msgs[2] && msgs[3]);
+
+	ck_assert_int_eq(msgs[0]->id.request.type, WFD_RTSP_METHOD_SET_PARAMETER);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(msgs[0], WFD_RTSP_HEADER_CSEQ)->cseq, 1);
+	ck_assert(!strcmp(msgs[0]->entity.value, "body"));
+	ck_assert_int_eq(msgs[1]->id.request.type, WFD_RTSP_METHOD_OPTIONS);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(msgs[1], WFD_RTSP_HEADER_CSEQ)->cseq, 2);
+	ck_assert(!strcmp(msgs[2]->entity.value, "body"));
+
+	/* released messages are recycled by the decoder */
+	memcpy(old, msgs, sizeof(old));
+	wfd_rtsp_msg_unref(old[0]);
+	shl_zero(msgs);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	ck_assert(msgs[0] == old[0] || msgs[1] == old[0]);
+	ck_assert(!strcmp(msgs[0]->entity.value, "body"));
+
+	/* messages may outlive their decoder */
+	wfd_rtsp_decoder_free(d);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(msgs[1], WFD_RTSP_HEADER_CSEQ)->cseq, 2);
+	ck_assert_int_eq(old[3]->id.request.type, WFD_RTSP_METHOD_OPTIONS);
+	wfd_rtsp_msg_unref(msgs[0]);
+	wfd_rtsp_msg_unref(msgs[1]);
+	wfd_rtsp_msg_unref(old[1]);
+	wfd_rtsp_msg_unref(old[2]);
+	wfd_rtsp_msg_unref(old[3]);
+}
+END_TEST
+
+static int limit_event(struct wfd_rtsp_decoder *dec,
+		       void *data,
+		       struct wfd_rtsp_decoder_event *ev)
+{
+	int *reason = data;
+
+	if (ev->type == WFD_RTSP_DECODER_ERROR)
+		*reason = ev->error.reason;
+
+	return 0;
+}
+
+START_TEST(test_wfd_rtsp_decoder_limits)
+{
+	static const char msg[] =
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"CSeq: 1\r\n"
+		"Content-Length: 4\r\n"
+		"\r\n"
+		"body";
+	struct wfd_rtsp_decoder_limits lim = { };
+	struct wfd_rtsp_decoder *d, *d2;
+	static char huge[4096 + 128];
+	struct wfd_rtsp_decoder_event ev;
+	size_t used, len, i;
+	int r, reason;
+
+	r = wfd_rtsp_decoder_new(limit_event, &reason, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_space(d) == SIZE_MAX);
+
+	/* header-lines */
+	lim.max_line = 16;
+	wfd_rtsp_decoder_set_limits(d, &lim);
+	reason = -1;
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert_int_eq(r, -EMSGSIZE);
+	ck_assert_int_eq(reason, WFD_RTSP_DECODER_E_LINE);
+	ck_assert(wfd_rtsp_decoder_get_space(d) == 0);
+
+	/* header count */
+	wfd_rtsp_decoder_reset(d);
+	lim.max_line = 24;
+	lim.max_headers = 1;
+	wfd_rtsp_decoder_set_limits(d, &lim);
+	reason = -1;
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert_int_eq(r, -EMSGSIZE);
+	ck_assert_int_eq(reason, WFD_RTSP_DECODER_E_HEADERS);
+
+	/* entities are only limited if buffered */
+	wfd_rtsp_decoder_reset(d);
+	lim.max_headers = 2;
+	lim.max_entity = 3;
+	wfd_rtsp_decoder_set_limits(d, &lim);
+	reason = -1;
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert_int_eq(r, -EMSGSIZE);
+	ck_assert_int_eq(reason, WFD_RTSP_DECODER_E_ENTITY);
+
+	wfd_rtsp_decoder_reset(d);
+	wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_STREAM_BODY);
+	reason = -1;
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(reason, -1);
+
+	/* buffered input */
+	wfd_rtsp_decoder_reset(d);
+	shl_zero(lim);
+	lim.max_buffer = 8;
+	wfd_rtsp_decoder_set_limits(d, &lim);
+	ck_assert(wfd_rtsp_decoder_get_space(d) == 8);
+	r = wfd_rtsp_decoder_feed(d, msg, 4);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_space(d) == 4);
+	r = wfd_rtsp_decoder_feed(d, &msg[4], 8);
+	ck_assert_int_eq(r, -ENOBUFS);
+	ck_assert_int_eq(reason, WFD_RTSP_DECODER_E_BUFFER);
+
+	wfd_rtsp_decoder_get_limits(d, &lim);
+	ck_assert(lim.max_buffer == 8 && !lim.max_line);
+
+	/* the global budget is shared by all decoders, but only charged for
+	 * buffer allocations */
+	wfd_rtsp_decoder_reset(d);
+	wfd_rtsp_decoder_set_limits(d, NULL);
+	used = wfd_rtsp_decoder_get_budget_used();
+	wfd_rtsp_decoder_set_budget(used + 4096);
+	r = wfd_rtsp_decoder_feed(d, msg, 4);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used);
+	wfd_rtsp_decoder_free(d);
+	used = wfd_rtsp_decoder_get_budget_used();
+	wfd_rtsp_decoder_set_budget(used + 4096);
+
+	r = wfd_rtsp_decoder_new(limit_event, &reason, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_new(limit_event, &reason, NULL, NULL, &d2);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_space(d2) == 4096);
+	r = wfd_rtsp_decoder_feed(d2, msg, 4);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used + 4096);
+	ck_assert(wfd_rtsp_decoder_get_space(d2) == 4092);
+
+	r = wfd_rtsp_decoder_feed(d, msg, 4);
+	ck_assert_int_eq(r, -ENOBUFS);
+	ck_assert_int_eq(reason, WFD_RTSP_DECODER_E_BUDGET);
+
+	wfd_rtsp_decoder_free(d2);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used);
+	wfd_rtsp_decoder_set_budget(0);
+	wfd_rtsp_decoder_free(d);
+
+	/* buffered entities are charged until the message is complete */
+	r = wfd_rtsp_decoder_new(limit_event, &reason, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	used = wfd_rtsp_decoder_get_budget_used();
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 3);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used + 4096 + 5);
+	r = wfd_rtsp_decoder_feed(d, &msg[sizeof(msg) - 3], 2);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used + 4096);
+	wfd_rtsp_decoder_free(d);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used);
+
+	/* payloads of queued events are charged until they're recycled */
+	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_feed(d, "$\001\000\006RAWSTH", 10);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert_int_eq(r, -EAGAIN);
+	used = wfd_rtsp_decoder_get_budget_used();
+
+	r = wfd_rtsp_decoder_feed(d, "$\001\000\006RAWSTH", 10);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used + 7);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert(!memcmp(ev.data.value, "RAWSTH", 7));
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used + 7);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert_int_eq(r, -EAGAIN);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used);
+
+	wfd_rtsp_decoder_set_budget(used + 6);
+	r = wfd_rtsp_decoder_feed(d, "$\001\000\006RAWSTH", 10);
+	ck_assert_int_eq(r, -ENOBUFS);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(ev.type, WFD_RTSP_DECODER_ERROR);
+	ck_assert_int_eq(ev.error.reason, WFD_RTSP_DECODER_E_BUDGET);
+	wfd_rtsp_decoder_set_budget(0);
+	wfd_rtsp_decoder_free(d);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() < used);
+
+	/* announced lengths are not trusted, entities grow with the input */
+	r = wfd_rtsp_decoder_new(limit_event, &reason, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	used = wfd_rtsp_decoder_get_budget_used();
+	len = sprintf(huge, "SET_PARAMETER * RTSP/1.0\r\n"
+			    "Content-Length: 4000000000\r\n\r\nbody");
+	r = wfd_rtsp_decoder_feed(d, huge, len);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() <= used + 4096 + 65536);
+	wfd_rtsp_decoder_free(d);
+	ck_assert(wfd_rtsp_decoder_get_budget_used() == used);
+
+	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	len = sprintf(huge, "SET_PARAMETER * RTSP/1.0\r\n"
+			    "Content-Length: 300000\r\n\r\n");
+	r = wfd_rtsp_decoder_feed(d, huge, len);
+	ck_assert(r >= 0);
+	for (i = 0; i < 300000; i += sizeof(huge)) {
+		memset(huge, 'a' + i % 26, sizeof(huge));
+		r = wfd_rtsp_decoder_feed(d, huge,
+					  shl_min(sizeof(huge), 300000 - i));
+		ck_assert(r >= 0);
+	}
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(ev.msg->entity.size, 300000);
+	for (i = 0; i < 300000; i += sizeof(huge))
+		ck_assert(((char*)ev.msg->entity.value)[i] == 'a' + i % 26);
+	ck_assert(((char*)ev.msg->entity.value)[299999] ==
+		  'a' + 299999 / sizeof(huge) * sizeof(huge) % 26);
+	ck_assert(((char*)ev.msg->entity.value)[300000] == 0);
+	wfd_rtsp_decoder_free(d);
+
+	/* lengths that leave no room for the terminating 0 are invalid */
+	r = wfd_rtsp_decoder_new(limit_event, &reason, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	len = sprintf(huge, "SET_PARAMETER * RTSP/1.0\r\n"
+			    "Content-Length: %zu\r\n\r\n", (size_t)SIZE_MAX);
+	memset(&huge[len], 'x', sizeof(huge) - len);
+	reason = -1;
+	r = wfd_rtsp_decoder_feed(d, huge, sizeof(huge));
+	ck_assert_int_eq(r, -EINVAL);
+	ck_assert_int_eq(reason, WFD_RTSP_DECODER_E_SYNTAX);
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+struct resync_log {
+	unsigned long cseqs[8];
+	size_t n_cseqs;
+	unsigned int reasons[32];
+	size_t n_reasons;
+	char skipped[256];
+	size_t n_skipped;
+};
+
+static int resync_event(struct wfd_rtsp_decoder *dec,
+			void *data,
+			struct wfd_rtsp_decoder_event *ev)
+{
+	struct resync_log *log = data;
+	const struct wfd_rtsp_msg_header *h;
+
+	switch (ev->type) {
+	case WFD_RTSP_DECODER_MSG:
+		h = wfd_rtsp_msg_get_header(ev->msg, WFD_RTSP_HEADER_CSEQ);
+		ck_assert(log->n_cseqs < SHL_ARRAY_LENGTH(log->cseqs));
+		log->cseqs[log->n_cseqs++] = h->cseq;
+		break;
+	case WFD_RTSP_DECODER_ERROR:
+		ck_assert(log->n_reasons < SHL_ARRAY_LENGTH(log->reasons));
+		log->reasons[log->n_reasons++] = ev->error.reason;
+		if (ev->error.reason == WFD_RTSP_DECODER_E_SKIPPED) {
+			ck_assert(log->n_skipped + ev->error.length <=
+				  sizeof(log->skipped));
+			memcpy(&log->skipped[log->n_skipped], ev->error.data,
+			       ev->error.length);
+			log->n_skipped += ev->error.length;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+START_TEST(test_wfd_rtsp_decoder_resync)
+{
+	static const char msg[] =
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"CSeq: 1\r\n"
+		"Content-Length: invalid\r\n"
+		"\r\n"
+		"junk\001\002 SETUP later\r\n"
+		"OPTIONS * RTSP/1.0\r\n"
+		"CSeq: 2\r\n"
+		"\r\n"
+		"RTSP/1.0 200 OK\r\n"
+		"CSeq: 3\r\n"
+		"\r\n";
+	static const char big[] =
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"CSeq: 1\r\n"
+		"Content-Length: 32\r\n"
+		"\r\n"
+		"$\001\000\002RTSP/1.0 200 OK\r\nCSeq: 9\r\n\r\n"
+		"OPTIONS * RTSP/1.0\r\n"
+		"CSeq: 2\r\n"
+		"\r\n";
+	struct wfd_rtsp_decoder_limits lim = { };
+	struct resync_log log = { };
+	struct wfd_rtsp_decoder *d;
+	size_t i, j;
+	int r;
+
+	r = wfd_rtsp_decoder_new(resync_event, &log, NULL, NULL, &d);
+	ck_assert(r >= 0);
+
+	/* without resync, the decoder dies */
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r < 0);
+	ck_assert_int_eq(log.n_reasons, 1);
+	ck_assert_int_eq(log.reasons[0], WFD_RTSP_DECODER_E_SYNTAX);
+	ck_assert_int_eq(log.n_cseqs, 0);
+
+	/* with resync, we skip to the next valid message; in one go or byte
+	 * by byte, so candidates are cut off by the end of the input */
+	for (i = 0; i < 2; ++i) {
+		wfd_rtsp_decoder_reset(d);
+		wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_RESYNC);
+		shl_zero(log);
+
+		if (!i) {
+			r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+			ck_assert(r >= 0);
+		} else {
+			for (j = 0; j < sizeof(msg) - 1; ++j) {
+				r = wfd_rtsp_decoder_feed(d, &msg[j], 1);
+				ck_assert(r >= 0);
+			}
+		}
+
+		ck_assert_int_eq(log.n_cseqs, 2);
+		ck_assert_int_eq(log.cseqs[0], 2);
+		ck_assert_int_eq(log.cseqs[1], 3);
+
+		/* the bogus SETUP line fails verification and is dropped */
+		ck_assert_int_eq(log.reasons[0], WFD_RTSP_DECODER_E_SYNTAX);
+		ck_assert_int_eq(log.reasons[log.n_reasons - 1],
+				 WFD_RTSP_DECODER_E_SYNTAX);
+		ck_assert_int_eq(log.n_skipped, 9);
+		ck_assert(!memcmp(log.skipped, "\r\njunk\001\002 ", 9));
+	}
+
+	/* errors after the header discard the entity, whatever it contains */
+	lim.max_entity = 16;
+	for (i = 0; i < 2; ++i) {
+		wfd_rtsp_decoder_reset(d);
+		wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_RESYNC);
+		wfd_rtsp_decoder_set_limits(d, &lim);
+		shl_zero(log);
+
+		if (!i) {
+			r = wfd_rtsp_decoder_feed(d, big, sizeof(big) - 1);
+			ck_assert(r >= 0);
+		} else {
+			for (j = 0; j < sizeof(big) - 1; ++j) {
+				r = wfd_rtsp_decoder_feed(d, &big[j], 1);
+				ck_assert(r >= 0);
+			}
+		}
+
+		ck_assert_int_eq(log.n_reasons, 1);
+		ck_assert_int_eq(log.reasons[0], WFD_RTSP_DECODER_E_ENTITY);
+		ck_assert_int_eq(log.n_cseqs, 1);
+		ck_assert_int_eq(log.cseqs[0], 2);
+	}
+
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_decoder_interest)
+{
+	static const char msg[] =
+		"SET_PARAMETER * RTSP/1.0\r\n"
+		"Date: Thu, 01 Jan 2015 00:00:00 GMT\r\n"
+		"CSeq : 5\r\n"
+		"content-length: 4\r\n"
+		"User-Agent: foo\r\n"
+		"Session: \"x\"\r\n"
+		"X-Unknown: y\r\n"
+		"broken line\r\n"
+		"Accept\r\n"
+		"Sess\000ion: 1\r\n"
+		"X-Some-Very-Long-Vendor-Header-Name: 1\r\n"
+		"\r\n"
+		"test";
+	struct wfd_rtsp_decoder_event ev;
+	const struct wfd_rtsp_msg *m;
+	struct wfd_rtsp_decoder *d;
+	size_t i, j;
+	int r;
+
+	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	ck_assert(wfd_rtsp_decoder_get_interest(d) == WFD_RTSP_HEADER_MASK_ALL);
+
+	wfd_rtsp_decoder_set_interest(d,
+				      WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_CSEQ) |
+				      WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_SESSION));
+
+	/* feed at once and byte by byte, so lines wrap around the ring */
+	for (i = 0; i < 2; ++i) {
+		if (!i) {
+			r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+			ck_assert(r >= 0);
+		} else {
+			for (j = 0; j < sizeof(msg) - 1; ++j) {
+				r = wfd_rtsp_decoder_feed(d, &msg[j], 1);
+				ck_assert(r >= 0);
+			}
+		}
+
+		r = wfd_rtsp_decoder_next(d, &ev);
+		ck_assert(r >= 0);
+		ck_assert_int_eq(ev.type, WFD_RTSP_DECODER_MSG);
+		m = ev.msg;
+
+		ck_assert_int_eq(wfd_rtsp_msg_get_header(m, WFD_RTSP_HEADER_CSEQ)->cseq, 5);
+		ck_assert(wfd_rtsp_msg_has_header(m, WFD_RTSP_HEADER_CONTENT_LENGTH));
+		ck_assert_int_eq(m->entity.size, 4);
+		ck_assert(!memcmp(m->entity.value, "test", 4));
+
+		/* the second line needs the parser to drop its binary 0 */
+		ck_assert_int_eq(wfd_rtsp_msg_get_header(m, WFD_RTSP_HEADER_SESSION)->count, 2);
+		ck_assert(!wfd_rtsp_msg_has_header(m, WFD_RTSP_HEADER_DATE));
+		ck_assert(!wfd_rtsp_msg_has_header(m, WFD_RTSP_HEADER_USER_AGENT));
+		ck_assert(!wfd_rtsp_msg_has_header(m, WFD_RTSP_HEADER_UNKNOWN));
+
+		/* lines too long to be identified on the raw input are
+		 * filtered after parsing */
+		ck_assert(m->header_mask ==
+			  (WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_CSEQ) |
+			   WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_CONTENT_LENGTH) |
+			   WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_SESSION)));
+	}
+
+	/* unknown lines are kept if asked for */
+	wfd_rtsp_decoder_set_interest(d,
+				      WFD_RTSP_HEADER_MASK(WFD_RTSP_HEADER_UNKNOWN));
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	m = ev.msg;
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(m, WFD_RTSP_HEADER_UNKNOWN)->count, 4);
+	ck_assert(!wfd_rtsp_msg_has_header(m, WFD_RTSP_HEADER_CSEQ));
+
+	/* malformed lines are UNKNOWN, even with a known name */
+	ck_assert(!wfd_rtsp_msg_has_header(m, WFD_RTSP_HEADER_ACCEPT));
+	ck_assert(!strcmp(wfd_rtsp_msg_get_header(m, WFD_RTSP_HEADER_UNKNOWN)->lines[2],
+			  "Accept"));
+
+	/* lines that can't be identified on the raw input are filtered, too */
+	ck_assert(!wfd_rtsp_msg_has_header(m, WFD_RTSP_HEADER_SESSION));
+
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_decoder_lazy)
+{
+	static const char msg[] =
+		"SETUP rtsp://localhost/wfd1.0/streamid=0 RTSP/1.0\r\n"
+		"CSeq: 4\r\n"
+		"Transport: RTP/AVP/UDP;unicast;\r\n"
+		"\tclient_port=1028\r\n"
+		"Session:   \"a  b\"\000 c  \r\n"
+		"X-Foo: bar\r\n"
+		"Ses\000sion: 2\r\n"
+		"Content-Length: 2\r\n"
+		"\r\n"
+		"ok";
+	static const char odd[] =
+		"OPTIONS * RTSP/1.0\r\n"
+		"\"CSeq\": 9\r\n"
+		"\001Content-Length: 5\r\n"
+		"\r\n"
+		"hello";
+	static const unsigned int types[] = {
+		WFD_RTSP_HEADER_CSEQ,
+		WFD_RTSP_HEADER_TRANSPORT,
+		WFD_RTSP_HEADER_SESSION,
+		WFD_RTSP_HEADER_UNKNOWN,
+		WFD_RTSP_HEADER_CONTENT_LENGTH,
+	};
+	const struct wfd_rtsp_msg_header *h;
+	struct wfd_rtsp_decoder_event ev;
+	struct wfd_rtsp_msg *eager, *lazy;
+	struct wfd_rtsp_decoder *d;
+	const char *v;
+	char buf[128];
+	size_t i, j, len;
+	ssize_t l;
+	int r;
+
+	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	eager = ev.msg;
+	wfd_rtsp_msg_ref(eager);
+	ck_assert_int_eq(eager->n_fields, 0);
+
+	wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_LAZY_HEADERS);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	lazy = ev.msg;
+
+	/* only the headers the decoder needs itself are parsed */
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(lazy, WFD_RTSP_HEADER_CSEQ)->cseq, 4);
+	ck_assert(wfd_rtsp_msg_has_header(lazy, WFD_RTSP_HEADER_CONTENT_LENGTH));
+	ck_assert(!wfd_rtsp_msg_has_header(lazy, WFD_RTSP_HEADER_TRANSPORT));
+	ck_assert_int_eq(lazy->entity.size, 2);
+	ck_assert_int_eq(lazy->n_fields, 6);
+
+	/* raw views are taken as is */
+	v = wfd_rtsp_msg_get_field(lazy, WFD_RTSP_HEADER_TRANSPORT, 0, &len);
+	ck_assert(v != NULL);
+	ck_assert_int_eq(len, 39);
+	ck_assert(!memcmp(v, "RTP/AVP/UDP;unicast;\r\n\tclient_port=1028", len));
+	v = wfd_rtsp_msg_get_field(lazy, WFD_RTSP_HEADER_UNKNOWN, 0, &len);
+	ck_assert(len == 10 && !memcmp(v, "X-Foo: bar", len));
+	ck_assert(!wfd_rtsp_msg_get_field(lazy, WFD_RTSP_HEADER_UNKNOWN, 1, &len));
+	ck_assert(!wfd_rtsp_msg_get_field(lazy, WFD_RTSP_HEADER_DATE, 0, &len));
+
+	/* sanitized copies match the tail of the eagerly parsed lines */
+	for (i = 0; i < SHL_ARRAY_LENGTH(types); ++i) {
+		h = wfd_rtsp_msg_get_header(eager, types[i]);
+		ck_assert(h->count > 0);
+
+		for (j = 0; j < h->count; ++j) {
+			l = wfd_rtsp_msg_copy_field(lazy, types[i], j,
+						    buf, sizeof(buf));
+			ck_assert(l >= 0);
+			ck_assert_int_eq(l, strlen(buf));
+			ck_assert(h->lengths[j] >= (size_t)l);
+			ck_assert(!strcmp(h->lines[j] + h->lengths[j] - l, buf));
+		}
+
+		l = wfd_rtsp_msg_copy_field(lazy, types[i], j,
+					    buf, sizeof(buf));
+		ck_assert_int_eq(l, -ENOENT);
+	}
+
+	l = wfd_rtsp_msg_copy_field(lazy, WFD_RTSP_HEADER_TRANSPORT, 0, buf, 39);
+	ck_assert_int_eq(l, -ENOBUFS);
+
+	wfd_rtsp_msg_unref(eager);
+	wfd_rtsp_decoder_free(d);
+
+	/* names the raw scan can't read are tokenized like in eager mode */
+	for (i = 0; i < 2; ++i) {
+		r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+		ck_assert(r >= 0);
+		if (i)
+			wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_LAZY_HEADERS);
+
+		r = wfd_rtsp_decoder_feed(d, odd, sizeof(odd) - 1);
+		ck_assert(r >= 0);
+		r = wfd_rtsp_decoder_next(d, &ev);
+		ck_assert(r >= 0);
+		ck_assert_int_eq(ev.type, WFD_RTSP_DECODER_MSG);
+		ck_assert_int_eq(ev.msg->entity.size, 5);
+		ck_assert_int_eq(wfd_rtsp_msg_get_header(ev.msg, WFD_RTSP_HEADER_CSEQ)->cseq, 9);
+		ck_assert(!wfd_rtsp_msg_has_header(ev.msg, WFD_RTSP_HEADER_UNKNOWN));
+
+		wfd_rtsp_decoder_free(d);
+	}
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_transport)
+{
+	static const char msg[] =
+		"RTSP/1.0 200 OK\r\n"
+		"CSeq: 6\r\n"
+		"Transport: bogus/1.0\r\n"
+		"Transport: RTP/AVP/UDP;unicast;\r\n"
+		" client_port=19000-19001;server_port=5000-5001\r\n"
+		"Transport: RTP/AVP/TCP;interleaved=0-1\r\n"
+		"\r\n";
+	static const struct {
+		const char *value;
+		int r;
+		struct wfd_rtsp_transport t;
+	} cases[] = {
+		{ "RTP/AVP/UDP;unicast;client_port=19000", 0,
+		  { WFD_RTSP_TRANSPORT_UDP,
+		    WFD_RTSP_TRANSPORT_UNICAST | WFD_RTSP_TRANSPORT_CLIENT_PORT,
+		    { 19000, 19000 } } },
+		{ "rtp/avp ; multicast;ttl=127;port=3456-3457", 0,
+		  { WFD_RTSP_TRANSPORT_UDP, WFD_RTSP_TRANSPORT_MULTICAST } },
+		{ "RTP/AVP/TCP;mode=\"PLAY;RECORD\";interleaved=2-3,RTP/AVP", 0,
+		  { WFD_RTSP_TRANSPORT_TCP, WFD_RTSP_TRANSPORT_INTERLEAVED,
+		    .interleaved = { 2, 3 } } },
+		{ "RTP/AVP;server_port=5000-5001-5002", -EINVAL },
+		{ "RTP/AVP;client_port=65536", -EINVAL },
+		{ "RTP/AVP;interleaved=256", -EINVAL },
+		{ "RTP/AVP;client_port", -EINVAL },
+		{ "RTP/AVP unicast", -EINVAL },
+		{ "RTP/SAVP;unicast", -EINVAL },
+		{ "RTP/SAVP;mode=\"a,b\";unicast, RTP/AVP/UDP;unicast;client_port=1000", 0,
+		  { WFD_RTSP_TRANSPORT_UDP,
+		    WFD_RTSP_TRANSPORT_UNICAST | WFD_RTSP_TRANSPORT_CLIENT_PORT,
+		    { 1000, 1000 } } },
+		{ "RTP/AVP;client_port=1000-999,RTP/AVP/TCP;interleaved=4", 0,
+		  { WFD_RTSP_TRANSPORT_TCP, WFD_RTSP_TRANSPORT_INTERLEAVED,
+		    .interleaved = { 4, 4 } } },
+		{ "RTP/AVP;client_port=1000-999", -EINVAL },
+		{ "RTP/SAVP, bogus", -EINVAL },
+		{ "", -EINVAL },
+	};
+	const struct wfd_rtsp_msg_header *h;
+	struct wfd_rtsp_decoder_event ev;
+	struct wfd_rtsp_transport t;
+	struct wfd_rtsp_decoder *d;
+	const char *v;
+	size_t i, len;
+	int r;
+
+	for (i = 0; i < SHL_ARRAY_LENGTH(cases); ++i) {
+		memset(&t, 0xff, sizeof(t));
+		r = wfd_rtsp_transport_parse(cases[i].value,
+					     strlen(cases[i].value), &t);
+		ck_assert_int_eq(r, cases[i].r);
+		if (r < 0)
+			continue;
+
+		ck_assert_int_eq(t.lower, cases[i].t.lower);
+		ck_assert_int_eq(t.flags, cases[i].t.flags);
+		if (t.flags & WFD_RTSP_TRANSPORT_CLIENT_PORT) {
+			ck_assert_int_eq(t.client_port[0], cases[i].t.client_port[0]);
+			ck_assert_int_eq(t.client_port[1], cases[i].t.client_port[1]);
+		}
+		if (t.flags & WFD_RTSP_TRANSPORT_INTERLEAVED) {
+			ck_assert_int_eq(t.interleaved[0], cases[i].t.interleaved[0]);
+			ck_assert_int_eq(t.interleaved[1], cases[i].t.interleaved[1]);
+		}
+	}
+
+	/* the decoder parses the first line it understands */
+	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+
+	h = wfd_rtsp_msg_get_header(ev.msg, WFD_RTSP_HEADER_TRANSPORT);
+	ck_assert_int_eq(h->count, 3);
+	ck_assert_int_eq(h->transport.lower, WFD_RTSP_TRANSPORT_UDP);
+	ck_assert_int_eq(h->transport.flags,
+			 WFD_RTSP_TRANSPORT_UNICAST |
+			 WFD_RTSP_TRANSPORT_CLIENT_PORT |
+			 WFD_RTSP_TRANSPORT_SERVER_PORT);
+	ck_assert_int_eq(h->transport.client_port[0], 19000);
+	ck_assert_int_eq(h->transport.client_port[1], 19001);
+	ck_assert_int_eq(h->transport.server_port[0], 5000);
+	ck_assert_int_eq(h->transport.server_port[1], 5001);
+
+	/* raw lazy fields can be parsed as they are */
+	wfd_rtsp_decoder_set_flags(d, WFD_RTSP_DECODER_F_LAZY_HEADERS);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+
+	v = wfd_rtsp_msg_get_field(ev.msg, WFD_RTSP_HEADER_TRANSPORT, 1, &len);
+	ck_assert(v != NULL);
+	r = wfd_rtsp_transport_parse(v, len, &t);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(t.server_port[1], 5001);
+
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_session)
+{
+	static const char msg[] =
+		"PLAY rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+		"CSeq: 7\r\n"
+		"Session: ;timeout=10\r\n"
+		"Session: 6B8B4567 ; timeout=30\r\n"
+		"Session: 1234\r\n"
+		"\r\n";
+	static const struct {
+		const char *value;
+		int r;
+		const char *id;
+		unsigned long timeout;
+	} cases[] = {
+		{ "6B8B4567", 0, "6B8B4567", 0 },
+		{ "  abc-DEF_1.2+$;timeout=60", 0, "abc-DEF_1.2+$", 60 },
+		{ "x;foo=\"bar\";TIMEOUT = 5", 0, "x", 5 },
+		{ "x;timeout", -EINVAL },
+		{ "x;timeout=5s", -EINVAL },
+		{ "x y", -EINVAL },
+		{ "\"x\"", -EINVAL },
+		{ "", -EINVAL },
+	};
+	const struct wfd_rtsp_msg_header *h;
+	struct wfd_rtsp_decoder_event ev;
+	struct wfd_rtsp_session_table *tbl;
+	struct wfd_rtsp_session s;
+	struct wfd_rtsp_decoder *d;
+	char id[16];
+	size_t i, len;
+	int r;
+
+	for (i = 0; i < SHL_ARRAY_LENGTH(cases); ++i) {
+		r = wfd_rtsp_session_parse(cases[i].value,
+					   strlen(cases[i].value), &s);
+		ck_assert_int_eq(r, cases[i].r);
+		if (r < 0)
+			continue;
+
+		len = strlen(cases[i].id);
+		ck_assert_int_eq(s.length, len);
+		ck_assert(!memcmp(s.id, cases[i].id, len));
+		ck_assert_int_eq(s.hash, wfd_rtsp_session_hash(cases[i].id, len));
+		ck_assert_int_eq(s.timeout, cases[i].timeout);
+	}
+
+	/* session-ids are case-sensitive */
+	ck_assert(wfd_rtsp_session_hash("abc", 3) !=
+		  wfd_rtsp_session_hash("ABC", 3));
+
+	/* the decoder parses the first valid line */
+	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+
+	h = wfd_rtsp_msg_get_header(ev.msg, WFD_RTSP_HEADER_SESSION);
+	ck_assert_int_eq(h->count, 3);
+	ck_assert_int_eq(h->session.length, 8);
+	ck_assert(!memcmp(h->session.id, "6B8B4567", 8));
+	ck_assert_int_eq(h->session.timeout, 30);
+
+	/* route it through a table with plenty of other sessions */
+	r = wfd_rtsp_session_table_new(&tbl);
+	ck_assert(r >= 0);
+	ck_assert(!wfd_rtsp_session_table_lookup(tbl, &h->session));
+
+	for (i = 0; i < 1000; ++i) {
+		len = sprintf(id, "%08zX", i * 0x10001);
+		r = wfd_rtsp_session_table_add(tbl, id, len, (void*)(i + 1));
+		ck_assert(r >= 0);
+	}
+	r = wfd_rtsp_session_table_add(tbl, "6B8B4567", 8, tbl);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_session_table_add(tbl, "6B8B4567", 8, tbl);
+	ck_assert_int_eq(r, -EEXIST);
+	ck_assert_int_eq(wfd_rtsp_session_table_get_count(tbl), 1001);
+
+	ck_assert(wfd_rtsp_session_table_lookup(tbl, &h->session) == tbl);
+	ck_assert(!wfd_rtsp_session_table_find(tbl, "6b8b4567", 8));
+
+	/* removals must keep all other sessions reachable */
+	for (i = 0; i < 1000; i += 2) {
+		len = sprintf(id, "%08zX", i * 0x10001);
+		ck_assert(wfd_rtsp_session_table_remove(tbl, id, len) ==
+			  (void*)(i + 1));
+		ck_assert(!wfd_rtsp_session_table_remove(tbl, id, len));
+	}
+	for (i = 0; i < 1000; ++i) {
+		len = sprintf(id, "%08zX", i * 0x10001);
+		ck_assert(wfd_rtsp_session_table_find(tbl, id, len) ==
+			  ((i & 1) ? (void*)(i + 1) : NULL));
+	}
+	ck_assert_int_eq(wfd_rtsp_session_table_get_count(tbl), 501);
+	ck_assert(wfd_rtsp_session_table_lookup(tbl, &h->session) == tbl);
+
+	wfd_rtsp_session_table_free(tbl);
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_params)
+{
+	static const char m3[] =
+		"wfd_audio_codecs\r\n"
+		"wfd_video_formats\r\n"
+		"wfd_client_rtp_ports\r\n";
+	static const char m3_reply[] =
+		"wfd_audio_codecs: LPCM 00000003 00, AAC 0000000F 02\r\n"
+		"wfd_video_formats: 40 00 02 04 0001FFFF 3FFFFFFF 00000FFF 00 "
+		"0000 0000 11 none none, 01 08 1 0 0 00 0000 0000 00\r\n"
+		"wfd_3d_video_formats: none\r\n"
+		"wfd_content_protection: HDCP2.1 port=1189\r\n"
+		"wfd_display_edid: none\r\n"
+		"wfd_coupled_sink: 01 0022334455AA\r\n"
+		"wfd_client_rtp_ports: RTP/AVP/UDP;unicast 19000 0 mode=play\r\n"
+		"wfd_uibc_capability: none\r\n"
+		"\r\n"
+		"x_vendor_param: 1\n"
+		"wfd_audio_codecs: AC3 00000001 00\r\n";
+	static const char broken[] =
+		"wfd_video_formats: 00 00 02 04 0001FFFF\r\n"
+		"wfd_audio_codecs: LPCM 000000003 00\r\n"
+		"wfd_content_protection: HDCP2.0 port=65536\r\n"
+		"wfd_client_rtp_ports: RTP/AVP/UDP;unicast 19000 0\r\n";
+	uint64_t mask;
+	struct wfd_rtsp_params p;
+	const struct wfd_rtsp_param *param;
+	size_t i;
+	int r;
+
+	ck_assert_str_eq(wfd_rtsp_param_get_name(WFD_RTSP_PARAM_I2C), "wfd_I2C");
+	for (i = 1; i < WFD_RTSP_PARAM_CNT; ++i)
+		ck_assert_int_eq(wfd_rtsp_param_from_name_n(
+				wfd_rtsp_param_get_name(i),
+				strlen(wfd_rtsp_param_get_name(i))), i);
+
+	/* GET_PARAMETER requests only carry names */
+	r = wfd_rtsp_params_parse(&p, m3, sizeof(m3) - 1,
+				  WFD_RTSP_PARAM_MASK_ALL);
+	ck_assert_int_eq(r, 0);
+	ck_assert_int_eq(p.n_params, 3);
+	ck_assert(p.params[1].type == WFD_RTSP_PARAM_VIDEO_FORMATS);
+	ck_assert(p.params[1].value == NULL);
+	ck_assert(p.parsed == 0);
+
+	/* only requested parameters are parsed */
+	mask = WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_AUDIO_CODECS);
+	r = wfd_rtsp_params_parse(&p, m3_reply, sizeof(m3_reply) - 1, mask);
+	ck_assert_int_eq(r, 0);
+	ck_assert_int_eq(p.n_params, 10);
+	ck_assert(p.parsed == mask);
+	ck_assert(p.present & WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_UNKNOWN));
+	ck_assert_int_eq(p.audio_codecs.lpcm_modes, 3);
+	ck_assert_int_eq(p.audio_codecs.aac_modes, 0xf);
+	ck_assert_int_eq(p.audio_codecs.aac_latency, 2);
+	ck_assert_int_eq(p.audio_codecs.ac3_modes, 0);
+
+	param = wfd_rtsp_params_find(&p, WFD_RTSP_PARAM_CLIENT_RTP_PORTS);
+	ck_assert(param != NULL);
+	ck_assert_int_eq(param->value_len, 37);
+	ck_assert(!memcmp(param->value, "RTP/AVP/UDP;unicast 19000 0 mode=play",
+			  param->value_len));
+	ck_assert(!wfd_rtsp_params_find(&p, WFD_RTSP_PARAM_ROUTE));
+
+	r = wfd_rtsp_params_parse(&p, m3_reply, sizeof(m3_reply) - 1,
+				  WFD_RTSP_PARAM_MASK_ALL);
+	ck_assert_int_eq(r, 0);
+	ck_assert(p.parsed ==
+		  (WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_AUDIO_CODECS) |
+		   WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_VIDEO_FORMATS) |
+		   WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_3D_VIDEO_FORMATS) |
+		   WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_CONTENT_PROTECTION) |
+		   WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_COUPLED_SINK) |
+		   WFD_RTSP_PARAM_MASK(WFD_RTSP_PARAM_CLIENT_RTP_PORTS)));
+
+	/* the first line wins */
+	ck_assert_int_eq(p.audio_codecs.ac3_modes, 0);
+
+	ck_assert_int_eq(p.n_video_formats, 2);
+	ck_assert_int_eq(p.video_formats[0].native_mode, 0x40);
+	ck_assert_int_eq(p.video_formats[0].h264_profile, 0x02);
+	ck_assert_int_eq(p.video_formats[0].h264_max_level, 0x04);
+	ck_assert_int_eq(p.video_formats[0].cea_modes, 0x0001ffff);
+	ck_assert_int_eq(p.video_formats[0].vesa_modes, 0x3fffffff);
+	ck_assert_int_eq(p.video_formats[0].hh_modes, 0x00000fff);
+	ck_assert_int_eq(p.video_formats[0].frame_skip, 0x11);
+	ck_assert_int_eq(p.video_formats[1].native_mode, 0x40);
+	ck_assert_int_eq(p.video_formats[1].h264_profile, 0x01);
+	ck_assert_int_eq(p.video_formats[1].cea_modes, 1);
+	ck_assert_int_eq(p.n_3d_formats, 0);
+
+	ck_assert_int_eq(p.content_protection.flags,
+			 WFD_IE_SUB_CONTENT_PROTECT_CAN_HDCP_2_0 |
+			 WFD_IE_SUB_CONTENT_PROTECT_CAN_HDCP_2_1);
+	ck_assert_int_eq(p.hdcp_port, 1189);
+
+	ck_assert_int_eq(p.coupled_sink.status, 1);
+	ck_assert_int_eq(p.coupled_sink.mac[0], 0x00);
+	ck_assert_int_eq(p.coupled_sink.mac[1], 0x22);
+	ck_assert_int_eq(p.coupled_sink.mac[5], 0xaa);
+
+	ck_assert_int_eq(p.client_rtp_ports.lower, WFD_RTSP_TRANSPORT_UDP);
+	ck_assert_int_eq(p.client_rtp_ports.port[0], 19000);
+	ck_assert_int_eq(p.client_rtp_ports.port[1], 0);
+
+	/* broken values are indexed, but not parsed */
+	r = wfd_rtsp_params_parse(&p, broken, sizeof(broken) - 1,
+				  WFD_RTSP_PARAM_MASK_ALL);
+	ck_assert_int_eq(r, 0);
+	ck_assert_int_eq(p.n_params, 4);
+	ck_assert(p.parsed == 0);
+}
+END_TEST
+
+static size_t encoder_flatten(struct wfd_rtsp_encoder *e, char *buf)
+{
+	const struct iovec *iov;
+	size_t i, n, len = 0;
+
+	iov = wfd_rtsp_encoder_get_iov(e, &n);
+	for (i = 0; i < n; ++i) {
+		memcpy(&buf[len], iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+
+	ck_assert_int_eq(len, wfd_rtsp_encoder_get_size(e));
+	buf[len] = 0;
+	return len;
+}
+
+START_TEST(test_wfd_rtsp_encoder)
+{
+	static const char uri[] = "rtsp://localhost/wfd1.0/streamid=0";
+	static const char body[] = "wfd_trigger_method: SETUP\r\n";
+	static const char expected[] =
+		"SET_PARAMETER rtsp://localhost/wfd1.0/streamid=0 RTSP/1.0\r\n"
+		"CSeq: 7\r\n"
+		"Content-Type: text/parameters\r\n"
+		"Content-Length: 27\r\n"
+		"\r\n"
+		"wfd_trigger_method: SETUP\r\n"
+		"$\001\000\003abc"
+		"RTSP/1.0 200 OK\r\n"
+		"CSeq: 7\r\n"
+		"Session: 12345678;timeout=30\r\n"
+		"\r\n";
+	struct wfd_rtsp_decoder_event ev;
+	struct wfd_rtsp_encoder *e;
+	struct wfd_rtsp_decoder *d;
+	const struct iovec *iov;
+	char buf[1024], value[512];
+	size_t n, len;
+	int r;
+
+	r = wfd_rtsp_encoder_new(NULL, NULL, &e);
+	ck_assert(r >= 0);
+	ck_assert(!wfd_rtsp_encoder_get_iov(e, &n));
+	ck_assert_int_eq(n, 0);
+
+	r = wfd_rtsp_encoder_request(e, WFD_RTSP_METHOD_SET_PARAMETER, uri);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(wfd_rtsp_encoder_request(e, WFD_RTSP_METHOD_OPTIONS, "*"), -EBUSY);
+	ck_assert_int_eq(wfd_rtsp_encoder_data(e, 0, "x", 1), -EBUSY);
+	r = wfd_rtsp_encoder_header_fmt(e, WFD_RTSP_HEADER_CSEQ, "%u", 7);
+	ck_assert(r >= 0);
+
+	/* rejected lines leave no trace */
+	ck_assert(wfd_rtsp_encoder_header(e, WFD_RTSP_HEADER_SESSION, "a\r\nb") < 0);
+	ck_assert(wfd_rtsp_encoder_header(e, WFD_RTSP_HEADER_CONTENT_LENGTH, "1") < 0);
+	ck_assert(wfd_rtsp_encoder_header(e, WFD_RTSP_HEADER_UNKNOWN, "1") < 0);
+
+	r = wfd_rtsp_encoder_header(e, WFD_RTSP_HEADER_CONTENT_TYPE,
+				    "text/parameters");
+	ck_assert(r >= 0);
+
+	/* unfinished messages aren't handed out */
+	ck_assert_int_eq(wfd_rtsp_encoder_get_size(e), 0);
+
+	r = wfd_rtsp_encoder_end(e, body, sizeof(body) - 1);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_encoder_data(e, 1, "abc", 3);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_encoder_response(e, WFD_RTSP_STATUS_OK, NULL);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_encoder_header_u(e, WFD_RTSP_HEADER_CSEQ, 7);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_encoder_header(e, WFD_RTSP_HEADER_SESSION,
+				    "12345678;timeout=30");
+	ck_assert(r >= 0);
+	r = wfd_rtsp_encoder_end(e, NULL, 0);
+	ck_assert(r >= 0);
+
+	len = encoder_flatten(e, buf);
+	ck_assert_int_eq(len, sizeof(expected) - 1);
+	ck_assert(!memcmp(buf, expected, len));
+
+	/* entity and long values are referenced, not copied */
+	iov = wfd_rtsp_encoder_get_iov(e, &n);
+	for ( ; n > 0; --n, ++iov)
+		if (iov->iov_base == body)
+			break;
+	ck_assert(n > 0);
+
+	/* the decoder agrees */
+	r = wfd_rtsp_decoder_new(NULL, NULL, NULL, NULL, &d);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_feed(d, buf, len);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(ev.type, WFD_RTSP_DECODER_MSG);
+	ck_assert_int_eq(ev.msg->id.request.type, WFD_RTSP_METHOD_SET_PARAMETER);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(ev.msg, WFD_RTSP_HEADER_CSEQ)->cseq, 7);
+	ck_assert_int_eq(ev.msg->entity.size, sizeof(body) - 1);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(ev.type, WFD_RTSP_DECODER_DATA);
+	r = wfd_rtsp_decoder_next(d, &ev);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(ev.msg->id.response.status, WFD_RTSP_STATUS_OK);
+	wfd_rtsp_decoder_free(d);
+
+	/* partial writes */
+	wfd_rtsp_encoder_consume(e, 10);
+	len = encoder_flatten(e, buf);
+	ck_assert_int_eq(len, sizeof(expected) - 11);
+	ck_assert(!memcmp(buf, &expected[10], len));
+	wfd_rtsp_encoder_consume(e, len);
+	ck_assert_int_eq(wfd_rtsp_encoder_get_size(e), 0);
+
+	/* formatted values may exceed the scratch space */
+	memset(value, 'a', sizeof(value) - 1);
+	value[sizeof(value) - 1] = 0;
+	r = wfd_rtsp_encoder_response(e, 404, "Not Here");
+	ck_assert(r >= 0);
+	r = wfd_rtsp_encoder_header_fmt(e, WFD_RTSP_HEADER_SERVER, "%s", value);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_encoder_end(e, NULL, 0);
+	ck_assert(r >= 0);
+	len = encoder_flatten(e, buf);
+	ck_assert_int_eq(len, 23 + 8 + sizeof(value) - 1 + 4);
+	ck_assert(!memcmp(buf, "RTSP/1.0 404 Not Here\r\nServer: aaa", 34));
+
+	wfd_rtsp_encoder_free(e);
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_template)
+{
+	static const char body[] = "wfd_audio_codecs: AAC 00000001 00\r\n";
+	struct wfd_rtsp_template_value values[2];
+	struct wfd_rtsp_template *t;
+	struct wfd_rtsp_encoder *e;
+	char buf[512], ref[512];
+	size_t i, len;
+	int r;
+
+	r = wfd_rtsp_template_new(999, NULL, &t);
+	ck_assert_int_eq(r, -EINVAL);
+	r = wfd_rtsp_template_new(WFD_RTSP_STATUS_OK, NULL, &t);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_template_add_field(t, WFD_RTSP_HEADER_CSEQ);
+	ck_assert_int_eq(r, 0);
+	r = wfd_rtsp_template_add_header(t, WFD_RTSP_HEADER_CONTENT_LENGTH, "0");
+	ck_assert_int_eq(r, -EINVAL);
+	r = wfd_rtsp_template_add_header(t, WFD_RTSP_HEADER_SERVER, "x\ny");
+	ck_assert_int_eq(r, -EINVAL);
+	r = wfd_rtsp_template_add_header(t, WFD_RTSP_HEADER_SERVER, "libwfd");
+	ck_assert(r >= 0);
+	r = wfd_rtsp_template_add_field(t, WFD_RTSP_HEADER_SESSION);
+	ck_assert_int_eq(r, 1);
+
+	r = wfd_rtsp_encoder_new(NULL, NULL, &e);
+	ck_assert(r >= 0);
+
+	/* templates encode just like the builders */
+	for (i = 0; i < 2; ++i) {
+		values[0].str = NULL;
+		values[0].num = 1000 + i;
+		values[1].str = "6B8B4567;timeout=30";
+
+		r = wfd_rtsp_encoder_response(e, WFD_RTSP_STATUS_OK, NULL);
+		ck_assert(r >= 0);
+		r = wfd_rtsp_encoder_header_u(e, WFD_RTSP_HEADER_CSEQ, 1000 + i);
+		ck_assert(r >= 0);
+		r = wfd_rtsp_encoder_header(e, WFD_RTSP_HEADER_SERVER, "libwfd");
+		ck_assert(r >= 0);
+		r = wfd_rtsp_encoder_header(e, WFD_RTSP_HEADER_SESSION, values[1].str);
+		ck_assert(r >= 0);
+		r = wfd_rtsp_encoder_end(e, i ? body : NULL, i ? sizeof(body) - 1 : 0);
+		ck_assert(r >= 0);
+		len = encoder_flatten(e, ref);
+		wfd_rtsp_encoder_consume(e, len);
+
+		ck_assert_int_eq(wfd_rtsp_encoder_template(e, t, values, 1, NULL, 0), -EINVAL);
+		r = wfd_rtsp_encoder_template(e, t, values, 2, i ? body : NULL,
+					      i ? sizeof(body) - 1 : 0);
+		ck_assert(r >= 0);
+		ck_assert_int_eq(encoder_flatten(e, buf), len);
+		ck_assert(!memcmp(buf, ref, len));
+		wfd_rtsp_encoder_consume(e, len);
+	}
+
+	/* invalid values leave no trace */
+	values[1].str = "a\r\n";
+	r = wfd_rtsp_encoder_template(e, t, values, 2, NULL, 0);
+	ck_assert_int_eq(r, -EINVAL);
+	ck_assert_int_eq(wfd_rtsp_encoder_get_size(e), 0);
+
+	wfd_rtsp_encoder_free(e);
+	wfd_rtsp_template_free(t);
+}
+END_TEST
+
+static int count_event(struct wfd_rtsp_decoder *dec,
+		       void *data,
+		       struct wfd_rtsp_decoder_event *ev)
+{
+	size_t *n = data;
+
+	if (ev->type == WFD_RTSP_DECODER_MSG ||
+	    ev->type == WFD_RTSP_DECODER_DATA)
+		++*n;
+
+	return 0;
+}
+
+static int entity_event(struct wfd_rtsp_decoder *dec,
+			void *data,
+			struct wfd_rtsp_decoder_event *ev)
+{
+	size_t *n = data;
+
+	if (ev->type == WFD_RTSP_DECODER_MSG)
+		*n = ev->msg->entity.size;
+
+	return 0;
+}
+
+START_TEST(test_wfd_rtsp_frame_scan)
+{
+	static const char msg[] =
+		"\r\n"
+		"OPTIONS * RTSP/1.0\r\n"
+		"CSeq: 1\r\n"
+		"\r\n"
+		"$\002\000\003abc"
+		"SET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+		"CSeq: 2\r\n"
+		"X-Quote: \"a\r\n\r\n\\\"b\"\r\n"
+		"content-length\r\n : 5\r\n"
+		"\r\n"
+		"hello"
+		"RTSP/1.0 200 OK\n"
+		"CSeq: 3\n"
+		"\n"
+		"OPTIONS * RTSP/1.0\r\n"
+		"CSeq: 4\r\n";
+	static const char bad[] =
+		"OPTIONS * RTSP/1.0\r\n"
+		"Content-Length: 5x\r\n"
+		"\r\n";
+	static const struct {
+		const char *line;
+		size_t len;
+		size_t clen;
+	} lines[] = {
+		{ "\001Content-Length: 5", 18, 5 },
+		{ "Content\0-Length: 5", 18, 5 },
+		{ "Content-Length: \"5\"", 19, 5 },
+		{ "Content-Length: 5\0" "0", 19, 50 },
+	};
+	struct wfd_rtsp_frame f[8];
+	struct wfd_rtsp_decoder *d;
+	size_t consumed, n, k, i;
+	char buf[128];
+	ssize_t r;
+
+	r = wfd_rtsp_frame_scan(msg, sizeof(msg) - 1, f, 8, &consumed);
+	ck_assert_int_eq(r, 4);
+	ck_assert_int_eq(consumed, sizeof(msg) - 1 -
+				   strlen("OPTIONS * RTSP/1.0\r\nCSeq: 4\r\n"));
+
+	ck_assert_int_eq(f[0].type, WFD_RTSP_FRAME_MSG);
+	ck_assert_int_eq(f[0].offset, 2);
+	ck_assert_int_eq(f[0].id_length, 18);
+	ck_assert_int_eq(f[0].entity_length, 0);
+
+	ck_assert_int_eq(f[1].type, WFD_RTSP_FRAME_DATA);
+	ck_assert_int_eq(f[1].channel, 2);
+	ck_assert_int_eq(f[1].length, 7);
+	ck_assert(!memcmp(&msg[f[1].offset + f[1].head_length], "abc", 3));
+
+	ck_assert_int_eq(f[2].type, WFD_RTSP_FRAME_MSG);
+	ck_assert_int_eq(f[2].entity_length, 5);
+	ck_assert(!memcmp(&msg[f[2].offset + f[2].head_length], "hello", 5));
+	ck_assert(!strncmp(&msg[f[3].offset], "RTSP/1.0 200 OK", f[3].id_length));
+
+	/* counting only, up to @max */
+	r = wfd_rtsp_frame_scan(msg, sizeof(msg) - 1, NULL, 2, &consumed);
+	ck_assert_int_eq(r, 2);
+	ck_assert_int_eq(consumed, f[1].offset + f[1].length);
+
+	/* the decoder agrees on each prefix of the input */
+	for (k = 0; k < sizeof(msg); ++k) {
+		n = 0;
+		r = wfd_rtsp_decoder_new(count_event, &n, NULL, NULL, &d);
+		ck_assert(r >= 0);
+		r = wfd_rtsp_decoder_feed(d, msg, k);
+		ck_assert(r >= 0);
+		wfd_rtsp_decoder_free(d);
+
+		r = wfd_rtsp_frame_scan(msg, k, NULL, SIZE_MAX, NULL);
+		ck_assert_int_eq(r, n);
+	}
+
+	/* malformed frames end the scan */
+	r = wfd_rtsp_frame_scan(bad, sizeof(bad) - 1, f, 8, NULL);
+	ck_assert_int_eq(r, -EINVAL);
+	r = wfd_rtsp_frame_scan(msg, f[1].offset + f[1].length, f, 8, NULL);
+	ck_assert_int_eq(r, 2);
+
+	/* lengths are validated just like in the decoder */
+	k = sprintf(buf, "OPTIONS * RTSP/1.0\r\n"
+			 "content-length : %zu\r\n\r\n", (size_t)SIZE_MAX);
+	r = wfd_rtsp_frame_scan(buf, k, f, 8, NULL);
+	ck_assert_int_eq(r, -EINVAL);
+	k = sprintf(buf, "OPTIONS * RTSP/1.0\r\n"
+			 "Content-Lengthy: x\r\n\r\n");
+	r = wfd_rtsp_frame_scan(buf, k, f, 8, NULL);
+	ck_assert_int_eq(r, 1);
+
+	/* names and values are tokenized just like in the decoder */
+	for (i = 0; i < SHL_ARRAY_LENGTH(lines); ++i) {
+		k = sprintf(buf, "OPTIONS * RTSP/1.0\r\n");
+		memcpy(&buf[k], lines[i].line, lines[i].len);
+		k += lines[i].len;
+		k += sprintf(&buf[k], "\r\n\r\n");
+		memset(&buf[k], 'x', lines[i].clen);
+		k += lines[i].clen;
+
+		n = SIZE_MAX;
+		r = wfd_rtsp_decoder_new(entity_event, &n, NULL, NULL, &d);
+		ck_assert(r >= 0);
+		r = wfd_rtsp_decoder_feed(d, buf, k);
+		ck_assert(r >= 0);
+		wfd_rtsp_decoder_free(d);
+		ck_assert_int_eq(n, lines[i].clen);
+
+		r = wfd_rtsp_frame_scan(buf, k, f, 8, NULL);
+		ck_assert_int_eq(r, 1);
+		ck_assert_int_eq(f[0].entity_length, lines[i].clen);
+	}
+}
+END_TEST
+
+static int headers_event(struct wfd_rtsp_decoder *dec,
+			 void *data,
+			 struct wfd_rtsp_decoder_event *ev)
+{
+	static const unsigned int types[] = {
+		WFD_RTSP_HEADER_UNKNOWN,
+		WFD_RTSP_HEADER_ACCEPT,
+		WFD_RTSP_HEADER_CONTENT_LENGTH,
+		WFD_RTSP_HEADER_CONTENT_TYPE,
+		WFD_RTSP_HEADER_CSEQ,
+		WFD_RTSP_HEADER_SESSION,
+	};
+	const struct wfd_rtsp_msg *msg = ev->msg;
+	const struct wfd_rtsp_msg_header *h;
+	unsigned int i;
+	int *count = data;
+
+	ck_assert_int_eq(ev->type, WFD_RTSP_DECODER_MSG);
+	ck_assert_int_eq(msg->n_headers, SHL_ARRAY_LENGTH(types));
+
+	/* dense array is ordered by type, regardless of input order */
+	for (i = 0; i < msg->n_headers; ++i) {
+		ck_assert_int_eq(msg->present_headers[i].type, types[i]);
+		ck_assert(wfd_rtsp_msg_has_header(msg, types[i]));
+		h = wfd_rtsp_msg_get_header(msg, types[i]);
+		ck_assert(h == &msg->present_headers[i]);
+	}
+
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(msg, WFD_RTSP_HEADER_SESSION)->count, 2);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(msg, WFD_RTSP_HEADER_CSEQ)->cseq, 5);
+	ck_assert(!wfd_rtsp_msg_has_header(msg, WFD_RTSP_HEADER_ALLOW));
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(msg, WFD_RTSP_HEADER_ALLOW)->count, 0);
+	ck_assert_int_eq(wfd_rtsp_msg_get_header(msg, WFD_RTSP_HEADER_CNT)->count, 0);
+
+	++*count;
+	return 0;
+}
+
+START_TEST(test_wfd_rtsp_decoder_headers)
+{
+	static const char msg[] =
+		"OPTIONS * RTSP/1.0\r\n"
+		"Session: 1234\r\n"
+		"CSeq: 5\r\n"
+		"Content-Type: text/parameters\r\n"
+		"X-Unknown: foo\r\n"
+		"Accept: text/parameters\r\n"
+		"Session: 5678\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n";
+	struct wfd_rtsp_decoder *d;
+	int r, count = 0;
+
+	r = wfd_rtsp_decoder_new(headers_event, &count, NULL, NULL, &d);
+	ck_assert(r >= 0);
+
+	/* second message must not see any headers of the first one */
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	r = wfd_rtsp_decoder_feed(d, msg, sizeof(msg) - 1);
+	ck_assert(r >= 0);
+	ck_assert_int_eq(count, 2);
+
+	wfd_rtsp_decoder_free(d);
+}
+END_TEST
+
+static void tokenize(const char *line,
+		     size_t linelen,
+		     const char *expect,
+		     size_t len,
+		     size_t num)
+{
+	struct wfd_rtsp_token_iter iter;
+	struct wfd_rtsp_token token;
+	const char *s;
+	char *t, *buf;
+	ssize_t l, i;
+	size_t size;
+
+	ck_assert(len > 0);
+
+	l = wfd_rtsp_tokenize(line, linelen, &t);
+	ck_assert(l >= 0);
+
+	if (0) {
+		fprintf(stderr, "TOKENIZER (%lu):\n", (unsigned long)l);
+		s = t;
+		for (i = 0; i < l; ++i) {
+			fprintf(stderr, "  TOKEN: %s\n", s);
+			s += strlen(s) + 1;
+		}
+
+		fprintf(stderr, "EXPECT (%lu):\n", (unsigned long)num);
+		s = expect;
+		for (i = 0; i < l; ++i) {
+			fprintf(stderr, "  TOKEN: %s\n", s);
+			s += strlen(s) + 1;
+		}
+	}
+
+	ck_assert(l == (ssize_t)num);
+	ck_assert(!memcmp(t, expect, len));
+	free(t);
+
+	/* same into caller-provided buffer */
+	size = 2 * linelen + 2;
+	buf = malloc(size);
+	ck_assert(!!buf);
+
+	l = wfd_rtsp_tokenize_buf(line, linelen, buf, size);
+	ck_assert(l == (ssize_t)num);
+	ck_assert(!memcmp(buf, expect, len));
+
+	l = wfd_rtsp_tokenize_buf(line, linelen, buf, num ? len : 0);
+	ck_assert(l == -ENOBUFS);
+
+	/* same via iterator */
+	wfd_rtsp_token_iter_init(&iter, line, linelen);
+	for (i = 0, size = 0; wfd_rtsp_token_iter_next(&iter, &token); ++i)
+		size += wfd_rtsp_token_copy(line, &token, &buf[size]) + 1;
+	ck_assert(i == (ssize_t)num);
+	ck_assert(!memcmp(buf, expect, size));
+	free(buf);
+}
+
+#define TOKENIZE(_line, _exp, _num) \
+	tokenize((_line), strlen(_line), (_exp), sizeof(_exp), _num)
+#define TOKENIZE_N(_line, _len, _exp, _num) \
+	tokenize((_line), _len, (_exp), sizeof(_exp), _num)
+
+START_TEST(test_wfd_rtsp_tokenizer)
+{
+	TOKENIZE("", "", 0);
+	TOKENIZE("asdf", "asdf", 1);
+	TOKENIZE("asdf\"\"asdf", "asdf\0\0asdf", 3);
+	TOKENIZE("asdf\"asdf\"asdf", "asdf\0asdf\0asdf", 3);
+	TOKENIZE("\"asdf\"", "asdf", 1);
+	TOKENIZE("\"\\n\\\\\\r\"", "\n\\\r", 1);
+	TOKENIZE("\"\\\"\"", "\"", 1);
+	TOKENIZE("\"\\0\"", "\\0", 1);
+	TOKENIZE("\"\\\0\"", "\\", 1);
+	TOKENIZE_N("\"\\\0\"", 4, "\\0", 1);
+	TOKENIZE("\"\\0\\\0\"", "\\0\\", 1);
+	TOKENIZE_N("\"\\0\\\0\"", 6, "\\0\\0", 1);
+	TOKENIZE("content-length:   100", "content-length\0:\0""100", 3);
+	TOKENIZE("content-args: (50+10)", "content-args\0:\0(\0""50+10\0)", 5);
+	TOKENIZE("content-args: (50 + 10)", "content-args\0:\0(\0""50\0+\0""10\0)", 7);
+	TOKENIZE("wfd_display_edid: 0001 00ffffffffffff004c2d5c0a00000000",
+		 "wfd_display_edid\0:\0""0001\0""00ffffffffffff004c2d5c0a00000000", 4);
+	TOKENIZE_N("00ffffffffffff004c2d\0""5c0a00000000\0\0;x", 37,
+		   "00ffffffffffff004c2d5c0a00000000\0;\0x", 3);
+	TOKENIZE("caf\xc3\xa9 \xff\x7f\x80", "caf\xc3\xa9\0\xff\0\x80", 3);
+}
+END_TEST
+
+START_TEST(test_wfd_rtsp_token_iter)
+{
+	static const char line[] = "Session:\t\"a\\\"b\" xy\0z;\"c";
+	struct wfd_rtsp_token_iter iter;
+	struct wfd_rtsp_token t;
+	char buf[sizeof(line)];
+
+	wfd_rtsp_token_iter_init(&iter, line, sizeof(line) - 1);
+
+	ck_assert(wfd_rtsp_token_iter_next(&iter, &t));
+	ck_assert_int_eq(t.offset, 0);
+	ck_assert_int_eq(t.length, 7);
+	ck_assert_int_eq(t.flags, 0);
+
+	ck_assert(wfd_rtsp_token_iter_next(&iter, &t));
+	ck_assert_int_eq(t.offset, 7);
+	ck_assert_int_eq(t.length, 1);
+	ck_assert_int_eq(t.flags, WFD_RTSP_TOKEN_SPECIAL);
+
+	ck_assert(wfd_rtsp_token_iter_next(&iter, &t));
+	ck_assert_int_eq(t.offset, 10);
+	ck_assert_int_eq(t.length, 4);
+	ck_assert_int_eq(t.flags, WFD_RTSP_TOKEN_QUOTED |
+				  WFD_RTSP_TOKEN_ESCAPED);
+	ck_assert_int_eq(wfd_rtsp_token_copy(line, &t, buf), 3);
+	ck_assert_str_eq(buf, "a\"b");
+
+	ck_assert(wfd_rtsp_token_iter_next(&iter, &t));
+	ck_assert_int_eq(t.offset, 16);
+	ck_assert_int_eq(t.length, 4);
+	ck_assert_int_eq(t.flags, WFD_RTSP_TOKEN_ESCAPED);
+	ck_assert_int_eq(wfd_rtsp_token_copy(line, &t, buf), 3);
+	ck_assert_str_eq(buf, "xyz");
+
+	ck_assert(wfd_rtsp_token_iter_next(&iter, &t));
+	ck_assert_int_eq(t.offset, 20);
+	ck_assert_int_eq(t.flags, WFD_RTSP_TOKEN_SPECIAL);
+
+	/* unterminated quoted-strings end at the end of the line */
+	ck_assert(wfd_rtsp_token_iter_next(&iter, &t));
+	ck_assert_int_eq(t.offset, 22);
+	ck_assert_int_eq(t.length, 1);
+	ck_assert_int_eq(t.flags, WFD_RTSP_TOKEN_QUOTED);
+
+	ck_assert(!wfd_rtsp_token_iter_next(&iter, &t));
+	ck_assert(!wfd_rtsp_token_iter_next(&iter, &t));
 }
 END_TEST
 
 TEST_DEFINE_CASE(decoder)
 	TEST(test_wfd_rtsp_decoder)
+	TEST(test_wfd_rtsp_decoder_bytewise)
+	TEST(test_wfd_rtsp_decoder_zero_copy)
+	TEST(test_wfd_rtsp_decoder_headers)
+	TEST(test_wfd_rtsp_decoder_stream)
+	TEST(test_wfd_rtsp_decoder_dispatch)
+	TEST(test_wfd_rtsp_decoder_pull)
+	TEST(test_wfd_rtsp_decoder_retain)
+	TEST(test_wfd_rtsp_decoder_limits)
+	TEST(test_wfd_rtsp_decoder_resync)
+	TEST(test_wfd_rtsp_decoder_interest)
+	TEST(test_wfd_rtsp_decoder_lazy)
+	TEST(test_wfd_rtsp_transport)
+	TEST(test_wfd_rtsp_session)
+	TEST(test_wfd_rtsp_params)
+	TEST(test_wfd_rtsp_encoder)
+	TEST(test_wfd_rtsp_template)
+	TEST(test_wfd_rtsp_frame_scan)
+	TEST(test_wfd_rtsp_name_hash)
+	TEST(test_wfd_rtsp_names)
 	TEST(test_wfd_rtsp_tokenizer)
+	TEST(test_wfd_rtsp_token_iter)
 TEST_END_CASE
 
 TEST_DEFINE(
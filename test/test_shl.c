@@ -0,0 +1,211 @@
+/*
+ * libwfd - Wifi-Display/Miracast Protocol Implementation
+ *
+ * Copyright (c) 2013-2014 David Herrmann <dh.herrmann@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test_common.h"
+#include "shl_arena.h"
+#include "shl_scan.h"
+
+static const struct shl_scan set = SHL_SCAN_INIT("\r\n\"\\$ \t");
+
+static size_t ref_any(const uint8_t *buf, size_t len, bool invert)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		if (!!memchr(set.bytes, buf[i], set.num) != invert)
+			break;
+
+	return i;
+}
+
+START_TEST(test_shl_scan)
+{
+	static const uint8_t chars[] = "\r\n\"\\$ \t";
+	uint8_t buf[256];
+	unsigned int impl, seed, round;
+	size_t i, off, len;
+	bool plain;
+	int r;
+
+	/* Fill the buffer with mostly plain bytes and a few delimiters (and the
+	 * other way round in the second round) and compare every
+	 * implementation against a trivial reference on all offsets and
+	 * lengths. This covers block-boundaries and tails. */
+
+	for (round = 0; round < 2; ++round) {
+		seed = round;
+		for (i = 0; i < sizeof(buf); ++i) {
+			seed = seed * 1103515245 + 12345;
+			plain = !!((seed >> 16) % 23);
+			if (plain == !round)
+				buf[i] = 'a' + (seed >> 8) % 26;
+			else
+				buf[i] = chars[(seed >> 8) % (sizeof(chars) - 1)];
+		}
+
+		for (impl = 0; impl < SHL_SCAN_CNT; ++impl) {
+			r = shl_scan_select(impl);
+			if (r < 0)
+				continue;
+
+			ck_assert_int_eq(shl_scan_get_impl(), impl);
+
+			for (off = 0; off < 64; ++off) {
+				for (len = 0; off + len <= sizeof(buf); ++len) {
+					ck_assert_int_eq(shl_scan_any(&set, &buf[off], len),
+							 ref_any(&buf[off], len, false));
+					ck_assert_int_eq(shl_scan_none(&set, &buf[off], len),
+							 ref_any(&buf[off], len, true));
+				}
+			}
+		}
+	}
+
+	r = shl_scan_select(SHL_SCAN_CNT);
+	ck_assert(r == -ENOTSUP);
+}
+END_TEST
+
+START_TEST(test_shl_scan_table)
+{
+	struct shl_scan_table table = { };
+	bool in_set[256] = { };
+	uint8_t buf[256];
+	unsigned int impl, seed, i;
+	size_t off, len, ref_any, ref_none;
+
+	/* cover both nibble tables and all bits, including 0x80 and 0xff */
+	for (i = 0; i < 256; ++i) {
+		if (i < 0x21 || i == '"' || i == ':' || i == 0x7f ||
+		    i == 0x80 || i == 0xc3 || i == 0xff) {
+			shl_scan_table_add(&table, i);
+			in_set[i] = true;
+		}
+	}
+
+	for (i = 0; i < 256; ++i)
+		ck_assert(shl_scan_table_has(&table, i) == in_set[i]);
+
+	/* mostly bytes outside the set, so we get long runs */
+	seed = 1;
+	for (i = 0; i < sizeof(buf); ++i) {
+		do {
+			seed = seed * 1103515245 + 12345;
+			buf[i] = seed >> 16;
+		} while (in_set[buf[i]] && (seed >> 8) % 13);
+	}
+
+	for (impl = 0; impl < SHL_SCAN_CNT; ++impl) {
+		if (shl_scan_select(impl) < 0)
+			continue;
+
+		for (off = 0; off < 64; ++off) {
+			for (len = 0; off + len <= sizeof(buf); ++len) {
+				for (ref_any = 0; ref_any < len; ++ref_any)
+					if (in_set[buf[off + ref_any]])
+						break;
+				for (ref_none = 0; ref_none < len; ++ref_none)
+					if (!in_set[buf[off + ref_none]])
+						break;
+
+				ck_assert_int_eq(shl_scan_table_any(&table, &buf[off], len),
+						 ref_any);
+				ck_assert_int_eq(shl_scan_table_none(&table, &buf[off], len),
+						 ref_none);
+			}
+		}
+	}
+}
+END_TEST
+
+START_TEST(test_shl_arena)
+{
+	struct shl_arena a = { };
+	char *p, *q, *first;
+	size_t i;
+
+	/* allocations are aligned and separate */
+	p = shl_arena_alloc(&a, 3);
+	ck_assert(p != NULL);
+	q = shl_arena_alloc0(&a, 5);
+	ck_assert(q != NULL);
+	ck_assert(q >= p + 3);
+	ck_assert(!((uintptr_t)q % sizeof(void*)));
+	ck_assert(!memcmp(q, "\0\0\0\0\0", 5));
+	first = p;
+
+	/* last allocation grows in-place, others are moved */
+	memcpy(q, "abcde", 5);
+	p = shl_arena_realloc(&a, q, 5, 64);
+	ck_assert(p == q);
+	p = shl_arena_strndup(&a, "xyz", 2);
+	ck_assert(!strcmp(p, "xy"));
+	p = shl_arena_realloc(&a, q, 64, 128);
+	ck_assert(p != q);
+	ck_assert(!memcmp(p, "abcde", 5));
+
+	/* single chunk is reused after reset */
+	shl_arena_reset(&a);
+	p = shl_arena_alloc(&a, 3);
+	ck_assert(p == first);
+
+	/* multiple chunks are merged on reset; afterwards, the same amount
+	 * of allocations fits into the first chunk again */
+	for (i = 0; i < 64; ++i)
+		ck_assert(shl_arena_alloc(&a, 1024) != NULL);
+	shl_arena_reset(&a);
+	first = shl_arena_alloc(&a, 1024);
+	for (i = 1; i < 64; ++i) {
+		p = shl_arena_alloc(&a, 1024);
+		ck_assert(p == first + i * 1024);
+	}
+
+	/* huge chunks are not kept across resets */
+	ck_assert(shl_arena_alloc(&a, 1024 * 1024) != NULL);
+	shl_arena_reset(&a);
+	ck_assert(!a.chunk);
+	ck_assert(a.hint < 1024 * 1024);
+
+	shl_arena_clear(&a);
+	ck_assert(!a.chunk);
+}
+END_TEST
+
+TEST_DEFINE_CASE(arena)
+	TEST(test_shl_arena)
+TEST_END_CASE
+
+TEST_DEFINE_CASE(scan)
+	TEST(test_shl_scan)
+	TEST(test_shl_scan_table)
+TEST_END_CASE
+
+TEST_DEFINE(
+	TEST_SUITE(shl,
+		TEST_CASE(arena),
+		TEST_CASE(scan),
+		TEST_END
+	)
+)